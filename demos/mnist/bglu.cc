@@ -4,7 +4,8 @@
 GatedLinearUnitMLP::GatedLinearUnitMLP(size_t input_dim, size_t hidden_dim, size_t output_dim) : 
 W_1_(gooch::randn({hidden_dim, input_dim}) / gooch::FromVector((float) sqrt(input_dim))), 
 W_2_(gooch::randn({hidden_dim, input_dim}) / gooch::FromVector((float) sqrt(input_dim))), 
-W_down_(gooch::randn({output_dim, hidden_dim}) / gooch::FromVector((float) sqrt(hidden_dim))) {}
+W_down_(gooch::randn({output_dim, hidden_dim}) / gooch::FromVector((float) sqrt(hidden_dim))),
+group_({&W_1_, &W_2_, &W_down_}) {}
 
 gooch::Tensor GatedLinearUnitMLP::forward(gooch::Tensor input_batch) {
   gooch::Tensor x_1 = gooch::Einsum(input_batch, W_1_, "batch input_dim, hidden_dim input_dim -> batch hidden_dim");
@@ -12,12 +13,26 @@ gooch::Tensor GatedLinearUnitMLP::forward(gooch::Tensor input_batch) {
   return gooch::Einsum(x_1 * x_2, W_down_, "batch hidden_dim, output_dim hidden_dim -> batch output_dim");
 }
 
+void GatedLinearUnitMLP::Quantize() {
+  quantized_ = {gooch::quantize::QuantizeWeights(W_1_, 0), gooch::quantize::QuantizeWeights(W_2_, 0),
+      gooch::quantize::QuantizeWeights(W_down_, 0)};
+}
+
+gooch::Tensor GatedLinearUnitMLP::forward_int8(gooch::Tensor input_batch) {
+  if (quantized_.empty()) Quantize();
+  gooch::Tensor x_1 = gooch::quantize::Einsum(input_batch, quantized_[0], "batch input_dim, hidden_dim input_dim -> batch hidden_dim");
+  gooch::Tensor x_2 = gooch::quantize::Einsum(input_batch, quantized_[1], "batch input_dim, hidden_dim input_dim -> batch hidden_dim");
+  return gooch::quantize::Einsum(x_1 * x_2, quantized_[2], "batch hidden_dim, output_dim hidden_dim -> batch output_dim");
+}
+
 std::vector<gooch::Tensor> GatedLinearUnitMLP::params() {
   return std::vector<gooch::Tensor>{W_1_, W_2_, W_down_};
 };
 
+gooch::ParameterGroup& GatedLinearUnitMLP::group() {
+  return group_;
+}
+
 void GatedLinearUnitMLP::ZeroGrad() {
-  for (auto t : params()) {
-    t.ZeroGrad();
-  }
+  group_.ZeroGrad();
 }
\ No newline at end of file
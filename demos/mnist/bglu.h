@@ -1,5 +1,7 @@
 #pragma once
 #include "tensor.h"
+#include "parameters.h"
+#include "quantize.h"
 
 
 class GatedLinearUnitMLP {
@@ -7,9 +9,16 @@ private:
   gooch::Tensor W_1_;
   gooch::Tensor W_2_;
   gooch::Tensor W_down_;
+  gooch::ParameterGroup group_;
+  std::vector<gooch::quantize::QuantizedTensor> quantized_;
 public:
   GatedLinearUnitMLP(size_t input_dim, size_t hidden_dim, size_t output_dim);
   gooch::Tensor forward(gooch::Tensor input_batch);
+  // int8 copies of the current weights for forward_int8, taken again after further training
+  void Quantize();
+  // inference through the int8 kernel, no gradients
+  gooch::Tensor forward_int8(gooch::Tensor input_batch);
   std::vector<gooch::Tensor> params();
+  gooch::ParameterGroup& group();
   void ZeroGrad();
 };
\ No newline at end of file
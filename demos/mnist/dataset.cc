@@ -0,0 +1,51 @@
+#include "dataset.h"
+#include "io.h"
+
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+void ConvertMnist(const std::string& csv_path, const std::string& labels_path, const std::string& images_path) {
+  std::ifstream in(csv_path);
+  if (!in) throw std::runtime_error("Cannot open " + csv_path);
+  std::string line;
+  std::getline(in, line);
+  std::vector<float> labels, pixels;
+  size_t width = 0;
+  while (std::getline(in, line)) {
+    if (line.empty()) continue;
+    // the fields are read in place, a row costs no allocations
+    const char* p = line.c_str();
+    char* end;
+    labels.push_back((float) std::strtol(p, &end, 10));
+    size_t count = 0;
+    while (*end == ',') {
+      p = end + 1;
+      pixels.push_back(std::strtof(p, &end) / 255.0f);
+      count++;
+    }
+    if (width == 0) width = count;
+    if (end == p || count != width || (*end != '\0' && *end != '\r')) {
+      throw std::invalid_argument("Malformed row " + std::to_string(labels.size()) + " in " + csv_path);
+    }
+  }
+  size_t rows = labels.size();
+  gooch::Tensor label_tensor({rows});
+  std::copy(labels.begin(), labels.end(), label_tensor.data().get());
+  gooch::Tensor image_tensor({rows, width});
+  std::copy(pixels.begin(), pixels.end(), image_tensor.data().get());
+  gooch::io::Save(label_tensor, labels_path);
+  gooch::io::Save(image_tensor, images_path);
+}
+
+std::pair<gooch::Tensor, gooch::Tensor> LoadMnist(const std::string& csv_path) {
+  namespace fs = std::filesystem;
+  std::string labels_path = csv_path + ".labels.tensor", images_path = csv_path + ".images.tensor";
+  auto stale = [&] (const std::string& path) {
+    return !fs::exists(path) || fs::last_write_time(path) < fs::last_write_time(csv_path);
+  };
+  if (stale(labels_path) || stale(images_path)) ConvertMnist(csv_path, labels_path, images_path);
+  return {gooch::io::Load(labels_path), gooch::io::Load(images_path)};
+}
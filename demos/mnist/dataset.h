@@ -0,0 +1,15 @@
+#pragma once
+
+#include "tensor.h"
+
+#include <string>
+#include <utility>
+
+// Parses an MNIST CSV (a header line, then a label and the pixels per row)
+// once and writes it as two tensor files: the (N) labels as floats and the
+// (N, pixels) images scaled to [0, 1].
+void ConvertMnist(const std::string& csv_path, const std::string& labels_path, const std::string& images_path);
+
+// The labels and images of an MNIST CSV, mapped from the tensor files next to
+// it. They are converted on first use and again whenever the CSV is newer.
+std::pair<gooch::Tensor, gooch::Tensor> LoadMnist(const std::string& csv_path);
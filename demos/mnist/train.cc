@@ -1,6 +1,8 @@
 #include "tensor.h"
 #include "bglu.h"
-#include "mnist.h"
+#include "dataset.h"
+#include "graph.h"
+#include "data.h"
 #include "sgd.cc"
 
 #include <iostream>
@@ -11,29 +13,27 @@
      return 1; 
    } 
    std::string path = argv[1]; 
-   auto [labels, images] = GetMnist(path); 
-   gooch::Tensor x = gooch::FromVector(images); 
+   // mapped from the binary copy of the CSV, which is written on the first run 
+   auto [y, x] = LoadMnist(path); 
+   // the images and labels are data, slicing a batch out of them records nothing
+   x.SetRequiresGrad(false); 
+   y.SetRequiresGrad(false); 
    GatedLinearUnitMLP mlp(784, 100, 10); 
-   gooch::SGD sgd(mlp.params(), 1e-3f); 
+   gooch::SGD sgd(mlp.group(), 1e-3f); 
+   // every batch has the same shape, so the steps after the first replay the captured one 
+   gooch::graph::StepGraph step([&] (const std::vector<gooch::Tensor>& batch) { 
+     return gooch::crossEntropyLoss(mlp.forward(batch[0]), batch[1], gooch::Reduction::kMean); 
+   }, [&] { 
+     sgd.step(); 
+     mlp.ZeroGrad(); 
+   }); 
    int BATCH_SIZE = 10; 
-   // int count = 0; 
-   for (int i = 0; i + BATCH_SIZE <  (int) labels.size(); i+=BATCH_SIZE) { 
-     std::vector<size_t> y_true; 
-     for (int j = i; j < i+BATCH_SIZE; j++) { 
-       y_true.push_back(labels[j]); 
-     } 
-     gooch::Tensor x_ = x(gooch::Slice(i,i+BATCH_SIZE-1)); 
-    //  gooch::Tensor x_ = x(gooch::Slice(0, BATCH_SIZE-1)); 
-     gooch::Tensor y_pred = mlp.forward(x_); 
-
-     gooch::Tensor loss = gooch::crossEntropyLoss(y_pred, y_true); 
+   // batches are gathered on a background thread while the previous step trains 
+   gooch::data::DataLoader loader({x, y}, BATCH_SIZE); 
+   for (size_t i = 0; i < loader.batches_per_epoch(); i++) { 
+     gooch::Tensor loss = step.Step(loader.Next()); 
 
      std::cout << loss << std::endl; 
-
-     mlp.ZeroGrad(); 
-     loss.Backward();  
-     sgd.step(); 
-
    } 
    return 0; 
  }
@@ -0,0 +1,208 @@
+#include "allocator.h"
+
+#include <array>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace gooch {
+namespace allocator {
+
+namespace {
+// Size classes are powers of two up to 256 bytes and quarter steps between
+// powers of two above, so a block wastes at most a fifth of itself.
+constexpr size_t kNumClasses = 256;
+// Blocks a thread keeps per class before handing them to the global pool.
+constexpr size_t kThreadCacheBlocks = 4;
+// Larger blocks are rare enough to go straight to the system.
+constexpr size_t kMaxCachedBlock = size_t(1) << 28;
+
+// Returns the class of a request and sets class_bytes to its block size.
+size_t size_class(size_t bytes, size_t* class_bytes) {
+  if (bytes <= kAlignment) {
+    *class_bytes = kAlignment;
+    return 0;
+  }
+  // base < bytes <= 2 * base
+  size_t log = 63 - __builtin_clzll(bytes - 1);
+  size_t base = size_t(1) << log;
+  size_t quarter = log >= 8 ? (bytes - base + base / 4 - 1) / (base / 4) : 4;
+  *class_bytes = base + quarter * (base / 4);
+  return log * 4 + quarter - 1;
+}
+
+// The block size of a class, the inverse of size_class.
+size_t class_size(size_t c) {
+  if (c == 0) return kAlignment;
+  size_t base = size_t(1) << (c / 4);
+  return base + (c % 4 + 1) * (base / 4);
+}
+
+void* system_allocate(size_t bytes) {
+  void* ptr = std::aligned_alloc(kAlignment, (bytes + kAlignment - 1) / kAlignment * kAlignment);
+  if (ptr == nullptr) throw std::bad_alloc();
+  return ptr;
+}
+
+class System : public Allocator {
+public:
+  void* Allocate(size_t bytes) override { return system_allocate(bytes); }
+  void Free(void* ptr, size_t) override { std::free(ptr); }
+};
+
+std::atomic<size_t> hits{0};
+std::atomic<size_t> misses{0};
+std::atomic<size_t> bytes_cached{0};
+
+using FreeLists = std::array<std::vector<void*>, kNumClasses>;
+
+struct Pool {
+  std::mutex mutex;
+  FreeLists blocks;
+};
+
+// never destroyed, buffers held by statics are freed after exit
+Pool& pool() {
+  static Pool* pool = new Pool();
+  return *pool;
+}
+
+// set once this thread's cache is destroyed, later frees go to the pool
+thread_local bool thread_cache_gone = false;
+
+struct ThreadCache {
+  FreeLists blocks;
+  ~ThreadCache() {
+    thread_cache_gone = true;
+    std::lock_guard<std::mutex> lock(pool().mutex);
+    for (size_t c = 0; c < kNumClasses; c++) {
+      pool().blocks[c].insert(pool().blocks[c].end(), blocks[c].begin(), blocks[c].end());
+    }
+  }
+};
+
+ThreadCache& thread_cache() {
+  thread_local ThreadCache cache;
+  return cache;
+}
+
+class Caching : public Allocator {
+public:
+  void* Allocate(size_t bytes) override {
+    size_t class_bytes;
+    size_t c = size_class(bytes, &class_bytes);
+    if (class_bytes <= kMaxCachedBlock) {
+      void* ptr = nullptr;
+      if (!thread_cache_gone && !thread_cache().blocks[c].empty()) {
+        ptr = thread_cache().blocks[c].back();
+        thread_cache().blocks[c].pop_back();
+      } else {
+        std::lock_guard<std::mutex> lock(pool().mutex);
+        if (!pool().blocks[c].empty()) {
+          ptr = pool().blocks[c].back();
+          pool().blocks[c].pop_back();
+        }
+      }
+      if (ptr != nullptr) {
+        hits++;
+        bytes_cached -= class_bytes;
+        return ptr;
+      }
+    }
+    misses++;
+    return system_allocate(class_bytes);
+  }
+
+  void Free(void* ptr, size_t bytes) override {
+    size_t class_bytes;
+    size_t c = size_class(bytes, &class_bytes);
+    if (class_bytes > kMaxCachedBlock) {
+      std::free(ptr);
+      return;
+    }
+    bytes_cached += class_bytes;
+    if (!thread_cache_gone && thread_cache().blocks[c].size() < kThreadCacheBlocks) {
+      thread_cache().blocks[c].push_back(ptr);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(pool().mutex);
+    pool().blocks[c].push_back(ptr);
+  }
+
+  void Trim() override {
+    auto release = [] (FreeLists& blocks) {
+      for (size_t c = 0; c < kNumClasses; c++) {
+        for (void* ptr : blocks[c]) {
+          std::free(ptr);
+          bytes_cached -= class_size(c);
+        }
+        blocks[c].clear();
+      }
+    };
+    if (!thread_cache_gone) release(thread_cache().blocks);
+    std::lock_guard<std::mutex> lock(pool().mutex);
+    release(pool().blocks);
+  }
+};
+
+Allocator* DefaultAllocator() {
+  const char* env = std::getenv("GOOCH_ALLOCATOR");
+  if (env != nullptr && std::strcmp(env, "system") == 0) return SystemAllocator();
+  return CachingAllocator();
+}
+
+std::atomic<Allocator*> current{nullptr};
+}
+
+Allocator* SystemAllocator() {
+  static System system;
+  return &system;
+}
+
+Allocator* CachingAllocator() {
+  // never destroyed, like the pool
+  static Caching* caching = new Caching();
+  return caching;
+}
+
+void SetAllocator(Allocator* allocator) {
+  current = allocator;
+}
+
+Allocator* GetAllocator() {
+  Allocator* allocator = current.load();
+  if (allocator == nullptr) {
+    Allocator* fallback = DefaultAllocator();
+    current.compare_exchange_strong(allocator, fallback);
+    allocator = current.load();
+  }
+  return allocator;
+}
+
+std::shared_ptr<float> Allocate(size_t size) {
+  Allocator* allocator = GetAllocator();
+  size_t bytes = size * sizeof(float);
+  float* ptr = static_cast<float*>(allocator->Allocate(bytes));
+  return std::shared_ptr<float>(ptr, [allocator, bytes] (float* ptr) { allocator->Free(ptr, bytes); });
+}
+
+std::shared_ptr<uint16_t> Allocate16(size_t size) {
+  Allocator* allocator = GetAllocator();
+  size_t bytes = std::max<size_t>(size, 1) * sizeof(uint16_t);
+  uint16_t* ptr = static_cast<uint16_t*>(allocator->Allocate(bytes));
+  return std::shared_ptr<uint16_t>(ptr, [allocator, bytes] (uint16_t* ptr) { allocator->Free(ptr, bytes); });
+}
+
+Stats GetStats() {
+  return Stats{hits.load(), misses.load(), bytes_cached.load()};
+}
+
+void Trim() {
+  GetAllocator()->Trim();
+}
+
+}
+}
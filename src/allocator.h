@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Storage for tensor data and gradient buffers.
+// Every buffer is aligned to kAlignment bytes and comes from the current
+// Allocator. The default one caches freed blocks by size class, so the handful
+// of sizes a training loop allocates every step are reused instead of going
+// back to the system. Each thread keeps a few blocks per class to itself and
+// shares the rest through a global pool. GOOCH_ALLOCATOR=system turns caching
+// off, e.g. for leak checkers.
+namespace gooch {
+namespace allocator {
+
+constexpr size_t kAlignment = 64;
+
+class Allocator {
+public:
+  virtual ~Allocator() = default;
+  // Returns at least bytes bytes, aligned to kAlignment.
+  virtual void* Allocate(size_t bytes) = 0;
+  // Takes back a block, bytes being what it was allocated with.
+  virtual void Free(void* ptr, size_t bytes) = 0;
+  // Releases memory held for reuse.
+  virtual void Trim() {}
+};
+
+Allocator* SystemAllocator();
+Allocator* CachingAllocator();
+// Buffers are freed by the allocator they came from, so switching allocators
+// does not affect live buffers. The allocator must outlive its buffers.
+void SetAllocator(Allocator* allocator);
+Allocator* GetAllocator();
+
+// A buffer of size floats from the current allocator.
+std::shared_ptr<float> Allocate(size_t size);
+// A buffer of size 16-bit elements, for reduced precision tensors.
+std::shared_ptr<uint16_t> Allocate16(size_t size);
+
+// Counters of the caching allocator.
+struct Stats {
+  size_t hits;         // allocations served from a cache
+  size_t misses;       // allocations that went to the system
+  size_t bytes_cached; // bytes held in caches, ready for reuse
+};
+Stats GetStats();
+
+// Releases the memory the current allocator holds for reuse. For the caching
+// allocator, that is the global pool and the calling thread's cache.
+void Trim();
+
+}
+}
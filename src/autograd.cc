@@ -0,0 +1,139 @@
+#include "autograd.h"
+#include "tensor.h"
+#include "glas.h"
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+namespace gooch {
+namespace autograd {
+
+namespace {
+// the gradients that are still waiting to be consumed by a node
+struct GraphTask {
+  std::unordered_map<const Node*, Tensor> pending;
+};
+
+thread_local GraphTask* current_task = nullptr;
+thread_local bool grad_enabled = true;
+
+// restores the enclosing task even if a backward closure throws
+struct TaskGuard {
+  GraphTask* saved;
+  explicit TaskGuard(GraphTask* task) : saved(current_task) { current_task = task; }
+  ~TaskGuard() { current_task = saved; }
+};
+
+// iterative post-order DFS, inputs come before the nodes that consume them
+std::vector<Node*> TopologicalOrder(Node* root) {
+  std::vector<Node*> order;
+  std::unordered_set<Node*> visited;
+  std::vector<std::pair<Node*, size_t>> stack;
+  visited.insert(root);
+  stack.emplace_back(root, 0);
+  while (!stack.empty()) {
+    auto& [node, next] = stack.back();
+    if (next < node->inputs_.size()) {
+      Node* input = node->inputs_[next++].get();
+      if (visited.insert(input).second) {
+        stack.emplace_back(input, 0);
+      }
+    } else {
+      order.push_back(node);
+      stack.pop_back();
+    }
+  }
+  return order;
+}
+}
+
+Node::Node(BackwardFn backward, std::vector<std::shared_ptr<Node>> inputs) : backward_(std::move(backward)), inputs_(std::move(inputs)) {}
+
+// Long chains (e.g. a loss summed sample by sample) would otherwise be torn down
+// recursively, one stack frame per node. Nodes we hold the last reference to are
+// unlinked here instead.
+Node::~Node() {
+  std::vector<std::shared_ptr<Node>> stack = std::move(inputs_);
+  backward_ = nullptr;
+  while (!stack.empty()) {
+    std::shared_ptr<Node> node = std::move(stack.back());
+    stack.pop_back();
+    if (node.use_count() == 1) {
+      for (auto& input : node->inputs_) {
+        stack.push_back(std::move(input));
+      }
+      node->inputs_.clear();
+      node->backward_ = nullptr;
+    }
+  }
+}
+
+NoGradMode::NoGradMode() : previous_(grad_enabled) {
+  grad_enabled = false;
+}
+
+NoGradMode::~NoGradMode() {
+  grad_enabled = previous_;
+}
+
+bool GradEnabled() {
+  return grad_enabled;
+}
+
+bool Track(Tensor& result, std::initializer_list<const Tensor*> inputs) {
+  bool track = false;
+  for (const Tensor* input : inputs) track = track || input->requires_grad();
+  track = track && grad_enabled;
+  if (!track) result.SetRequiresGrad(false);
+  return track;
+}
+
+bool Track(Tensor& result, const std::vector<Tensor>& inputs) {
+  bool track = false;
+  for (const Tensor& input : inputs) track = track || input.requires_grad();
+  track = track && grad_enabled;
+  if (!track) result.SetRequiresGrad(false);
+  return track;
+}
+
+std::shared_ptr<Node> MakeNode(const std::vector<Tensor>& inputs, BackwardFn backward) {
+  std::vector<std::shared_ptr<Node>> edges;
+  for (const Tensor& input : inputs) {
+    if (input.grad_fn_) edges.push_back(input.grad_fn_);
+  }
+  return std::make_shared<Node>(std::move(backward), std::move(edges));
+}
+
+void Accumulate(const std::shared_ptr<Node>& node, const Tensor& grad) {
+  if (current_task == nullptr) {
+    RunBackward(node, grad);
+    return;
+  }
+  auto it = current_task->pending.find(node.get());
+  if (it == current_task->pending.end()) {
+    current_task->pending.emplace(node.get(), grad);
+  } else {
+    // out of place, the first contribution may alias another node's gradient
+    it->second = glas::add(it->second, grad);
+  }
+}
+
+void RunBackward(const std::shared_ptr<Node>& root, const Tensor& grad) {
+  GraphTask task;
+  TaskGuard guard(&task);
+  std::vector<Node*> order = TopologicalOrder(root.get());
+  task.pending.emplace(root.get(), grad);
+  for (auto it = order.rbegin(); it != order.rend(); ++it) {
+    auto entry = task.pending.find(*it);
+    if (entry == task.pending.end()) continue;
+    Tensor node_grad = entry->second;
+    task.pending.erase(entry);
+    if ((*it)->backward_) (*it)->backward_(node_grad);
+  }
+}
+
+}
+}
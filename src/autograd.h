@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <functional>
+#include <initializer_list>
+
+namespace gooch {
+
+class Tensor;
+
+namespace autograd {
+
+using BackwardFn = std::function<void(const Tensor&)>;
+
+// A node on the autograd tape.
+// Every differentiable op records one node on its result. The node knows how to
+// turn the gradient of its output into gradients of its inputs (backward_), and
+// which nodes produced those inputs (inputs_), which is all the engine needs to
+// order the graph.
+class Node {
+public:
+  BackwardFn backward_;
+  std::vector<std::shared_ptr<Node>> inputs_;
+
+  Node(BackwardFn backward, std::vector<std::shared_ptr<Node>> inputs);
+  ~Node();
+};
+
+// Turns off recording on this thread for its lifetime, e.g. for evaluation.
+// Ops inside the scope build no node and capture nothing, so their inputs and
+// intermediates are freed as soon as the caller drops them, and their results
+// do not require a gradient.
+class NoGradMode {
+public:
+  NoGradMode();
+  ~NoGradMode();
+private:
+  bool previous_;
+};
+
+bool GradEnabled();
+
+// Whether an op records a node for result: recording is on and some input
+// requires a gradient. Ops call this before building their backward closure.
+// If it returns false, result is marked as not requiring a gradient.
+bool Track(Tensor& result, std::initializer_list<const Tensor*> inputs);
+bool Track(Tensor& result, const std::vector<Tensor>& inputs);
+
+// Records a node for an op with the given inputs. Only inputs that have a node
+// themselves become edges, leaves just receive their gradient in the closure.
+std::shared_ptr<Node> MakeNode(const std::vector<Tensor>& inputs, BackwardFn backward);
+
+// Hands a gradient to the node that produced a tensor. During a backward pass the
+// gradient is summed with the other contributions for that node and consumed once
+// all of its consumers have run. Outside of a backward pass this starts one.
+void Accumulate(const std::shared_ptr<Node>& node, const Tensor& grad);
+
+// Runs one reverse-topological pass over the graph rooted at root.
+void RunBackward(const std::shared_ptr<Node>& root, const Tensor& grad);
+
+}
+}
@@ -0,0 +1,120 @@
+#include "data.h"
+#include "glas.h"
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+#include <stdexcept>
+
+namespace gooch {
+namespace data {
+
+DataLoader::DataLoader(const std::vector<Tensor>& tensors, size_t batch_size, bool shuffle, unsigned seed, size_t buffers)
+    : batch_size_(batch_size), shuffle_(shuffle), generator_(seed) {
+  if (tensors.empty()) {
+    throw std::invalid_argument("DataLoader needs at least one tensor");
+  }
+  if (buffers < 2) {
+    throw std::invalid_argument("DataLoader needs at least two buffers to overlap with training");
+  }
+  examples_ = tensors[0].shape().empty() ? 0 : tensors[0].shape()[0];
+  for (const Tensor& t : tensors) {
+    if (t.shape().empty() || t.shape()[0] != examples_) {
+      throw std::invalid_argument("DataLoader tensors must hold the same number of examples along their first axis");
+    }
+    // the worker copies whole examples, so it reads a dense float32 copy if it has to
+    Tensor source = t.is_contiguous() && t.dtype() == DType::kFloat32 ? t : glas::cast(t, DType::kFloat32);
+    source.data();
+    sources_.push_back(source);
+    utils::Span<size_t> shape = t.shape();
+    example_sizes_.push_back(std::accumulate(shape.begin() + 1, shape.end(), (size_t) 1, std::multiplies<size_t>()));
+  }
+  if (batch_size == 0 || batch_size > examples_) {
+    throw std::invalid_argument("DataLoader batch size must be between 1 and the number of examples");
+  }
+  for (size_t i = 0; i < buffers; i++) {
+    std::vector<Tensor> batch;
+    for (const Tensor& source : sources_) {
+      std::vector<size_t> shape = source.shape();
+      shape[0] = batch_size;
+      Tensor buffer(shape);
+      buffer.SetRequiresGrad(false);
+      batch.push_back(buffer);
+    }
+    buffers_.push_back(batch);
+    free_.push_back(i);
+  }
+  worker_ = std::thread([this] { Run(); });
+}
+
+DataLoader::~DataLoader() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  changed_.notify_all();
+  worker_.join();
+}
+
+const std::vector<Tensor>& DataLoader::Next() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (holding_) {
+    free_.push_back(held_);
+    holding_ = false;
+    changed_.notify_all();
+  }
+  changed_.wait(lock, [this] { return !ready_.empty() || error_; });
+  if (ready_.empty()) std::rethrow_exception(error_);
+  held_ = ready_.front();
+  ready_.pop_front();
+  holding_ = true;
+  return buffers_[held_];
+}
+
+size_t DataLoader::batches_per_epoch() const {
+  return examples_ / batch_size_;
+}
+
+void DataLoader::Run() {
+  std::vector<size_t> order(examples_);
+  std::iota(order.begin(), order.end(), (size_t) 0);
+  try {
+    while (true) {
+      if (shuffle_) std::shuffle(order.begin(), order.end(), generator_);
+      for (size_t b = 0; b < batches_per_epoch(); b++) {
+        size_t buffer;
+        {
+          std::unique_lock<std::mutex> lock(mutex_);
+          changed_.wait(lock, [this] { return stop_ || !free_.empty(); });
+          if (stop_) return;
+          buffer = free_.front();
+          free_.pop_front();
+        }
+        Fill(buffers_[buffer], order.data() + b * batch_size_);
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          ready_.push_back(buffer);
+        }
+        changed_.notify_all();
+      }
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    error_ = std::current_exception();
+    changed_.notify_all();
+  }
+}
+
+void DataLoader::Fill(std::vector<Tensor>& batch, const size_t* examples) {
+  for (size_t t = 0; t < sources_.size(); t++) {
+    size_t n = example_sizes_[t];
+    const float* in = sources_[t].data().get() + sources_[t].offset();
+    float* out = batch[t].data().get();
+    for (size_t i = 0; i < batch_size_; i++) {
+      std::memcpy(out + i * n, in + examples[i] * n, n * sizeof(float));
+    }
+  }
+}
+
+}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "tensor.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Batching of in-memory datasets on a background thread.
+// A DataLoader holds a few batch buffers, allocated once. Its worker takes a
+// free buffer, copies the next batch_size examples into it and queues it, so
+// a batch is prepared while the previous ones are being trained on. The
+// order is reshuffled every epoch. Only whole batches are produced, so every
+// batch has the same shape and a graph::StepGraph keeps replaying.
+namespace gooch {
+namespace data {
+
+class DataLoader {
+public:
+  // Every tensor holds one example per index of its first axis, and all of
+  // them hold the same number of examples. buffers (at least 2) bounds how
+  // many batches are ready or in use at once. The tensors are read by the
+  // worker, they must not be written while the loader is alive.
+  DataLoader(const std::vector<Tensor>& tensors, size_t batch_size, bool shuffle = true, unsigned seed = 0, size_t buffers = 3);
+  DataLoader(const DataLoader&) = delete;
+  DataLoader& operator=(const DataLoader&) = delete;
+  ~DataLoader();
+
+  // The next batch, one contiguous float32 (batch_size, ...) tensor per
+  // dataset tensor, without gradients. Waits for the worker if it is behind.
+  // The tensors are valid until the following call, which hands their buffer
+  // back to be refilled. An error in the worker is rethrown here.
+  const std::vector<Tensor>& Next();
+  size_t batches_per_epoch() const;
+
+private:
+  void Run();
+  void Fill(std::vector<Tensor>& batch, const size_t* examples);
+
+  std::vector<Tensor> sources_;
+  std::vector<size_t> example_sizes_;
+  size_t examples_;
+  size_t batch_size_;
+  bool shuffle_;
+  std::mt19937 generator_;
+  std::vector<std::vector<Tensor>> buffers_;
+
+  std::mutex mutex_;
+  std::condition_variable changed_;
+  std::deque<size_t> free_;
+  std::deque<size_t> ready_;
+  size_t held_;
+  bool holding_ = false;
+  bool stop_ = false;
+  std::exception_ptr error_;
+  std::thread worker_;
+};
+
+}
+}
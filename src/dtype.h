@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Element types a tensor can be stored in.
+// Reduced precision tensors keep 16 bits per element and are widened to
+// float32 for arithmetic, so kernels always accumulate in float32. The
+// elementwise ops and einsum read them directly and store their result in
+// the same type when every tensor operand has it; other ops widen the whole
+// tensor through Tensor::data() first.
+// For mixed precision training, keep the parameters in float32 as master
+// weights, update them with the optimizer as usual and cast() them to a
+// reduced type in forward. The cast passes the float32 gradient straight
+// back to the master weights.
+namespace gooch {
+
+enum class DType { kFloat32, kBFloat16, kFloat16 };
+
+inline size_t SizeOf(DType dtype) {
+  return dtype == DType::kFloat32 ? 4 : 2;
+}
+
+inline const char* Name(DType dtype) {
+  switch (dtype) {
+  case DType::kBFloat16: return "bfloat16";
+  case DType::kFloat16: return "float16";
+  default: return "float32";
+  }
+}
+
+inline uint32_t float_bits(float x) {
+  uint32_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  return bits;
+}
+
+inline float bits_float(uint32_t bits) {
+  float x;
+  std::memcpy(&x, &bits, sizeof(x));
+  return x;
+}
+
+// bfloat16 is the top half of a float32, rounded to nearest even. NaNs stay quiet NaNs.
+inline uint16_t float_to_bf16(float x) {
+  uint32_t bits = float_bits(x);
+  if ((bits & 0x7fffffffu) > 0x7f800000u) return (uint16_t) ((bits >> 16) | 0x40);
+  bits += 0x7fff + ((bits >> 16) & 1);
+  return (uint16_t) (bits >> 16);
+}
+
+inline float bf16_to_float(uint16_t x) {
+  return bits_float((uint32_t) x << 16);
+}
+
+// IEEE half precision, rounded to nearest even, overflowing to infinity.
+inline uint16_t float_to_fp16(float x) {
+  uint32_t bits = float_bits(x);
+  uint16_t sign = (uint16_t) ((bits >> 16) & 0x8000);
+  uint32_t abs = bits & 0x7fffffffu;
+  if (abs > 0x7f800000u) return sign | 0x7e00;
+  if (abs >= 0x477ff000u) return sign | 0x7c00; // rounds past the largest half
+  if (abs < 0x38800000u) {
+    // subnormal or zero: scale so the half's subnormal step becomes one unit and round there
+    float scaled = bits_float(abs) * 16777216.0f; // 2^24
+    uint32_t units = (uint32_t) scaled;
+    float rest = scaled - (float) units;
+    if (rest > 0.5f || (rest == 0.5f && (units & 1))) units++;
+    return sign | (uint16_t) units;
+  }
+  uint32_t mantissa = abs + 0xfff + ((abs >> 13) & 1); // round the 13 dropped bits to nearest even
+  return sign | (uint16_t) ((mantissa - 0x38000000u) >> 13);
+}
+
+inline float fp16_to_float(uint16_t x) {
+  uint32_t sign = (uint32_t) (x & 0x8000) << 16;
+  uint32_t exponent = (x >> 10) & 0x1f, mantissa = x & 0x3ff;
+  if (exponent == 0) {
+    // zero or subnormal, exact in float32
+    float value = mantissa * 5.9604644775390625e-8f; // 2^-24
+    return bits_float(float_bits(value) | sign);
+  }
+  if (exponent == 0x1f) return bits_float(sign | 0x7f800000u | (mantissa << 13));
+  return bits_float(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+}
@@ -0,0 +1,351 @@
+#include "glas.h"
+#include "tensor.h"
+#include "utils.h"
+#include "parallel.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <unordered_map>
+
+namespace gooch {
+namespace glas {
+
+namespace {
+std::vector<std::string> tokenize(const std::string& equation) {
+  std::vector<std::string> tokens;
+  std::string token;
+  for (char c : equation) {
+    if (isspace(c)) {
+      if (token.size() != 0) tokens.push_back(token);
+      token = "";
+    } else if (c == ',') {
+      if (token.size() != 0) tokens.push_back(token);
+      tokens.push_back(",");
+      token = "";
+    } else {
+      token += c;
+    }
+  }
+  if(token.size() != 0) tokens.push_back(token);
+  return tokens;
+}
+
+// the stride a label advances an operand by, repeated labels walk the diagonal
+int label_stride(const std::vector<std::string>& labels, const std::vector<int>& strides, const std::string& label) {
+  int stride = 0;
+  for (size_t i = 0; i < labels.size(); ++i) {
+    if (labels[i] == label) stride += strides[i];
+  }
+  return stride;
+}
+
+bool has_label(const std::vector<std::string>& labels, const std::string& label) {
+  return std::find(labels.begin(), labels.end(), label) != labels.end();
+}
+
+bool has_repeats(const std::vector<std::string>& labels) {
+  std::vector<std::string> sorted = labels;
+  std::sort(sorted.begin(), sorted.end());
+  return std::adjacent_find(sorted.begin(), sorted.end()) != sorted.end();
+}
+
+// calls f(a_offset, b_offset, c_offset) for every index of the loop nest
+template <typename F>
+void for_each_index(const std::vector<EinsumLoop>& loops, F f) {
+  std::vector<size_t> index(loops.size(), 0);
+  ptrdiff_t a_offset = 0, b_offset = 0, c_offset = 0;
+  while (true) {
+    f(a_offset, b_offset, c_offset);
+    size_t i = loops.size();
+    while (i > 0) {
+      --i;
+      if (++index[i] < loops[i].size) {
+        a_offset += loops[i].a_stride;
+        b_offset += loops[i].b_stride;
+        c_offset += loops[i].c_stride;
+        break;
+      }
+      a_offset -= (ptrdiff_t) (loops[i].size - 1) * loops[i].a_stride;
+      b_offset -= (ptrdiff_t) (loops[i].size - 1) * loops[i].b_stride;
+      c_offset -= (ptrdiff_t) (loops[i].size - 1) * loops[i].c_stride;
+      index[i] = 0;
+      if (i == 0) return;
+    }
+    if (loops.empty()) return;
+  }
+}
+
+std::shared_ptr<EinsumPlan> compile(const EinsumEquation& equation,
+    const std::vector<size_t>& a_shape, const std::vector<int>& a_strides,
+    const std::vector<size_t>& b_shape, const std::vector<int>& b_strides,
+    const std::vector<size_t>& c_shape_hint) {
+  if (equation.a_labels_.size() != a_shape.size() || equation.b_labels_.size() != b_shape.size()) {
+    throw std::invalid_argument("Invalid equation");
+  }
+  // sizes of every label, in order of first appearance
+  std::vector<std::string> labels;
+  std::map<std::string, size_t> size_map;
+  auto add_sizes = [&](const std::vector<std::string>& operand, const std::vector<size_t>& shape) {
+    for (size_t i = 0; i < operand.size(); ++i) {
+      auto it = size_map.find(operand[i]);
+      if (it == size_map.end()) {
+        labels.push_back(operand[i]);
+        size_map[operand[i]] = shape[i];
+      } else if (it->second != shape[i]) {
+        throw std::invalid_argument("Invalid equation");
+      }
+    }
+  };
+  add_sizes(equation.a_labels_, a_shape);
+  add_sizes(equation.b_labels_, b_shape);
+  for (size_t i = 0; i < equation.c_labels_.size(); ++i) {
+    const std::string& label = equation.c_labels_[i];
+    if (size_map.count(label)) continue;
+    if (i >= c_shape_hint.size()) {
+      throw std::invalid_argument("Invalid equation");
+    }
+    labels.push_back(label);
+    size_map[label] = c_shape_hint[i];
+  }
+
+  auto plan = std::make_shared<EinsumPlan>();
+  plan->equation = &equation;
+  plan->a_shape = a_shape;
+  plan->a_strides = a_strides;
+  plan->b_shape = b_shape;
+  plan->b_strides = b_strides;
+  for (const std::string& label : equation.c_labels_) {
+    plan->c_shape.push_back(size_map[label]);
+  }
+  plan->c_strides = utils::compute_strides(plan->c_shape);
+  plan->c_size = 1;
+  for (size_t dim : plan->c_shape) {
+    plan->c_size *= dim;
+  }
+
+  std::vector<EinsumLoop> loops;
+  for (const std::string& label : labels) {
+    loops.push_back(EinsumLoop{size_map[label],
+        label_stride(equation.a_labels_, a_strides, label),
+        label_stride(equation.b_labels_, b_strides, label),
+        label_stride(equation.c_labels_, plan->c_strides, label)});
+  }
+
+  // classify the labels to see whether this is a (batched) matrix multiply
+  std::vector<size_t> rows, cols, contracted;
+  std::vector<EinsumLoop> batch;
+  bool gemm = !has_repeats(equation.a_labels_) && !has_repeats(equation.b_labels_) && !has_repeats(equation.c_labels_);
+  for (size_t i = 0; i < labels.size() && gemm; ++i) {
+    bool in_a = has_label(equation.a_labels_, labels[i]);
+    bool in_b = has_label(equation.b_labels_, labels[i]);
+    bool in_c = has_label(equation.c_labels_, labels[i]);
+    if (in_a && in_b && in_c) batch.push_back(loops[i]);
+    else if (in_a && in_c) rows.push_back(i);
+    else if (in_b && in_c) cols.push_back(i);
+    else if (in_a && in_b) contracted.push_back(i);
+    else gemm = false;
+  }
+  gemm = gemm && rows.size() <= 1 && cols.size() <= 1 && contracted.size() <= 1;
+
+  plan->gemm = gemm;
+  if (gemm) {
+    plan->loops = batch;
+    EinsumLoop none{1, 0, 0, 0};
+    const EinsumLoop& row = rows.empty() ? none : loops[rows[0]];
+    const EinsumLoop& col = cols.empty() ? none : loops[cols[0]];
+    const EinsumLoop& inner = contracted.empty() ? none : loops[contracted[0]];
+    plan->M = row.size;
+    plan->N = col.size;
+    plan->K = inner.size;
+    plan->a_rs = row.a_stride;
+    plan->a_cs = inner.a_stride;
+    plan->b_rs = inner.b_stride;
+    plan->b_cs = col.b_stride;
+    plan->c_rs = row.c_stride;
+    plan->c_cs = col.c_stride;
+  } else {
+    // contracted labels innermost so they accumulate in a register, then the
+    // output is walked in memory order
+    std::stable_sort(loops.begin(), loops.end(), [](const EinsumLoop& x, const EinsumLoop& y) {
+      if ((x.c_stride == 0) != (y.c_stride == 0)) return y.c_stride == 0;
+      return x.c_stride > y.c_stride;
+    });
+    plan->loops = loops;
+    plan->M = plan->N = plan->K = 0;
+    plan->a_rs = plan->a_cs = plan->b_rs = plan->b_cs = plan->c_rs = plan->c_cs = 0;
+  }
+  return plan;
+}
+
+void run_loops(const EinsumPlan& plan, const float* a, const float* b, float* c) {
+  if (plan.loops.empty()) {
+    c[0] += a[0] * b[0];
+    return;
+  }
+  const EinsumLoop inner = plan.loops.back();
+  auto run_inner = [inner] (const float* a_ptr, const float* b_ptr, float* c_ptr) {
+    if (inner.c_stride == 0) {
+      float sum = 0.0f;
+      for (size_t i = 0; i < inner.size; ++i) {
+        sum += a_ptr[(ptrdiff_t) i * inner.a_stride] * b_ptr[(ptrdiff_t) i * inner.b_stride];
+      }
+      *c_ptr += sum;
+    } else {
+      for (size_t i = 0; i < inner.size; ++i) {
+        c_ptr[(ptrdiff_t) i * inner.c_stride] += a_ptr[(ptrdiff_t) i * inner.a_stride] * b_ptr[(ptrdiff_t) i * inner.b_stride];
+      }
+    }
+  };
+  if (plan.loops.size() == 1) {
+    run_inner(a, b, c);
+    return;
+  }
+  // the outermost loop is split across threads when it walks disjoint outputs
+  const EinsumLoop outermost = plan.loops.front();
+  std::vector<EinsumLoop> middle(plan.loops.begin() + 1, plan.loops.end() - 1);
+  size_t work = 1;
+  for (const EinsumLoop& loop : plan.loops) {
+    work *= loop.size;
+  }
+  size_t grain = outermost.c_stride == 0 ? outermost.size : std::max<size_t>(1, parallel::kGrainSize / std::max<size_t>(1, work / outermost.size));
+  parallel::parallel_for(0, outermost.size, grain, [&] (size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      const float* a_row = a + (ptrdiff_t) i * outermost.a_stride;
+      const float* b_row = b + (ptrdiff_t) i * outermost.b_stride;
+      float* c_row = c + (ptrdiff_t) i * outermost.c_stride;
+      for_each_index(middle, [&](ptrdiff_t a_offset, ptrdiff_t b_offset, ptrdiff_t c_offset) {
+        run_inner(a_row + a_offset, b_row + b_offset, c_row + c_offset);
+      });
+    }
+  });
+}
+}
+
+EinsumEquation::EinsumEquation(std::vector<std::string> a_labels, std::vector<std::string> b_labels, std::vector<std::string> c_labels) : a_labels_(a_labels), b_labels_(b_labels), c_labels_(c_labels) {}
+
+const EinsumEquation& EinsumEquation::a_grad() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!a_grad_) a_grad_ = std::make_unique<EinsumEquation>(c_labels_, b_labels_, a_labels_);
+  return *a_grad_;
+}
+
+const EinsumEquation& EinsumEquation::b_grad() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (!b_grad_) b_grad_ = std::make_unique<EinsumEquation>(c_labels_, a_labels_, b_labels_);
+  return *b_grad_;
+}
+
+std::shared_ptr<const EinsumPlan> EinsumEquation::plan(utils::Span<size_t> a_shape, utils::Span<int> a_strides,
+    utils::Span<size_t> b_shape, utils::Span<int> b_strides,
+    utils::Span<size_t> c_shape) const {
+  // ranks are part of the key so the concatenation is unambiguous, the buffer
+  // is reused so a lookup that hits does not allocate
+  thread_local std::vector<long> key;
+  key.clear();
+  key.reserve(4 * (a_shape.size() + b_shape.size()) + c_shape.size() + 3);
+  key.push_back(a_shape.size());
+  key.insert(key.end(), a_shape.begin(), a_shape.end());
+  key.insert(key.end(), a_strides.begin(), a_strides.end());
+  key.push_back(b_shape.size());
+  key.insert(key.end(), b_shape.begin(), b_shape.end());
+  key.insert(key.end(), b_strides.begin(), b_strides.end());
+  key.push_back(c_shape.size());
+  key.insert(key.end(), c_shape.begin(), c_shape.end());
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = plans_.find(key);
+  if (it != plans_.end()) {
+    lru_.splice(lru_.begin(), lru_, it->second);
+    return it->second->second;
+  }
+  std::shared_ptr<const EinsumPlan> plan = compile(*this, a_shape, a_strides, b_shape, b_strides, c_shape);
+  lru_.emplace_front(key, plan);
+  plans_[key] = lru_.begin();
+  // layouts that keep changing, e.g. variable batch sizes, must not grow the cache without bound
+  if (lru_.size() > kMaxEinsumPlans) {
+    plans_.erase(lru_.back().first);
+    lru_.pop_back();
+  }
+  return plan;
+}
+
+const EinsumEquation& parse_einsum(const std::string& equation) {
+  static std::mutex mutex;
+  static std::unordered_map<std::string, std::unique_ptr<EinsumEquation>> equations;
+  std::lock_guard<std::mutex> lock(mutex);
+  auto it = equations.find(equation);
+  if (it != equations.end()) return *it->second;
+
+  std::vector<std::string> tokens = tokenize(equation);
+  std::vector<std::string> operands[3];
+  for (size_t i = 0, state = 0; i < tokens.size(); i++) {
+    if (tokens[i] == ",") {
+      if (state != 0) {
+        throw std::invalid_argument("Invalid equation");
+      }
+      state = 1;
+    } else if (tokens[i] == "->") {
+      if (state != 1) {
+        throw std::invalid_argument("Invalid equation");
+      }
+      state = 2;
+    } else {
+      operands[state].push_back(tokens[i]);
+    }
+  }
+  auto parsed = std::make_unique<EinsumEquation>(operands[0], operands[1], operands[2]);
+  const EinsumEquation& result = *parsed;
+  equations[equation] = std::move(parsed);
+  return result;
+}
+
+namespace {
+// Runs plan into c, zeroed first and laid out as the plan's output. Operands
+// whose layout differs from the plan's are planned again.
+void run_plan(const EinsumPlan& plan, const Tensor& a, const Tensor& b, float* c) {
+  if (a.shape() != plan.a_shape || a.strides() != plan.a_strides || b.shape() != plan.b_shape || b.strides() != plan.b_strides) {
+    run_plan(*plan.equation->plan(a.shape(), a.strides(), b.shape(), b.strides(), plan.c_shape), a, b, c);
+    return;
+  }
+  std::fill(c, c + plan.c_size, 0.0f);
+  // data() widens reduced precision operands, the copies live until the plan has run
+  std::shared_ptr<float> a_buffer = a.data(), b_buffer = b.data();
+  const float* a_data = a_buffer.get() + a.offset();
+  const float* b_data = b_buffer.get() + b.offset();
+  if (plan.gemm) {
+    for_each_index(plan.loops, [&](ptrdiff_t a_offset, ptrdiff_t b_offset, ptrdiff_t c_offset) {
+      sgemm(plan.M, plan.N, plan.K, a_data + a_offset, plan.a_rs, plan.a_cs,
+          b_data + b_offset, plan.b_rs, plan.b_cs, c + c_offset, plan.c_rs, plan.c_cs);
+    });
+  } else {
+    run_loops(plan, a_data, b_data, c);
+  }
+}
+}
+
+Tensor einsum(const EinsumPlan& plan, const Tensor& a, const Tensor& b) {
+  std::shared_ptr<float> c_buffer = allocator::Allocate(plan.c_size);
+  run_plan(plan, a, b, c_buffer.get());
+  Tensor c(plan.c_shape, plan.c_strides, 0, c_buffer);
+  // reduced precision operands were widened by data(), the product is stored back in their type
+  if (a.dtype() != DType::kFloat32 && a.dtype() == b.dtype()) return glas::cast(c, a.dtype());
+  return c;
+}
+
+void einsum_into(const EinsumPlan& plan, const Tensor& a, const Tensor& b, const Tensor& out) {
+  if (out.dtype() != DType::kFloat32 || !out.is_contiguous() || out.shape() != plan.c_shape) {
+    throw std::invalid_argument("einsum_into expects a contiguous float32 output of the plan's shape");
+  }
+  run_plan(plan, a, b, out.data().get() + out.offset());
+}
+
+Tensor einsum(const Tensor& a, const Tensor& b, const std::string& equation) {
+  return einsum(*parse_einsum(equation).plan(a.shape(), a.strides(), b.shape(), b.strides()), a, b);
+}
+
+}
+}
@@ -0,0 +1,359 @@
+#include "fusion.h"
+#include "tensor.h"
+#include "glas.h"
+#include "utils.h"
+#include "parallel.h"
+#include "kernels.h"
+#include "graph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace gooch {
+namespace fusion {
+
+namespace {
+thread_local bool lazy = false;
+
+// bounds the scratch tiles an evaluation needs, larger operands are evaluated on their own
+constexpr size_t kMaxFusedNodes = 32;
+// elements of one row processed per step, every node gets a tile of this size
+constexpr size_t kTile = 256;
+
+void apply(Op op, size_t n, const float* x, const float* y, float* out) {
+  const kernels::Table& k = kernels::Get();
+  bool fast = kernels::FastMath();
+  switch (op) {
+  case Op::kAdd: k.add(n, x, 1, y, 1, out); break;
+  case Op::kSub: k.sub(n, x, 1, y, 1, out); break;
+  case Op::kMul: k.mul(n, x, 1, y, 1, out); break;
+  case Op::kDiv: k.div(n, x, 1, y, 1, out); break;
+  case Op::kNeg: k.neg(n, x, out); break;
+  case Op::kInv: (fast ? k.inv_fast : k.inv)(n, x, out); break;
+  case Op::kRoot: k.root(n, x, out); break;
+  case Op::kExp: (fast ? k.exp_fast : k.exp)(n, x, out); break;
+  case Op::kLog: (fast ? k.log_fast : k.log)(n, x, out); break;
+  case Op::kLeaf: std::copy(x, x + n, out); break;
+  }
+}
+
+bool is_evaluated(Expr* expr) {
+  std::lock_guard<std::mutex> lock(expr->mutex);
+  return expr->buffer != nullptr;
+}
+
+// iterative post-order DFS, inputs come before the nodes that read them.
+// With stop_at_evaluated, nodes below the root that already have a buffer are
+// treated as inputs and not descended into.
+std::vector<Expr*> topological_order(Expr* root, bool stop_at_evaluated) {
+  std::vector<Expr*> order;
+  std::unordered_set<Expr*> visited;
+  std::vector<std::pair<Expr*, size_t>> stack;
+  visited.insert(root);
+  stack.emplace_back(root, 0);
+  while (!stack.empty()) {
+    auto& [node, next] = stack.back();
+    bool stop = stop_at_evaluated && node != root && is_evaluated(node);
+    if (!stop && next < node->inputs.size()) {
+      Expr* input = node->inputs[next++].get();
+      if (visited.insert(input).second) {
+        stack.emplace_back(input, 0);
+      }
+    } else {
+      order.push_back(node);
+      stack.pop_back();
+    }
+  }
+  return order;
+}
+
+std::shared_ptr<Expr> make_leaf(const Tensor& t) {
+  auto expr = std::make_shared<Expr>();
+  expr->op = Op::kLeaf;
+  expr->shape = t.shape();
+  expr->leaf = t;
+  expr->num_nodes = 1;
+  return expr;
+}
+
+// the expression of a, inlined if a is a whole, unevaluated lazy result
+std::shared_ptr<Expr> as_expr(const Tensor& a) {
+  std::shared_ptr<Expr> expr = a.expr();
+  if (expr && a.offset() == 0 && a.shape() == expr->shape && a.strides() == utils::compute_strides(expr->shape) && !is_evaluated(expr.get())) {
+    return expr;
+  }
+  return make_leaf(a);
+}
+
+std::shared_ptr<float> evaluate(Expr& root);
+
+// the shape two operands broadcast to, both are known to be compatible
+std::vector<size_t> broadcast_shape(const std::vector<size_t>& a, const std::vector<size_t>& b) {
+  const std::vector<size_t>& longer = a.size() >= b.size() ? a : b;
+  const std::vector<size_t>& shorter = a.size() >= b.size() ? b : a;
+  std::vector<size_t> shape = longer;
+  for (size_t i = 0; i < shorter.size(); ++i) {
+    size_t& dim = shape[longer.size() - shorter.size() + i];
+    if (dim == 1) dim = shorter[i];
+  }
+  return shape;
+}
+
+// an operand that would grow a backward expression past the bound is evaluated into a leaf first
+std::shared_ptr<Expr> bounded(const std::shared_ptr<Expr>& x, size_t others) {
+  if (x->num_nodes + others + 1 <= kMaxFusedNodes || x->op == Op::kLeaf) return x;
+  std::shared_ptr<float> buffer;
+  {
+    std::lock_guard<std::mutex> lock(x->mutex);
+    buffer = x->buffer;
+  }
+  return make_leaf(Tensor(x->shape, utils::compute_strides(x->shape), 0, buffer ? buffer : evaluate(*x)));
+}
+
+// a node of a backward expression, it has no autograd node of its own since only update_grad reads it
+std::shared_ptr<Expr> combine(Op op, std::shared_ptr<Expr> x, std::shared_ptr<Expr> y = nullptr) {
+  x = bounded(x, y ? y->num_nodes : 0);
+  if (y) y = bounded(y, x->num_nodes);
+  auto expr = std::make_shared<Expr>();
+  expr->op = op;
+  expr->shape = y ? broadcast_shape(x->shape, y->shape) : x->shape;
+  expr->inputs = {x};
+  if (y) expr->inputs.push_back(y);
+  expr->num_nodes = x->num_nodes + (y ? y->num_nodes : 0) + 1;
+  return expr;
+}
+
+// One reverse pass over the region, the gradients of its leaves go through update_grad.
+// The adjoints are expressions over the region's own nodes, so the gradient of
+// every leaf is evaluated in one fused pass that recomputes the forward values
+// it needs tile by tile instead of keeping a full-size tensor per node.
+void backpropagate(const std::shared_ptr<Expr>& root, const Tensor& grad) {
+  std::vector<Expr*> order = topological_order(root.get(), false);
+  std::unordered_map<Expr*, std::shared_ptr<Expr>> values;
+  values.emplace(root.get(), root);
+  for (Expr* node : order) {
+    for (const std::shared_ptr<Expr>& input : node->inputs) values.emplace(input.get(), input);
+  }
+  std::unordered_map<Expr*, std::shared_ptr<Expr>> adjoints;
+  adjoints.emplace(root.get(), as_expr(grad));
+  auto accumulate = [&adjoints] (Expr* node, const std::shared_ptr<Expr>& contribution) {
+    auto it = adjoints.find(node);
+    if (it == adjoints.end()) adjoints.emplace(node, contribution);
+    else it->second = combine(Op::kAdd, it->second, contribution);
+  };
+  std::shared_ptr<Expr> half;
+  for (auto it = order.rbegin(); it != order.rend(); ++it) {
+    Expr* node = *it;
+    auto entry = adjoints.find(node);
+    if (entry == adjoints.end()) continue;
+    std::shared_ptr<Expr> g = entry->second;
+    if (node->op == Op::kLeaf) {
+      update_grad(g->op == Op::kLeaf ? *g->leaf : Tensor(g->shape, g), *node->leaf);
+      adjoints.erase(node);
+      continue;
+    }
+    Expr* x = node->inputs[0].get();
+    Expr* y = node->inputs.size() > 1 ? node->inputs[1].get() : nullptr;
+    const std::shared_ptr<Expr>& out = values.at(node);
+    switch (node->op) {
+    case Op::kAdd:
+      accumulate(x, g);
+      accumulate(y, g);
+      break;
+    case Op::kSub:
+      accumulate(x, g);
+      accumulate(y, combine(Op::kNeg, g));
+      break;
+    case Op::kMul:
+      accumulate(x, combine(Op::kMul, g, values.at(y)));
+      accumulate(y, combine(Op::kMul, g, values.at(x)));
+      break;
+    case Op::kDiv: {
+      std::shared_ptr<Expr> x_grad = combine(Op::kDiv, g, values.at(y));
+      accumulate(x, x_grad);
+      accumulate(y, combine(Op::kNeg, combine(Op::kMul, x_grad, out)));
+      break;
+    }
+    case Op::kNeg:
+      accumulate(x, combine(Op::kNeg, g));
+      break;
+    case Op::kInv:
+      accumulate(x, combine(Op::kNeg, combine(Op::kMul, g, combine(Op::kMul, out, out))));
+      break;
+    case Op::kExp:
+      accumulate(x, combine(Op::kMul, g, out));
+      break;
+    case Op::kLog:
+      accumulate(x, combine(Op::kDiv, g, values.at(x)));
+      break;
+    case Op::kRoot:
+      if (!half) half = make_leaf(FromVector(0.5f));
+      accumulate(x, combine(Op::kDiv, combine(Op::kMul, g, half), out));
+      break;
+    default:
+      break;
+    }
+    adjoints.erase(node);
+  }
+}
+
+Tensor make_result(const std::shared_ptr<Expr>& expr) {
+  // a fused region is evaluated once into a buffer of its own, replays cannot refresh it
+  graph::Unsupported();
+  Tensor result(expr->shape, expr);
+  std::vector<Tensor> leaves;
+  for (Expr* node : topological_order(expr.get(), false)) {
+    if (node->op == Op::kLeaf) leaves.push_back(*node->leaf);
+  }
+  if (autograd::Track(result, leaves)) {
+    result.grad_fn_ = autograd::MakeNode(leaves, [expr] (const Tensor& grad) {
+      backpropagate(expr, grad);
+    });
+  }
+  return result;
+}
+
+// keeps the fused region bounded, an operand that would grow it too far is evaluated first
+void bound_region(std::shared_ptr<Expr>& x, const Tensor& a, size_t others) {
+  if (x->num_nodes + others + 1 > kMaxFusedNodes && x->op != Op::kLeaf) {
+    a.data();
+    x = make_leaf(a);
+  }
+}
+
+std::shared_ptr<float> evaluate(Expr& root) {
+  std::vector<Expr*> order = topological_order(&root, true);
+  bool scalar = root.shape.empty();
+  std::vector<size_t> shape = scalar ? std::vector<size_t>{1} : root.shape;
+  size_t rank = shape.size();
+  size_t len = shape[rank - 1];
+  size_t size = std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<size_t>());
+  // an empty result has nothing to compute, and no rows to divide the work into
+  if (size == 0) return allocator::Allocate(0);
+  size_t rows = size / len;
+
+  // where every input reads from, broadcast to the output shape
+  std::unordered_map<Expr*, size_t> slot;
+  std::vector<bool> is_input(order.size());
+  std::vector<const float*> input_data(order.size(), nullptr);
+  std::vector<std::vector<int>> input_strides(order.size());
+  std::vector<Tensor> keep_alive;
+  // the slots every computed node reads its operands from, looked up once so
+  // that the workers only read plain vectors
+  std::vector<size_t> x_slot(order.size()), y_slot(order.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    Expr* node = order[i];
+    slot[node] = i;
+    is_input[i] = node != &root && (node->op == Op::kLeaf || is_evaluated(node));
+    if (!is_input[i]) {
+      // inputs come first in the order, so their slots are known
+      x_slot[i] = slot.at(node->inputs[0].get());
+      y_slot[i] = node->inputs.size() > 1 ? slot.at(node->inputs[1].get()) : i;
+      continue;
+    }
+    Tensor source = node->op == Op::kLeaf ? *node->leaf : Tensor(node->shape, utils::compute_strides(node->shape), 0, node->buffer);
+    Tensor broadcast = Tensor::Broadcast(source, root.shape);
+    keep_alive.push_back(broadcast);
+    input_data[i] = broadcast.data().get() + broadcast.offset();
+    input_strides[i] = scalar ? std::vector<int>{0} : std::vector<int>(broadcast.strides());
+  }
+
+  std::shared_ptr<float> buffer = allocator::Allocate(size);
+  float* out = buffer.get();
+  parallel::parallel_for(0, rows, std::max<size_t>(1, parallel::kGrainSize / len), [&] (size_t begin, size_t end) {
+    std::vector<float> scratch(order.size() * kTile);
+    std::vector<const float*> tile(order.size());
+    std::vector<ptrdiff_t> row_offset(order.size());
+    for (size_t r = begin; r < end; ++r) {
+      for (size_t i = 0; i < order.size(); ++i) {
+        if (!is_input[i]) continue;
+        ptrdiff_t offset = 0;
+        size_t rest = r;
+        for (size_t d = rank - 1; d-- > 0;) {
+          offset += (ptrdiff_t) (rest % shape[d]) * input_strides[i][d];
+          rest /= shape[d];
+        }
+        row_offset[i] = offset;
+      }
+      for (size_t j = 0; j < len; j += kTile) {
+        size_t n = std::min(kTile, len - j);
+        for (size_t i = 0; i < order.size(); ++i) {
+          float* own = scratch.data() + i * kTile;
+          if (is_input[i]) {
+            int stride = input_strides[i][rank - 1];
+            const float* source = input_data[i] + row_offset[i] + (ptrdiff_t) j * stride;
+            if (stride == 1) {
+              tile[i] = source;
+              continue;
+            }
+            for (size_t k = 0; k < n; ++k) {
+              own[k] = source[(ptrdiff_t) k * stride];
+            }
+            tile[i] = own;
+          } else {
+            Expr* node = order[i];
+            float* target = i + 1 == order.size() ? out + r * len + j : own;
+            const float* x = tile[x_slot[i]];
+            const float* y = node->inputs.size() > 1 ? tile[y_slot[i]] : nullptr;
+            apply(node->op, n, x, y, target);
+            tile[i] = target;
+          }
+        }
+      }
+    }
+  });
+  return buffer;
+}
+}
+
+LazyMode::LazyMode() : previous_(lazy) {
+  lazy = true;
+}
+
+LazyMode::~LazyMode() {
+  lazy = previous_;
+}
+
+bool Enabled() {
+  return lazy;
+}
+
+Tensor Unary(Op op, const Tensor& a) {
+  std::shared_ptr<Expr> x = as_expr(a);
+  bound_region(x, a, 0);
+  auto expr = std::make_shared<Expr>();
+  expr->op = op;
+  expr->shape = a.shape();
+  expr->inputs = {x};
+  expr->num_nodes = x->num_nodes + 1;
+  return make_result(expr);
+}
+
+Tensor Binary(Op op, const Tensor& a, const Tensor& b) {
+  std::shared_ptr<Expr> x = as_expr(a);
+  std::shared_ptr<Expr> y = as_expr(b);
+  if (x->num_nodes >= y->num_nodes) {
+    bound_region(x, a, y->num_nodes);
+    bound_region(y, b, x->num_nodes);
+  } else {
+    bound_region(y, b, x->num_nodes);
+    bound_region(x, a, y->num_nodes);
+  }
+  auto expr = std::make_shared<Expr>();
+  expr->op = op;
+  expr->shape = Tensor::GetBroadcastShape(a, b);
+  expr->inputs = {x, y};
+  expr->num_nodes = x->num_nodes + y->num_nodes + 1;
+  return make_result(expr);
+}
+
+std::shared_ptr<float> Materialize(Expr& expr) {
+  std::lock_guard<std::mutex> lock(expr.mutex);
+  if (!expr.buffer) expr.buffer = evaluate(expr);
+  return expr.buffer;
+}
+
+}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "tensor.h"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <optional>
+
+// Lazy elementwise fusion.
+// Inside a LazyMode scope the elementwise Tensor ops (+, -, *, /, unary -, exp,
+// log, inv, root) do not compute anything. They record an expression DAG on
+// their result instead, inlining the DAGs of operands that are themselves
+// unevaluated results. The DAG is evaluated in one tiled pass over the output
+// the first time the result's data is read, which every non-elementwise op
+// does. Each result gets a single autograd node for its whole fused region.
+// Gradients go straight to the region's inputs, so the .grad() of tensors that
+// were inlined into a region is not accumulated.
+namespace gooch {
+namespace fusion {
+
+enum class Op { kLeaf, kAdd, kSub, kMul, kDiv, kNeg, kInv, kExp, kLog, kRoot };
+
+// A node of a recorded expression. Leaves hold the tensor they read from.
+struct Expr {
+  Op op;
+  std::vector<size_t> shape;
+  std::vector<std::shared_ptr<Expr>> inputs;
+  std::optional<Tensor> leaf;
+  size_t num_nodes; // an upper bound on the nodes of the DAG rooted here
+  std::mutex mutex;
+  std::shared_ptr<float> buffer; // set once evaluated
+};
+
+// Turns on lazy elementwise mode on this thread for its lifetime.
+class LazyMode {
+public:
+  LazyMode();
+  ~LazyMode();
+private:
+  bool previous_;
+};
+
+bool Enabled();
+Tensor Unary(Op op, const Tensor& a);
+Tensor Binary(Op op, const Tensor& a, const Tensor& b);
+// Evaluates the expression once and returns its contiguous buffer.
+std::shared_ptr<float> Materialize(Expr& expr);
+
+}
+}
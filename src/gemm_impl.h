@@ -0,0 +1,211 @@
+// The GEMM kernel, written once against a vector type Vec and included by
+// kernels.cc inside one namespace per instruction set, see kernels_impl.h.
+// No include guard: this file is meant to be included several times.
+//
+// A cache-blocked GEMM in the style of GotoBLAS/BLIS.
+// B is packed into KC x NC blocks that live in L3, A into MC x KC blocks that
+// live in L2, and a register-blocked MR x NR micro kernel streams through the
+// packed panels. Packing also absorbs arbitrary operand strides, which is how
+// transposed einsum operands are handled without a separate copy.
+namespace {
+constexpr size_t MR = 6;
+// two vector registers of columns, with MR rows that is 12 accumulators
+constexpr size_t NR = 2 * Vec::kWidth;
+constexpr size_t MC = 120;
+constexpr size_t KC = 256;
+constexpr size_t NC = 2048;
+
+// packs an mc x kc block of A into MR-row panels, zero padding the last panel
+void pack_a(size_t mc, size_t kc, const float* a, int rs, int cs, float* packed) {
+  for (size_t i = 0; i < mc; i += MR) {
+    size_t rows = std::min(MR, mc - i);
+    for (size_t p = 0; p < kc; ++p) {
+      for (size_t r = 0; r < rows; ++r) {
+        packed[r] = a[(ptrdiff_t) (i + r) * rs + (ptrdiff_t) p * cs];
+      }
+      for (size_t r = rows; r < MR; ++r) {
+        packed[r] = 0.0f;
+      }
+      packed += MR;
+    }
+  }
+}
+
+// packs a kc x nc block of B into NR-column panels, zero padding the last panel
+void pack_b(size_t kc, size_t nc, const float* b, int rs, int cs, float* packed) {
+  for (size_t j = 0; j < nc; j += NR) {
+    size_t cols = std::min(NR, nc - j);
+    for (size_t p = 0; p < kc; ++p) {
+      const float* row = b + (ptrdiff_t) p * rs + (ptrdiff_t) j * cs;
+      if (cols == NR && cs == 1) {
+        Vec::store(packed, Vec::load(row));
+        Vec::store(packed + Vec::kWidth, Vec::load(row + Vec::kWidth));
+      } else {
+        for (size_t c = 0; c < cols; ++c) {
+          packed[c] = row[(ptrdiff_t) c * cs];
+        }
+        for (size_t c = cols; c < NR; ++c) {
+          packed[c] = 0.0f;
+        }
+      }
+      packed += NR;
+    }
+  }
+}
+
+// Packing buffers are per thread. They are reached through these functions and
+// passed around as pointers, because a thread_local named inside a lambda that
+// runs on a worker refers to the worker's copy.
+float* a_buffer() {
+  thread_local std::vector<float> buffer(MC * KC);
+  return buffer.data();
+}
+
+float* b_buffer() {
+  thread_local std::vector<float> buffer(KC * NC);
+  return buffer.data();
+}
+
+// C[rows x cols] += A_panel * B_panel over kc
+void micro_kernel(size_t kc, const float* a, const float* b, float* c, int rs, int cs, size_t rows, size_t cols) {
+  constexpr size_t W = Vec::kWidth;
+  typename Vec::Reg acc[MR][2];
+  for (size_t r = 0; r < MR; ++r) {
+    acc[r][0] = Vec::zero();
+    acc[r][1] = Vec::zero();
+  }
+  for (size_t p = 0; p < kc; ++p) {
+    typename Vec::Reg b0 = Vec::load(b);
+    typename Vec::Reg b1 = Vec::load(b + W);
+    for (size_t r = 0; r < MR; ++r) {
+      typename Vec::Reg a_vec = Vec::set1(a[r]);
+      acc[r][0] = Vec::fmadd(a_vec, b0, acc[r][0]);
+      acc[r][1] = Vec::fmadd(a_vec, b1, acc[r][1]);
+    }
+    a += MR;
+    b += NR;
+  }
+  if (rows == MR && cols == NR && cs == 1) {
+    for (size_t r = 0; r < MR; ++r) {
+      float* row = c + (ptrdiff_t) r * rs;
+      Vec::store(row, Vec::add(Vec::load(row), acc[r][0]));
+      Vec::store(row + W, Vec::add(Vec::load(row + W), acc[r][1]));
+    }
+  } else {
+    float tile[MR * NR];
+    for (size_t r = 0; r < MR; ++r) {
+      Vec::store(tile + r * NR, acc[r][0]);
+      Vec::store(tile + r * NR + W, acc[r][1]);
+    }
+    for (size_t r = 0; r < rows; ++r) {
+      for (size_t col = 0; col < cols; ++col) {
+        c[(ptrdiff_t) r * rs + (ptrdiff_t) col * cs] += tile[r * NR + col];
+      }
+    }
+  }
+}
+}
+
+void sgemm(size_t M, size_t N, size_t K,
+    const float* a, int a_rs, int a_cs,
+    const float* b, int b_rs, int b_cs,
+    float* c, int c_rs, int c_cs) {
+  // one unit of parallel work is an MC x (NR * kPanelsPerTask) tile of C
+  constexpr size_t kPanelsPerTask = 4;
+  // a task is worth handing to another thread at about a 64^3 multiply
+  size_t flops_per_task = MC * NR * kPanelsPerTask * std::min(K, KC);
+  size_t grain = std::max<size_t>(1, (64 * 64 * 64) / std::max<size_t>(1, flops_per_task));
+  float* b_packed = b_buffer();
+  for (size_t jc = 0; jc < N; jc += NC) {
+    size_t nc = std::min(NC, N - jc);
+    size_t panels = (nc + NR - 1) / NR;
+    for (size_t pc = 0; pc < K; pc += KC) {
+      size_t kc = std::min(KC, K - pc);
+      const float* b_block = b + (ptrdiff_t) pc * b_rs + (ptrdiff_t) jc * b_cs;
+      parallel::parallel_for(0, panels, std::max<size_t>(1, grain * kPanelsPerTask), [&] (size_t begin, size_t end) {
+        size_t cols = std::min(end * NR, nc) - begin * NR;
+        pack_b(kc, cols, b_block + (ptrdiff_t) (begin * NR) * b_cs, b_rs, b_cs, b_packed + begin * NR * kc);
+      });
+      size_t m_blocks = (M + MC - 1) / MC;
+      size_t n_groups = (panels + kPanelsPerTask - 1) / kPanelsPerTask;
+      parallel::parallel_for(0, m_blocks * n_groups, grain, [&] (size_t begin, size_t end) {
+        for (size_t task = begin; task < end; ++task) {
+          size_t ic = (task / n_groups) * MC;
+          size_t mc = std::min(MC, M - ic);
+          size_t jr_begin = (task % n_groups) * kPanelsPerTask * NR;
+          size_t jr_end = std::min(jr_begin + kPanelsPerTask * NR, nc);
+          // A is packed per task, once per group of column panels
+          float* a_packed = a_buffer();
+          pack_a(mc, kc, a + (ptrdiff_t) ic * a_rs + (ptrdiff_t) pc * a_cs, a_rs, a_cs, a_packed);
+          for (size_t jr = jr_begin; jr < jr_end; jr += NR) {
+            for (size_t ir = 0; ir < mc; ir += MR) {
+              float* c_tile = c + (ptrdiff_t) (ic + ir) * c_rs + (ptrdiff_t) (jc + jr) * c_cs;
+              micro_kernel(kc, a_packed + ir * kc, b_packed + jr * kc, c_tile, c_rs, c_cs,
+                  std::min(MR, mc - ir), std::min(NR, nc - jr));
+            }
+          }
+        }
+      });
+    }
+  }
+}
+
+namespace {
+// dot products of R rows of A with C rows of B, every loaded vector is used R or C times
+template <size_t R, size_t C>
+void qdot_block(size_t K, const int8_t* a, const int8_t* b, int32_t* out) {
+  typename Vec::IReg acc[R][C];
+  for (size_t r = 0; r < R; ++r) {
+    for (size_t c = 0; c < C; ++c) acc[r][c] = Vec::izero();
+  }
+  for (size_t p = 0; p < K; p += Vec::kDotWidth) {
+    typename Vec::IReg av[R], a_abs[R];
+    for (size_t r = 0; r < R; ++r) {
+      av[r] = Vec::load_i8(a + r * K + p);
+      a_abs[r] = Vec::abs_i8(av[r]);
+    }
+    for (size_t c = 0; c < C; ++c) {
+      typename Vec::IReg bv = Vec::load_i8(b + c * K + p);
+      for (size_t r = 0; r < R; ++r) acc[r][c] = Vec::dot_i8(acc[r][c], a_abs[r], av[r], bv);
+    }
+  }
+  for (size_t r = 0; r < R; ++r) {
+    for (size_t c = 0; c < C; ++c) out[r * C + c] = Vec::ireduce_add(acc[r][c]);
+  }
+}
+}
+
+// 2 x 4 blocks of dot products over panels of B that stay in L2,
+// the int32 sums are dequantized as they are stored
+void qgemm(size_t M, size_t N, size_t K,
+    const int8_t* a, const float* a_scale,
+    const int8_t* b, const float* b_scale,
+    float* c, long c_rs, long c_cs) {
+  constexpr size_t QR = 2, QC = 4;
+  constexpr size_t kPanelBytes = 128 * 1024;
+  size_t panel = std::max(QC, kPanelBytes / std::max<size_t>(1, K) / QC * QC);
+  int32_t sums[QR * QC];
+  for (size_t j0 = 0; j0 < N; j0 += panel) {
+    size_t j_end = std::min(N, j0 + panel);
+    for (size_t i = 0; i < M; i += QR) {
+      size_t rows = std::min(QR, M - i);
+      for (size_t j = j0; j < j_end; j += QC) {
+        size_t cols = std::min(QC, j_end - j);
+        if (rows == QR && cols == QC) {
+          qdot_block<QR, QC>(K, a + i * K, b + j * K, sums);
+        } else {
+          for (size_t r = 0; r < rows; ++r) {
+            for (size_t col = 0; col < cols; ++col) {
+              qdot_block<1, 1>(K, a + (i + r) * K, b + (j + col) * K, sums + r * QC + col);
+            }
+          }
+        }
+        for (size_t r = 0; r < rows; ++r) {
+          for (size_t col = 0; col < cols; ++col) {
+            c[(long) (i + r) * c_rs + (long) (j + col) * c_cs] = (float) sums[r * QC + col] * a_scale[i + r] * b_scale[j + col];
+          }
+        }
+      }
+    }
+  }
+}
@@ -1,11 +1,15 @@
 #include "glas.h"
 #include "tensor.h"
 #include "utils.h"
+#include "parallel.h"
+#include "kernels.h"
 
-#include <immintrin.h>
+#include <algorithm>
+#include <numeric>
 #include <map>
 #include <cmath>
 #include <unordered_set>
+#include <stdexcept>
 
 namespace gooch {
 namespace glas {
@@ -16,347 +20,927 @@ void adam_update(size_t N,
     const float* v,     // second moment
     float lr,
     float eps) {
-const __m256 lr_vec = _mm256_set1_ps(lr);
-const __m256 eps_vec = _mm256_set1_ps(eps);
-for (size_t i = 0; i < N - N%8; i += 8) {
-__m256 m_vec = _mm256_loadu_ps(m + i);
-__m256 v_vec = _mm256_loadu_ps(v + i);
-v_vec = _mm256_sqrt_ps(v_vec);
-v_vec = _mm256_add_ps(v_vec, eps_vec);
-__m256 upd = _mm256_div_ps(m_vec, v_vec);
-upd = _mm256_mul_ps(lr_vec, upd);
-__m256 theta_vec = _mm256_loadu_ps(theta + i);
-theta_vec = _mm256_sub_ps(theta_vec, upd);
-_mm256_storeu_ps(theta + i, theta_vec);
+  kernels::Get().adam_update(N, theta, m, v, lr, eps);
 }
-for (size_t i = N - N%8; i < N; ++i) {
-theta[i] -= lr * (m[i] / (std::sqrt(v[i]) + eps));
+
+void adam_step(const std::vector<AdamTensor>& tensors, const kernels::AdamStep& step) {
+  struct Chunk {
+    const AdamTensor* tensor;
+    size_t begin;
+    size_t size;
+  };
+  std::vector<Chunk> chunks;
+  for (const AdamTensor& t : tensors) {
+    for (size_t begin = 0; begin < t.N; begin += parallel::kGrainSize) {
+      chunks.push_back({&t, begin, std::min(parallel::kGrainSize, t.N - begin)});
+    }
+  }
+  auto kernel = kernels::Get().adam_step;
+  parallel::parallel_for(0, chunks.size(), 1, [&] (size_t begin, size_t end) {
+    for (size_t c = begin; c < end; ++c) {
+      const Chunk& chunk = chunks[c];
+      const AdamTensor& t = *chunk.tensor;
+      kernel(chunk.size, t.param + chunk.begin, t.grad + chunk.begin, t.m + chunk.begin, t.v + chunk.begin, step);
+    }
+  });
+}
+
+void inplace_add_square_const(size_t N, float a, const float* x, float* y) {
+  kernels::Get().add_square_scaled(N, a, x, y);
 }
+
+void axpy(size_t N, float a, const float* x, float* y) {
+  auto kernel = kernels::Get().axpy;
+  parallel::parallel_for(0, N, parallel::kGrainSize, [=] (size_t begin, size_t end) {
+    kernel(end - begin, a, x + begin, y + begin);
+  });
 }
 
+namespace {
+kernels::WidenRow widen_kernel(DType dtype) {
+  return dtype == DType::kBFloat16 ? kernels::Get().bf16_to_float : kernels::Get().fp16_to_float;
+}
 
-void inplace_add_square_const(size_t N, float a, const float* x, float* y) {
-  const __m256 alpha_vec = _mm256_set1_ps(a);
-  for (size_t i = 0; i < (N - N % 8); i += 8) {
-    __m256 x_vec = _mm256_loadu_ps(x + i); 
-    x_vec = _mm256_mul_ps(x_vec, x_vec);
-    x_vec = _mm256_mul_ps(alpha_vec, x_vec);
-    __m256 y_vec = _mm256_loadu_ps(y + i);
-    y_vec = _mm256_add_ps(x_vec, y_vec);
-    _mm256_storeu_ps(y + i, y_vec);
-  }
-  for (size_t i = (N - N % 8); i < N; i++) {
-    y[i] += x[i] * x[i] * a;
-  }
+kernels::NarrowRow narrow_kernel(DType dtype) {
+  return dtype == DType::kBFloat16 ? kernels::Get().float_to_bf16 : kernels::Get().float_to_fp16;
 }
 
+float widen_one(DType dtype, uint16_t x) {
+  return dtype == DType::kBFloat16 ? bf16_to_float(x) : fp16_to_float(x);
+}
 
+size_t num_elements(utils::Span<size_t> shape) {
+  return std::accumulate(shape.begin(), shape.end(), (size_t) 1, std::multiplies<size_t>());
+}
 
-void axpy(size_t N, float a, const float* x, float* y) {
-  const __m256 alpha_vec = _mm256_set1_ps(a);
-  for (size_t i = 0; i < (N - N % 8); i += 8) {
-    __m256 x_vec = _mm256_loadu_ps(x + i); 
-    x_vec = _mm256_mul_ps(alpha_vec, x_vec);
-    __m256 y_vec = _mm256_loadu_ps(y + i);
-    y_vec = _mm256_add_ps(x_vec, y_vec);
-    _mm256_storeu_ps(y + i, y_vec);
+// a result is stored in reduced precision when both operands are, in the same type
+DType result_dtype(const Tensor& a, const Tensor& b) {
+  return a.dtype() == b.dtype() ? a.dtype() : DType::kFloat32;
+}
+
+// float32 scratch per thread, rows of reduced precision operands go through it this many elements at a time
+constexpr size_t kTile = 512;
+}
+
+void widen(DType dtype, size_t N, const uint16_t* x, float* out) {
+  auto kernel = widen_kernel(dtype);
+  parallel::parallel_for(0, N, parallel::kGrainSize, [=] (size_t begin, size_t end) {
+    kernel(end - begin, x + begin, out + begin);
+  });
+}
+
+void narrow(DType dtype, size_t N, const float* x, uint16_t* out) {
+  auto kernel = narrow_kernel(dtype);
+  parallel::parallel_for(0, N, parallel::kGrainSize, [=] (size_t begin, size_t end) {
+    kernel(end - begin, x + begin, out + begin);
+  });
+}
+
+Tensor cast(const Tensor& a, DType dtype) {
+  utils::Span<size_t> shape = a.shape();
+  size_t size = num_elements(shape);
+  if (dtype == DType::kFloat32) {
+    if (a.is_contiguous() && a.half_data()) {
+      std::shared_ptr<float> buffer = allocator::Allocate(size);
+      widen(a.dtype(), size, a.half_data().get() + a.offset(), buffer.get());
+      return Tensor(shape, utils::compute_strides(shape), 0, buffer);
+    }
+    return Tensor(shape, utils::compute_strides(shape), 0, utils::broadcast_tensor_to_buf(a, shape, size));
   }
-  for (size_t i = (N - N % 8); i < N; i++) {
-    y[i] += a * x[i];
+  // reduced precision from float32, other reduced types go through it
+  std::shared_ptr<float> source;
+  const float* x;
+  if (a.dtype() == DType::kFloat32 && a.is_contiguous()) {
+    source = a.data();
+    x = source.get() + a.offset();
+  } else {
+    source = utils::broadcast_tensor_to_buf(a, shape, size);
+    x = source.get();
   }
+  std::shared_ptr<uint16_t> buffer = allocator::Allocate16(size);
+  narrow(dtype, size, x, buffer.get());
+  return Tensor(shape, utils::compute_strides(shape), 0, buffer, dtype);
 }
 
-Tensor add(const Tensor& a, const Tensor& b) {
-  std::vector<size_t> broadcast_shape = Tensor::GetBroadcastShape(a, b);
-  size_t broadcast_size = std::accumulate(broadcast_shape.begin(), broadcast_shape.end(), 1, std::multiplies<size_t>());
-
-  std::shared_ptr<float> a_buffer = utils::broadcast_tensor_to_buf(a, broadcast_shape, broadcast_size);
-  std::shared_ptr<float> b_buffer = utils::broadcast_tensor_to_buf(b, broadcast_shape, broadcast_size);
+void sgemm(size_t M, size_t N, size_t K,
+    const float* a, int a_rs, int a_cs,
+    const float* b, int b_rs, int b_cs,
+    float* c, int c_rs, int c_cs) {
+  kernels::Get().sgemm(M, N, K, a, a_rs, a_cs, b, b_rs, b_cs, c, c_rs, c_cs);
+}
 
-  glas::axpy(broadcast_size, 1.0f, a_buffer.get(), b_buffer.get());
+namespace {
+// data() of a reduced precision tensor is a widened copy, writes into it would be lost
+void check_writable(const Tensor& out, const char* op) {
+  if (out.dtype() != DType::kFloat32) {
+    throw std::invalid_argument(std::string(op) + " cannot write into a reduced precision tensor");
+  }
+}
 
-  return Tensor(broadcast_shape, utils::compute_strides(broadcast_shape), 0, b_buffer);
+// the out of an _into kernel holds exactly the result
+void check_out(const Tensor& out, utils::Span<size_t> shape, const char* op) {
+  check_writable(out, op);
+  if (!out.is_contiguous() || out.shape() != shape) {
+    throw std::invalid_argument(std::string(op) + " expects a contiguous output of the result's shape");
+  }
 }
 
-// in-place add, b += a
-void add_(const Tensor& a, const Tensor& b) {
-  Tensor broadcast_a = Tensor::Broadcast(a, b.shape());
+// Computes op(a, b) into out, a contiguous buffer of the broadcast shape. The
+// operands are read in place through their broadcast strides, so no broadcast
+// copy is ever made. The output is split into flat chunks, each walked one
+// (partial) row at a time with the row kernel of the op.
+void binary_rows(const Tensor& a, const Tensor& b, utils::Span<size_t> shape, kernels::BinaryRow row_kernel, float* out) {
+  size_t size = num_elements(shape);
+  utils::Strides x_strides = Tensor::Broadcast(a, shape).strides();
+  utils::Strides y_strides = Tensor::Broadcast(b, shape).strides();
+  const float* x = a.data().get() + a.offset();
+  const float* y = b.data().get() + b.offset();
+
+  size_t rank = shape.size();
+  size_t row_size = rank == 0 ? 1 : shape[rank - 1];
+  long x_row_stride = rank == 0 ? 0 : x_strides[rank - 1];
+  long y_row_stride = rank == 0 ? 0 : y_strides[rank - 1];
+  parallel::parallel_for(0, size, parallel::kGrainSize, [&] (size_t begin, size_t end) {
+    size_t i = begin;
+    while (i < end) {
+      size_t row = i / row_size, col = i % row_size;
+      size_t N = std::min(row_size - col, end - i);
+      long x_offset = (long) col * x_row_stride, y_offset = (long) col * y_row_stride;
+      for (size_t d = rank - 1; rank > 1 && d-- > 0;) {
+        size_t index = row % shape[d];
+        row /= shape[d];
+        x_offset += (long) index * x_strides[d];
+        y_offset += (long) index * y_strides[d];
+      }
+      row_kernel(N, x + x_offset, x_row_stride, y + y_offset, y_row_stride, out + i);
+      i += N;
+    }
+  });
+}
 
-  std::shared_ptr<float> a_buffer(new float[b.size()], std::default_delete<float[]>());
-  utils::BufferCopy(broadcast_a, a_buffer.get());
+// An operand of reduced_rows, read as float32 kTile elements at a time.
+struct RowSource {
+  const float* values; // float32 operands are read in place
+  const uint16_t* half;
+  DType dtype;
 
-  std::shared_ptr<float> b_buffer(new float[b.size()], std::default_delete<float[]>());
-  utils::BufferCopy(b, b_buffer.get());
+  RowSource(const Tensor& t, std::shared_ptr<float>& keep_alive) : values(nullptr), half(nullptr), dtype(t.dtype()) {
+    if (t.half_data()) {
+      half = t.half_data().get() + t.offset();
+    } else {
+      keep_alive = t.data();
+      values = keep_alive.get() + t.offset();
+    }
+  }
 
-  glas::axpy(b.size(), 1.0f, a_buffer.get(), b_buffer.get());
+  // n elements from offset on, returns where they are and sets their stride
+  const float* load(long offset, long stride, size_t n, float* scratch, long& out_stride) const {
+    out_stride = stride;
+    if (values) return values + offset;
+    if (stride == 0) {
+      scratch[0] = widen_one(dtype, half[offset]);
+    } else if (stride == 1) {
+      widen_kernel(dtype)(n, half + offset, scratch);
+    } else {
+      for (size_t k = 0; k < n; k++) scratch[k] = widen_one(dtype, half[offset + (long) k * stride]);
+      out_stride = 1;
+    }
+    return scratch;
+  }
+};
+
+// binary_rows with a reduced precision operand. Each row is widened a tile at
+// a time into float32 scratch and combined with the float32 kernel. The result
+// goes to out, or is narrowed to dtype as it is stored to half_out.
+void reduced_rows(const Tensor& a, const Tensor& b, utils::Span<size_t> shape, kernels::BinaryRow row_kernel,
+    float* out, uint16_t* half_out, DType dtype) {
+  size_t size = num_elements(shape);
+  utils::Strides x_strides = Tensor::Broadcast(a, shape).strides();
+  utils::Strides y_strides = Tensor::Broadcast(b, shape).strides();
+  std::shared_ptr<float> x_data, y_data;
+  RowSource x(a, x_data), y(b, y_data);
+
+  kernels::NarrowRow store = half_out ? narrow_kernel(dtype) : nullptr;
+  size_t rank = shape.size();
+  size_t row_size = rank == 0 ? 1 : shape[rank - 1];
+  long x_row_stride = rank == 0 ? 0 : x_strides[rank - 1];
+  long y_row_stride = rank == 0 ? 0 : y_strides[rank - 1];
+  parallel::parallel_for(0, size, parallel::kGrainSize, [&] (size_t begin, size_t end) {
+    float x_tile[kTile], y_tile[kTile], out_tile[kTile];
+    size_t i = begin;
+    while (i < end) {
+      size_t row = i / row_size, col = i % row_size;
+      size_t N = std::min(row_size - col, end - i);
+      long x_offset = (long) col * x_row_stride, y_offset = (long) col * y_row_stride;
+      for (size_t d = rank - 1; rank > 1 && d-- > 0;) {
+        size_t index = row % shape[d];
+        row /= shape[d];
+        x_offset += (long) index * x_strides[d];
+        y_offset += (long) index * y_strides[d];
+      }
+      for (size_t t = 0; t < N; t += kTile) {
+        size_t n = std::min(kTile, N - t);
+        long xs, ys;
+        const float* x_row = x.load(x_offset + (long) t * x_row_stride, x_row_stride, n, x_tile, xs);
+        const float* y_row = y.load(y_offset + (long) t * y_row_stride, y_row_stride, n, y_tile, ys);
+        if (store) {
+          row_kernel(n, x_row, xs, y_row, ys, out_tile);
+          store(n, out_tile, half_out + i + t);
+        } else {
+          row_kernel(n, x_row, xs, y_row, ys, out + i + t);
+        }
+      }
+      i += N;
+    }
+  });
+}
 
-  utils::BufferAssign(b, b_buffer);
+// op(a, b) in a new contiguous tensor, of a's and b's dtype when they share one
+Tensor broadcast_binary(const Tensor& a, const Tensor& b, kernels::BinaryRow row_kernel) {
+  utils::Shape shape = Tensor::GetBroadcastShape(a, b);
+  size_t size = num_elements(shape);
+  DType dtype = result_dtype(a, b);
+  if (dtype != DType::kFloat32) {
+    std::shared_ptr<uint16_t> buffer = allocator::Allocate16(size);
+    reduced_rows(a, b, shape, row_kernel, nullptr, buffer.get(), dtype);
+    return Tensor(shape, utils::compute_strides(shape), 0, buffer, dtype);
+  }
+  std::shared_ptr<float> buffer = allocator::Allocate(size);
+  if (a.half_data() || b.half_data()) {
+    reduced_rows(a, b, shape, row_kernel, buffer.get(), nullptr, dtype);
+  } else {
+    binary_rows(a, b, shape, row_kernel, buffer.get());
+  }
+  return Tensor(shape, utils::compute_strides(shape), 0, buffer);
 }
 
-template <typename Op>
-void binary_op_simd8(size_t N, const float* x, float* y, Op op) {
-  for (size_t i = 0; i < (N - N % 8); i += 8) {
-    __m256 x_vec = _mm256_loadu_ps(x + i);
-    __m256 y_vec = _mm256_loadu_ps(y + i);
-    y_vec = op(x_vec, y_vec);
-    _mm256_storeu_ps(y + i, y_vec);
+void binary_into(const Tensor& a, const Tensor& b, const Tensor& out, kernels::BinaryRow row_kernel, const char* op) {
+  utils::Shape shape = Tensor::GetBroadcastShape(a, b);
+  check_out(out, shape, op);
+  float* y = out.data().get() + out.offset();
+  if (a.half_data() || b.half_data()) {
+    reduced_rows(a, b, shape, row_kernel, y, nullptr, DType::kFloat32);
+  } else {
+    binary_rows(a, b, shape, row_kernel, y);
   }
 }
+}
 
-Tensor binary_op(const Tensor& a, const Tensor& b, void (*op)(size_t, const float*, float*)) {
-  std::vector<size_t> broadcast_shape = Tensor::GetBroadcastShape(a, b);
-  size_t broadcast_size = std::accumulate(broadcast_shape.begin(), broadcast_shape.end(), 1, std::multiplies<size_t>());
+Tensor add(const Tensor& a, const Tensor& b) {
+  return broadcast_binary(a, b, kernels::Get().add);
+}
 
-  std::shared_ptr<float> a_buffer = utils::broadcast_tensor_to_buf(a, broadcast_shape, broadcast_size);
-  std::shared_ptr<float> b_buffer = utils::broadcast_tensor_to_buf(b, broadcast_shape, broadcast_size);
+void add_into(const Tensor& a, const Tensor& b, const Tensor& out) {
+  binary_into(a, b, out, kernels::Get().add, "add_into");
+}
 
-  op(broadcast_size, a_buffer.get(), b_buffer.get());
+// in-place add, b += a, with a broadcast to b's shape
+void add_(const Tensor& a, const Tensor& b) {
+  check_writable(b, "add_");
+  utils::Span<size_t> shape = b.shape();
+  const float* x = a.data().get() + a.offset();
+  float* y = b.data().get() + b.offset();
+  if (a.is_contiguous() && b.is_contiguous() && a.shape() == shape) {
+    size_t size = std::accumulate(shape.begin(), shape.end(), (size_t) 1, std::multiplies<size_t>());
+    axpy(size, 1.0f, x, y);
+    return;
+  }
 
-  return Tensor(broadcast_shape, utils::compute_strides(broadcast_shape), 0, b_buffer);
+  utils::StridedIterator it(shape, {b.strides(), Tensor::Broadcast(a, shape).strides()});
+  auto axpy_row = kernels::Get().axpy;
+  size_t cols = it.row_size();
+  long y_cs = it.row_stride(0), x_cs = it.row_stride(1);
+  parallel::parallel_for(0, it.steps(), std::max<size_t>(1, parallel::kGrainSize / std::max<size_t>(1, cols)), [&] (size_t begin, size_t end) {
+    utils::StridedIterator local = it;
+    local.seek(begin);
+    for (size_t step = begin; step < end; step++, local.next()) {
+      float* y_row = y + local.offset(0);
+      const float* x_row = x + local.offset(1);
+      if (y_cs == 1 && x_cs == 1) {
+        axpy_row(cols, 1.0f, x_row, y_row);
+      } else {
+        for (size_t j = 0; j < cols; j++) y_row[j * y_cs] += x_row[j * x_cs];
+      }
+    }
+  });
 }
 
 void mul_simd(size_t N, const float* x, float* y) {
-  binary_op_simd8(N, x, y, [] (__m256 x_vec, __m256 y_vec) { return _mm256_mul_ps(x_vec, y_vec); });
-  for (size_t i = (N - N % 8); i < N; ++i) {
-    y[i] *= x[i];
-  }
+  kernels::Get().mul(N, x, 1, y, 1, y);
 }
 
 Tensor mul(const Tensor& a, const Tensor& b) {
-  return binary_op(a, b, mul_simd);
+  return broadcast_binary(a, b, kernels::Get().mul);
+}
+
+void mul_into(const Tensor& a, const Tensor& b, const Tensor& out) {
+  binary_into(a, b, out, kernels::Get().mul, "mul_into");
 }
 
 void div_simd(size_t N, const float* x, float* y) {
-  binary_op_simd8(N, x, y, [] (__m256 x_vec, __m256 y_vec) { return _mm256_div_ps(x_vec, y_vec); });
-  for (size_t i = (N - N % 8); i < N; ++i) {
-    y[i] = x[i] / y[i];
-  }
+  kernels::Get().div(N, x, 1, y, 1, y);
 }
 
 Tensor div(const Tensor& a, const Tensor& b) {
-  return binary_op(a, b, div_simd);
+  return broadcast_binary(a, b, kernels::Get().div);
+}
+
+void div_into(const Tensor& a, const Tensor& b, const Tensor& out) {
+  binary_into(a, b, out, kernels::Get().div, "div_into");
 }
 
 void sub_simd(size_t N, const float* x, float* y) {
-  binary_op_simd8(N, x, y, [] (__m256 x_vec, __m256 y_vec) { return _mm256_sub_ps(x_vec, y_vec); });
-  for (size_t i = (N - N % 8); i < N; ++i) {
-    y[i] = x[i] - y[i];
-  }
+  kernels::Get().sub(N, x, 1, y, 1, y);
 }
 
 Tensor sub(const Tensor& a, const Tensor& b) {
-  return binary_op(a, b, sub_simd);
+  return broadcast_binary(a, b, kernels::Get().sub);
 }
 
-template <typename Op>
-void unary_op_simd8(size_t N, float* y, float alpha, Op op) {
-  const __m256 alpha_vec = _mm256_set1_ps(alpha);
-  for (size_t i = 0; i < (N - N % 8); i += 8) {
-    __m256 y_vec = _mm256_loadu_ps(y + i);
-    y_vec = op(alpha_vec, y_vec);
-    _mm256_storeu_ps(y + i, y_vec);
-  }
+void sub_into(const Tensor& a, const Tensor& b, const Tensor& out) {
+  binary_into(a, b, out, kernels::Get().sub, "sub_into");
 }
 
-Tensor unary_op(const Tensor& a, void (*op) (size_t, float*)) {
-  std::shared_ptr<float> buffer = utils::broadcast_tensor_to_buf(a, a.shape(), a.size());
+namespace {
+// op of a contiguous reduced precision a, widened a tile at a time into float32
+// scratch. The result goes to out, or is narrowed back as it is stored to half_out.
+void reduced_unary(const Tensor& a, kernels::UnaryRow op, float* out, uint16_t* half_out) {
+  size_t size = num_elements(a.shape());
+  DType dtype = a.dtype();
+  const uint16_t* x = a.half_data().get() + a.offset();
+  kernels::WidenRow load = widen_kernel(dtype);
+  kernels::NarrowRow store = half_out ? narrow_kernel(dtype) : nullptr;
+  parallel::parallel_for(0, size, parallel::kGrainSize, [&] (size_t begin, size_t end) {
+    float tile[kTile];
+    for (size_t i = begin; i < end; i += kTile) {
+      size_t n = std::min(kTile, end - i);
+      if (store) {
+        load(n, x + i, tile);
+        op(n, tile, tile);
+        store(n, tile, half_out + i);
+      } else {
+        load(n, x + i, out + i);
+        op(n, out + i, out + i);
+      }
+    }
+  });
+}
 
-  op(a.size(), buffer.get());
+// op of a float32 a into out, a dense copy of a non-contiguous a is made in out first
+void unary_rows(const Tensor& a, kernels::UnaryRow op, float* out) {
+  size_t size = num_elements(a.shape());
+  const float* x = out;
+  if (a.is_contiguous()) {
+    x = a.data().get() + a.offset();
+  } else {
+    utils::BufferCopy(a, out);
+  }
+  parallel::parallel_for(0, size, parallel::kGrainSize, [=] (size_t begin, size_t end) {
+    op(end - begin, x + begin, out + begin);
+  });
+}
 
-  return Tensor(a.shape(), a.strides(), 0, buffer);
+void unary_into(const Tensor& a, const Tensor& out, kernels::UnaryRow row_kernel, const char* op) {
+  check_out(out, a.shape(), op);
+  float* y = out.data().get() + out.offset();
+  if (a.half_data() && a.is_contiguous()) {
+    reduced_unary(a, row_kernel, y, nullptr);
+  } else {
+    // data() widens a reduced precision a
+    unary_rows(a, row_kernel, y);
+  }
+}
 }
 
-void neg_simd(size_t N, float* y) {
-  unary_op_simd8(N, y, -1, [] (__m256 x_vec, __m256 y_vec) { return _mm256_mul_ps(x_vec, y_vec); });
-  for (size_t i = (N - N % 8); i < N; ++i) {
-    y[i] *= -1;
+Tensor unary_op(const Tensor& a, kernels::UnaryRow op) {
+  utils::Span<size_t> shape = a.shape();
+  size_t size = num_elements(shape);
+  if (a.half_data()) {
+    // the result keeps a's type
+    DType dtype = a.dtype();
+    Tensor dense = a.is_contiguous() ? a : glas::cast(glas::cast(a, DType::kFloat32), dtype);
+    std::shared_ptr<uint16_t> buffer = allocator::Allocate16(size);
+    reduced_unary(dense, op, nullptr, buffer.get());
+    return Tensor(shape, utils::compute_strides(shape), 0, buffer, dtype);
   }
+  std::shared_ptr<float> buffer = allocator::Allocate(size);
+  unary_rows(a, op, buffer.get());
+  return Tensor(shape, utils::compute_strides(shape), 0, buffer);
+}
+
+void neg_simd(size_t N, float* y) {
+  kernels::Get().neg(N, y, y);
 }
 
 Tensor neg(const Tensor& a) {
-  return unary_op(a, neg_simd);
+  return unary_op(a, kernels::Get().neg);
+}
+
+void neg_into(const Tensor& a, const Tensor& out) {
+  unary_into(a, out, kernels::Get().neg, "neg_into");
 }
 
 void mul_cons_simd(size_t N, float* y, float x) {
-  unary_op_simd8(N, y, x, [] (__m256 x_vec, __m256 y_vec) { return _mm256_mul_ps(x_vec, y_vec); });
-  for (size_t i = (N - N % 8); i < N; ++i) {
-    y[i] *= x;
-  }
+  kernels::Get().scale(N, x, y);
 }
 
 void inv_simd(size_t N, float* y) {
-  unary_op_simd8(N, y, 1, [] (__m256 x_vec, __m256 y_vec) { return _mm256_div_ps(x_vec, y_vec); });
-  for (size_t i = (N - N % 8); i < N; ++i) {
-    y[i] = 1 / y[i];
-  }
+  kernels::Get().inv(N, y, y);
 }
 
 Tensor inv(const Tensor& a) {
-  return unary_op(a, inv_simd);
+  return unary_op(a, kernels::FastMath() ? kernels::Get().inv_fast : kernels::Get().inv);
+}
+
+void inv_into(const Tensor& a, const Tensor& out) {
+  unary_into(a, out, kernels::FastMath() ? kernels::Get().inv_fast : kernels::Get().inv, "inv_into");
 }
 
 void log_buf(size_t N, float* y) {
-  for (size_t i = 0; i < N; ++i) {
-    y[i] = std::log(y[i]);
-  }
+  kernels::Get().log(N, y, y);
 }
 
 Tensor log(const Tensor& a) {
-  return unary_op(a, log_buf);
+  return unary_op(a, kernels::FastMath() ? kernels::Get().log_fast : kernels::Get().log);
+}
+
+void log_into(const Tensor& a, const Tensor& out) {
+  unary_into(a, out, kernels::FastMath() ? kernels::Get().log_fast : kernels::Get().log, "log_into");
 }
 
 void exp_buf(size_t N, float* y) {
-  for (size_t i = 0; i < N; ++i) {
-    y[i] = std::exp(y[i]);
-  }
+  kernels::Get().exp(N, y, y);
 }
 
 Tensor exp(const Tensor& a) {
-  return unary_op(a, exp_buf);
-}
-
-Tensor einsum(const Tensor& a, const Tensor& b, const std::string& equation) {
-  // tokenize equation
-  std::vector<std::string> tokens;
-  std::string token;
-  for (char c : equation) {
-    if (isspace(c)) {
-      if (token.size() != 0) tokens.push_back(token);
-      token = "";
-    } else if (c == ',') {
-      if (token.size() != 0) tokens.push_back(token);
-      tokens.push_back(",");
-      token = "";
-    } else {
-      token += c;
+  return unary_op(a, kernels::FastMath() ? kernels::Get().exp_fast : kernels::Get().exp);
+}
+
+void exp_into(const Tensor& a, const Tensor& out) {
+  unary_into(a, out, kernels::FastMath() ? kernels::Get().exp_fast : kernels::Get().exp, "exp_into");
+}
+
+void root_buf(size_t N, float* y) {
+  kernels::Get().root(N, y, y);
+}
+
+Tensor root(const Tensor& a) {
+  return unary_op(a, kernels::Get().root);
+}
+
+void root_into(const Tensor& a, const Tensor& out) {
+  unary_into(a, out, kernels::Get().root, "root_into");
+}
+
+namespace {
+// The kept axes of a, and strides that view the output at a's shape by
+// stepping 0 along the reduced axes.
+std::vector<size_t> reduced_layout(const Tensor& a, const std::unordered_set<size_t>& axes, std::vector<int>& out_strides) {
+  for (size_t axis : axes) {
+    if (axis >= a.shape().size()) throw std::invalid_argument("Axis out of range");
+  }
+  std::vector<size_t> shape;
+  std::map<size_t, int> depth_to_index;
+  for (size_t i = 0; i < a.shape().size(); ++i) {
+    if (axes.find(i) == axes.end()) {
+      shape.push_back(a.shape()[i]);
+      depth_to_index[i] = shape.size() - 1;
     }
   }
-  if(token.size() != 0) tokens.push_back(token);
-  // group shapes
-  std::map<std::string, size_t> a_shape_map;
-  std::map<std::string, size_t> b_shape_map;
-  std::map<std::string, size_t> c_shape_map;
-  std::map<std::string, size_t> size_map;
-  std::vector<size_t> c_shape;
-  size_t index = 0;
-  for (size_t i = 0, state = 0; i < tokens.size(); i++) {
-    if (tokens[i] == ",") {
-      if (state != 0) {
-        throw std::invalid_argument("Invalid equation");
-      }
-      state = 1;
-      index = 0;
-    } else if (tokens[i] == "->") {
-      if (state != 1) {
-        throw std::invalid_argument("Invalid equation");
+  out_strides.assign(a.shape().size(), 0);
+  std::vector<int> compact_strides = utils::compute_strides(shape);
+  for (auto& [depth, index] : depth_to_index) {
+    out_strides[depth] = compact_strides[index];
+  }
+  return shape;
+}
+
+// Hands reduce_rows the walk of every outer position of a, in row-major order.
+// When the outermost axis is kept its rows reduce into disjoint parts of the
+// output and are split across threads.
+template <typename F>
+void for_each_reduced_row(const Tensor& a, const std::unordered_set<size_t>& axes, const std::vector<int>& out_strides, float* out, F reduce_rows) {
+  utils::Span<size_t> a_shape = a.shape();
+  utils::Span<int> a_strides = a.strides();
+  const float* in = a.data().get() + a.offset();
+  if (a_shape.size() > 0 && axes.find(0) == axes.end()) {
+    size_t rows = a_shape[0];
+    std::vector<size_t> row_shape(a_shape.begin() + 1, a_shape.end());
+    size_t row_size = std::accumulate(row_shape.begin(), row_shape.end(), (size_t) 1, std::multiplies<size_t>());
+    utils::StridedIterator it(row_shape, {std::vector<int>(out_strides.begin() + 1, out_strides.end()),
+                                          std::vector<int>(a_strides.begin() + 1, a_strides.end())});
+    parallel::parallel_for(0, rows, std::max<size_t>(1, parallel::kGrainSize / std::max<size_t>(1, row_size)), [&] (size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        reduce_rows(it, in + (long) i * a_strides[0], out + (long) i * out_strides[0]);
       }
-      state = 2;
-      index = 0;
-    } else if (state == 0) {
-      a_shape_map[tokens[i]] = index++;
-      size_map[tokens[i]] = a.shape()[a_shape_map[tokens[i]]];
-    } else if (state == 1) {
-      b_shape_map[tokens[i]] = index++;
-      size_map[tokens[i]] = b.shape()[b_shape_map[tokens[i]]];
-    } else if (state == 2) {
-      if (size_map.count(tokens[i]) == 0) {
-        throw std::invalid_argument("Invalid equation");
+    });
+  } else {
+    reduce_rows(utils::StridedIterator(a_shape, {out_strides, a_strides}), in, out);
+  }
+}
+
+float identity(ReduceOp op) {
+  switch (op) {
+  case ReduceOp::kSum: return 0.0f;
+  case ReduceOp::kMax: return -HUGE_VALF;
+  case ReduceOp::kMin: return HUGE_VALF;
+  }
+  return 0.0f;
+}
+
+float combine(ReduceOp op, float x, float y) {
+  switch (op) {
+  case ReduceOp::kSum: return x + y;
+  case ReduceOp::kMax: return std::max(x, y);
+  case ReduceOp::kMin: return std::min(x, y);
+  }
+  return x;
+}
+}
+
+Tensor reduce(const Tensor& a, std::function<float(float, float)> op, std::unordered_set<size_t> axes, float fill) {
+  std::vector<int> out_strides;
+  std::vector<size_t> shape = reduced_layout(a, axes, out_strides);
+  size_t size = std::accumulate(shape.begin(), shape.end(), (size_t) 1, std::multiplies<size_t>());
+  std::shared_ptr<float> buffer = allocator::Allocate(size);
+  std::fill(buffer.get(), buffer.get() + size, fill);
+
+  // folds the elements of one outer position into the output, in row-major order
+  for_each_reduced_row(a, axes, out_strides, buffer.get(), [&] (utils::StridedIterator it, const float* in, float* out) {
+    size_t cols = it.row_size();
+    long out_cs = it.row_stride(0), in_cs = it.row_stride(1);
+    for (size_t step = 0, steps = it.steps(); step < steps; step++, it.next()) {
+      float* o = out + it.offset(0);
+      const float* x = in + it.offset(1);
+      if (out_cs == 0) {
+        float acc = *o;
+        for (size_t j = 0; j < cols; j++) acc = op(acc, x[j * in_cs]);
+        *o = acc;
+      } else {
+        for (size_t j = 0; j < cols; j++) o[j * out_cs] = op(o[j * out_cs], x[j * in_cs]);
       }
-      c_shape_map[tokens[i]] = index++;
-      c_shape.push_back(size_map[tokens[i]]);
     }
+  });
+  return Tensor(shape, utils::compute_strides(shape), 0, buffer);
+}
+
+namespace {
+// reduces a over axes into out, laid out by reduced_layout
+void reduce_rows(const Tensor& a, ReduceOp op, const std::unordered_set<size_t>& axes, const std::vector<int>& out_strides, size_t size, float* out) {
+  const kernels::Table& k = kernels::Get();
+  float (*row)(size_t, const float*) = op == ReduceOp::kSum ? k.sum : op == ReduceOp::kMax ? k.max : k.min;
+  kernels::BinaryRow vertical = op == ReduceOp::kSum ? k.add : op == ReduceOp::kMax ? k.maximum : k.minimum;
+
+  if (size == 1 && a.is_contiguous()) {
+    // a full reduction, each thread folds a chunk and the partials are folded the same way
+    utils::Span<size_t> a_shape = a.shape();
+    size_t n = std::accumulate(a_shape.begin(), a_shape.end(), (size_t) 1, std::multiplies<size_t>());
+    const float* in = a.data().get() + a.offset();
+    size_t chunks = std::max<size_t>(1, (n + parallel::kGrainSize - 1) / parallel::kGrainSize);
+    std::vector<float> partials(chunks);
+    parallel::parallel_for(0, chunks, 1, [&] (size_t begin, size_t end) {
+      for (size_t c = begin; c < end; ++c) {
+        size_t first = c * parallel::kGrainSize;
+        partials[c] = row(std::min(n, first + parallel::kGrainSize) - first, in + first);
+      }
+    });
+    *out = row(chunks, partials.data());
+    return;
   }
-  std::vector<std::string> all_dims;
-  // check that the identical keys have identical values
-  for (const auto& [key, value] : a_shape_map) {
-    all_dims.push_back(key); // push back A
-    if (b_shape_map.count(key) == 0) continue;
-    if (b.shape()[b_shape_map[key]] != a.shape()[a_shape_map[key]]) {
-      throw std::invalid_argument("Invalid equation");
+
+  std::fill(out, out + size, identity(op));
+  for_each_reduced_row(a, axes, out_strides, out, [&] (utils::StridedIterator it, const float* in, float* out) {
+    size_t cols = it.row_size();
+    long out_cs = it.row_stride(0), in_cs = it.row_stride(1);
+    for (size_t step = 0, steps = it.steps(); step < steps; step++, it.next()) {
+      float* o = out + it.offset(0);
+      const float* x = in + it.offset(1);
+      if (out_cs == 0 && in_cs == 1) {
+        // the reduced axis is innermost and contiguous
+        *o = combine(op, *o, row(cols, x));
+      } else if (out_cs == 1) {
+        // a reduced axis is further out, whole rows fold into the output row
+        vertical(cols, o, 1, x, in_cs, o);
+      } else if (out_cs == 0) {
+        float acc = *o;
+        for (size_t j = 0; j < cols; j++) acc = combine(op, acc, x[j * in_cs]);
+        *o = acc;
+      } else {
+        for (size_t j = 0; j < cols; j++) o[j * out_cs] = combine(op, o[j * out_cs], x[j * in_cs]);
+      }
     }
+  });
+}
+}
+
+Tensor reduce(const Tensor& a, ReduceOp op, std::unordered_set<size_t> axes) {
+  std::vector<int> out_strides;
+  std::vector<size_t> shape = reduced_layout(a, axes, out_strides);
+  size_t size = num_elements(shape);
+  std::shared_ptr<float> buffer = allocator::Allocate(size);
+  reduce_rows(a, op, axes, out_strides, size, buffer.get());
+  return Tensor(shape, utils::compute_strides(shape), 0, buffer);
+}
+
+void reduce_into(const Tensor& a, ReduceOp op, const std::unordered_set<size_t>& axes, const Tensor& out) {
+  std::vector<int> out_strides;
+  std::vector<size_t> shape = reduced_layout(a, axes, out_strides);
+  check_out(out, shape, "reduce_into");
+  reduce_rows(a, op, axes, out_strides, num_elements(shape), out.data().get() + out.offset());
+}
+
+Tensor reduceSum(const Tensor& a, std::unordered_set<size_t> axes) {
+  return reduce(a, ReduceOp::kSum, axes);
+}
+
+Tensor reduceMax(const Tensor& a, std::unordered_set<size_t> axes) {
+  return reduce(a, ReduceOp::kMax, axes);
+}
+
+Tensor reduceMin(const Tensor& a, std::unordered_set<size_t> axes) {
+  return reduce(a, ReduceOp::kMin, axes);
+}
+
+Tensor reduceMean(const Tensor& a, std::unordered_set<size_t> axes) {
+  Tensor result = reduce(a, ReduceOp::kSum, axes);
+  size_t count = 1;
+  for (size_t axis : axes) count *= a.shape()[axis];
+  kernels::Get().scale(num_elements(result.shape()), 1.0f / count, result.data().get());
+  return result;
+}
+
+void reduceMean_into(const Tensor& a, const std::unordered_set<size_t>& axes, const Tensor& out) {
+  reduce_into(a, ReduceOp::kSum, axes, out);
+  size_t count = 1;
+  for (size_t axis : axes) count *= a.shape()[axis];
+  kernels::Get().scale(num_elements(out.shape()), 1.0f / count, out.data().get() + out.offset());
+}
+
+namespace {
+// the kept axes of a, whose lines along axis argReduce scans
+std::vector<size_t> arg_layout(const Tensor& a, size_t axis) {
+  utils::Span<size_t> a_shape = a.shape();
+  if (axis >= a_shape.size()) {
+    throw std::invalid_argument("Axis out of range");
   }
-  for (const auto& [key, value] : b_shape_map) {
-    if (a_shape_map.count(key) == 0) {
-      all_dims.push_back(key); // push back A - B to get A + B
-      continue;
-    }
-    if (a.shape()[a_shape_map[key]] != b.shape()[b_shape_map[key]]) {
-      throw std::invalid_argument("Invalid equation");
-    }
-  } 
-  std::vector<int> c_strides(c_shape.size());
-  size_t c_size = 1;
-  for (int i = (int) c_shape.size() - 1; i >= 0; i--) {
-    c_strides[i] = c_size;
-    c_size *= c_shape[i];
-  }
-  // recursively multiply and sum
-  std::shared_ptr<float> c_buffer(new float[c_size], std::default_delete<float[]>());
-  std::fill(c_buffer.get(), c_buffer.get() + c_size, 0.0f);
-  std::function<void(int, int, int, size_t)> recursive_einsum = [&](int a_offset, int b_offset, int c_offset, size_t N) {
-    if (N == 0) {
-      c_buffer.get()[c_offset] += a.data().get()[a_offset + a.offset()] * b.data().get()[b_offset + b.offset()];
-    } else {
-      std::string dim = all_dims[N - 1];
-      for (size_t i = 0; i < size_map[dim]; i++) {
-        int new_a_offset = a_shape_map.count(dim) ? a_offset + i * a.strides()[a_shape_map[dim]] : a_offset;
-        int new_b_offset = b_shape_map.count(dim) ? b_offset + i * b.strides()[b_shape_map[dim]] : b_offset;
-        int new_c_offset = c_shape_map.count(dim) ? c_offset + i * c_strides[c_shape_map[dim]] : c_offset;
-        recursive_einsum(new_a_offset, new_b_offset, new_c_offset, N - 1);
+  if (a_shape[axis] == 0) {
+    throw std::invalid_argument("Cannot take the argmax or argmin of an empty axis");
+  }
+  std::vector<size_t> shape = a_shape;
+  shape.erase(shape.begin() + axis);
+  return shape;
+}
+
+void arg_rows(const Tensor& a, size_t axis, ReduceOp op, utils::Span<size_t> shape, float* out) {
+  utils::Span<size_t> a_shape = a.shape();
+  std::vector<int> a_strides = a.strides();
+  std::vector<int> outer_strides = a_strides;
+  outer_strides.erase(outer_strides.begin() + axis);
+  size_t len = a_shape[axis];
+  long stride = a_strides[axis];
+  const float* in = a.data().get() + a.offset();
+
+  // each output position scans its line along axis, the first extremum wins
+  utils::StridedIterator it(shape, {utils::compute_strides(shape), outer_strides});
+  size_t cols = it.row_size();
+  long out_cs = it.row_stride(0), in_cs = it.row_stride(1);
+  parallel::parallel_for(0, it.steps(), std::max<size_t>(1, parallel::kGrainSize / std::max<size_t>(1, cols * len)), [&] (size_t begin, size_t end) {
+    utils::StridedIterator walk = it;
+    walk.seek(begin);
+    for (size_t step = begin; step < end; step++, walk.next()) {
+      for (size_t j = 0; j < cols; j++) {
+        const float* x = in + walk.offset(1) + (long) j * in_cs;
+        size_t best = 0;
+        float best_value = x[0];
+        for (size_t i = 1; i < len; i++) {
+          float v = x[(long) i * stride];
+          if (op == ReduceOp::kMin ? v < best_value : v > best_value) {
+            best = i;
+            best_value = v;
+          }
+        }
+        out[walk.offset(0) + (long) j * out_cs] = (float) best;
       }
     }
-  };
-  recursive_einsum(0, 0, 0, all_dims.size());
-  return Tensor(c_shape, c_strides, 0, c_buffer);
+  });
+}
+}
+
+Tensor argReduce(const Tensor& a, size_t axis, ReduceOp op) {
+  std::vector<size_t> shape = arg_layout(a, axis);
+  std::shared_ptr<float> buffer = allocator::Allocate(num_elements(shape));
+  arg_rows(a, axis, op, shape, buffer.get());
+  return Tensor(shape, utils::compute_strides(shape), 0, buffer);
+}
+
+void argReduce_into(const Tensor& a, size_t axis, ReduceOp op, const Tensor& out) {
+  std::vector<size_t> shape = arg_layout(a, axis);
+  check_out(out, shape, "argReduce_into");
+  arg_rows(a, axis, op, shape, out.data().get() + out.offset());
+}
+
+Tensor argmax(const Tensor& a, size_t axis) {
+  return argReduce(a, axis, ReduceOp::kMax);
 }
 
-  void root_buf(size_t N, float* y) {
-    for (size_t i = 0; i < N; ++i) {
-      y[i] = std::sqrt(y[i]);
+Tensor argmin(const Tensor& a, size_t axis) {
+  return argReduce(a, axis, ReduceOp::kMin);
+}
+
+namespace {
+// a shape around axis, the elements before it, along it and after it
+struct AxisSplit {
+  size_t outer, size, inner;
+};
+
+AxisSplit split_at(utils::Span<size_t> shape, size_t axis) {
+  if (axis >= shape.size()) {
+    throw std::invalid_argument("Axis out of range");
+  }
+  AxisSplit split{1, shape[axis], 1};
+  for (size_t d = 0; d < axis; d++) split.outer *= shape[d];
+  for (size_t d = axis + 1; d < shape.size(); d++) split.inner *= shape[d];
+  return split;
+}
+
+// the elements of a in row-major order, a itself when it already is
+Tensor dense(const Tensor& a) {
+  if (a.is_contiguous() && !a.half_data()) return a;
+  Tensor packed(a.shape());
+  utils::BufferCopy(a, packed.data().get());
+  return packed;
+}
+
+// the indices held by a float tensor, each must be a whole number below bound
+std::vector<size_t> read_indices(const Tensor& index, size_t bound) {
+  Tensor packed = dense(index);
+  const float* x = packed.data().get() + packed.offset();
+  std::vector<size_t> indices(num_elements(index.shape()));
+  for (size_t i = 0; i < indices.size(); i++) {
+    if (!(x[i] >= 0.0f && x[i] < (float) bound) || x[i] != std::floor(x[i])) {
+      throw std::invalid_argument("Index out of range");
     }
+    indices[i] = (size_t) x[i];
   }
+  return indices;
+}
 
-  Tensor root(const Tensor& a) {
-    return unary_op(a, root_buf);
+// shape with its axis dimension replaced by size
+bool matches_except(utils::Span<size_t> shape, utils::Span<size_t> other, size_t axis, size_t size) {
+  if (shape.size() != other.size()) return false;
+  for (size_t d = 0; d < shape.size(); d++) {
+    if (other[d] != (d == axis ? size : shape[d])) return false;
   }
-Tensor reduce(const Tensor& a, std::function<float(float, float)> op, std::unordered_set<size_t> axes, float fill) {
-  size_t size = 1;
-  std::vector<size_t> shape;
-  std::map<size_t, int> depth_to_index;
-  for (size_t i = 0; i < a.shape().size(); ++i) {
-    if (axes.find(i) == axes.end()) {
-      size *= a.shape()[i];
-      shape.push_back(a.shape()[i]);
-      depth_to_index[i] = shape.size() - 1;
-    }
+  return true;
+}
+
+// the index of gather and scatter_add has the rank and shape of a except along axis
+void check_gather_index(const Tensor& a, size_t axis, const Tensor& index) {
+  if (index.shape().size() != a.shape().size() || axis >= a.shape().size() ||
+      !matches_except(a.shape(), index.shape(), axis, index.shape()[axis])) {
+    throw std::invalid_argument("gather and scatter_add expect an index shaped like the tensor except along axis");
   }
+}
 
-  std::shared_ptr<float> buffer(new float[size], std::default_delete<float[]>());
-  std::fill(buffer.get(), buffer.get() + size, fill);
+size_t grain_for(size_t row) {
+  return std::max<size_t>(1, parallel::kGrainSize / std::max<size_t>(1, row));
+}
+}
+
+namespace {
+// the shape index_select gives, checked against a
+std::vector<size_t> select_shape(const Tensor& a, size_t axis, const Tensor& index) {
+  split_at(a.shape(), axis);
+  if (index.shape().size() != 1) {
+    throw std::invalid_argument("index_select expects a 1-d index");
+  }
+  std::vector<size_t> shape = a.shape();
+  shape[axis] = index.shape()[0];
+  return shape;
+}
+
+void select_rows(const Tensor& a, size_t axis, const Tensor& index, float* out) {
+  AxisSplit split = split_at(a.shape(), axis);
+  std::vector<size_t> rows = read_indices(index, split.size);
+  Tensor source = dense(a);
+  const float* in = source.data().get() + source.offset();
+  size_t K = rows.size(), inner = split.inner;
+  // one contiguous run of inner elements per selected slice
+  parallel::parallel_for(0, split.outer * K, grain_for(inner), [&] (size_t begin, size_t end) {
+    for (size_t r = begin; r < end; r++) {
+      const float* x = in + ((r / K) * split.size + rows[r % K]) * inner;
+      std::copy(x, x + inner, out + r * inner);
+    }
+  });
+}
 
-  std::function<void(size_t, int, int)> recursive_reduce = [=, &depth_to_index, &recursive_reduce] (size_t depth, int buffer_offset, int tensor_offset) {
-    if (depth == a.shape().size()) {
-      buffer.get()[buffer_offset] = op(buffer.get()[buffer_offset], a.data().get()[a.offset() + tensor_offset]);
+void gather_rows(const Tensor& a, size_t axis, const Tensor& index, float* out) {
+  AxisSplit split = split_at(a.shape(), axis);
+  std::vector<size_t> indices = read_indices(index, split.size);
+  Tensor source = dense(a);
+  const float* in = source.data().get() + source.offset();
+  size_t K = index.shape()[axis], inner = split.inner;
+  parallel::parallel_for(0, split.outer * K, grain_for(inner), [&] (size_t begin, size_t end) {
+    for (size_t r = begin; r < end; r++) {
+      const float* x = in + (r / K) * split.size * inner;
+      for (size_t i = 0; i < inner; i++) {
+        out[r * inner + i] = x[indices[r * inner + i] * inner + i];
+      }
     }
-    else {
-      for (size_t i = 0; i < a.shape()[depth]; ++i) {
-        int offset_inc = ((int) i) * a.strides()[depth];
-        int buffer_offset_inc = axes.find(depth) != axes.end() ? 0 : ((int) i) * utils::compute_strides(shape)[depth_to_index[depth]];
-        recursive_reduce(depth + 1, buffer_offset + buffer_offset_inc, tensor_offset + offset_inc);
+  });
+}
+}
+
+Tensor index_select(const Tensor& a, size_t axis, const Tensor& index) {
+  Tensor result(select_shape(a, axis, index));
+  select_rows(a, axis, index, result.data().get());
+  return result;
+}
+
+void index_select_into(const Tensor& a, size_t axis, const Tensor& index, const Tensor& out) {
+  check_out(out, select_shape(a, axis, index), "index_select_into");
+  select_rows(a, axis, index, out.data().get() + out.offset());
+}
+
+void index_add_(const Tensor& out, size_t axis, const Tensor& index, const Tensor& src) {
+  check_writable(out, "index_add_");
+  assert(out.is_contiguous());
+  AxisSplit split = split_at(out.shape(), axis);
+  if (index.shape().size() != 1) {
+    throw std::invalid_argument("index_add_ expects a 1-d index");
+  }
+  std::vector<size_t> rows = read_indices(index, split.size);
+  size_t K = rows.size(), inner = split.inner;
+  if (!matches_except(out.shape(), src.shape(), axis, K)) {
+    throw std::invalid_argument("index_add_ expects one source slice per index");
+  }
+  Tensor values = dense(src);
+  const float* x = values.data().get() + values.offset();
+  float* y = out.data().get() + out.offset();
+  parallel::parallel_for(0, split.outer, grain_for(K * inner), [&] (size_t begin, size_t end) {
+    for (size_t o = begin; o < end; o++) {
+      for (size_t k = 0; k < K; k++) {
+        axpy(inner, 1.0f, x + (o * K + k) * inner, y + (o * split.size + rows[k]) * inner);
       }
     }
-  };
-  recursive_reduce(0, 0, 0);
+  });
+}
 
-  return Tensor(shape, utils::compute_strides(shape), 0, buffer);
+Tensor gather(const Tensor& a, size_t axis, const Tensor& index) {
+  check_gather_index(a, axis, index);
+  Tensor result(index.shape());
+  gather_rows(a, axis, index, result.data().get());
+  return result;
 }
 
-Tensor reduceSum(const Tensor& a, std::unordered_set<size_t> axes) {
-  return reduce(a, [] (float x, float y) { return x + y; }, axes, 0.0f);
+void gather_into(const Tensor& a, size_t axis, const Tensor& index, const Tensor& out) {
+  check_gather_index(a, axis, index);
+  check_out(out, index.shape(), "gather_into");
+  gather_rows(a, axis, index, out.data().get() + out.offset());
 }
 
-Tensor reduceMax(const Tensor& a, std::unordered_set<size_t> axes) {
-  return reduce(a, [] (float x, float y) { return std::max(x, y); }, axes, std::numeric_limits<float>::lowest());
+void scatter_add_(const Tensor& out, size_t axis, const Tensor& index, const Tensor& src) {
+  check_writable(out, "scatter_add_");
+  assert(out.is_contiguous());
+  check_gather_index(out, axis, index);
+  if (src.shape() != index.shape()) {
+    throw std::invalid_argument("scatter_add expects a source shaped like the index");
+  }
+  AxisSplit split = split_at(out.shape(), axis);
+  std::vector<size_t> indices = read_indices(index, split.size);
+  Tensor values = dense(src);
+  const float* x = values.data().get() + values.offset();
+  float* y = out.data().get() + out.offset();
+  size_t K = index.shape()[axis], inner = split.inner;
+  parallel::parallel_for(0, split.outer, grain_for(K * inner), [&] (size_t begin, size_t end) {
+    for (size_t r = begin * K; r < end * K; r++) {
+      float* target = y + (r / K) * split.size * inner;
+      for (size_t i = 0; i < inner; i++) {
+        target[indices[r * inner + i] * inner + i] += x[r * inner + i];
+      }
+    }
+  });
+}
+
+Tensor scatter_add(const Tensor& a, size_t axis, const Tensor& index, const Tensor& src) {
+  Tensor result(a.shape());
+  utils::BufferCopy(a, result.data().get());
+  scatter_add_(result, axis, index, src);
+  return result;
+}
+
+void scatter_add_into(const Tensor& a, size_t axis, const Tensor& index, const Tensor& src, const Tensor& out) {
+  check_out(out, a.shape(), "scatter_add_into");
+  utils::BufferCopy(a, out.data().get() + out.offset());
+  scatter_add_(out, axis, index, src);
+}
+
+void copy_into(const Tensor& a, const Tensor& out) {
+  check_writable(out, "copy_into");
+  if (!out.is_contiguous() || num_elements(out.shape()) != num_elements(a.shape())) {
+    throw std::invalid_argument("copy_into expects a contiguous output of as many elements");
+  }
+  utils::BufferCopy(a, out.data().get() + out.offset());
 }
 }
 }
\ No newline at end of file
@@ -1,30 +1,132 @@
+#pragma once
+
 #include "tensor.h"
+#include "kernels.h"
+
+#include <list>
+#include <map>
+#include <mutex>
 // GLAS is a re-implementation of a few kernels from BLAS
-// All of the kernels expect the input to be *contiguous* in memory
+// The kernels read their inputs through shape and strides, so views need no
+// copy, and take a plain pass over memory when the inputs are contiguous.
+// The _into forms write the float32 result into out instead of allocating it,
+// out must be a contiguous float32 tensor of the result's shape. They are what
+// graph replays refresh captured results with.
 namespace gooch {
 namespace glas {
 
 void axpy(size_t N, float a, const float* x, float* y);
+// Converts N elements between float32 and a reduced precision dtype.
+void widen(DType dtype, size_t N, const uint16_t* x, float* out);
+void narrow(DType dtype, size_t N, const float* x, uint16_t* out);
+// A contiguous copy of a in dtype.
+Tensor cast(const Tensor& a, DType dtype);
+// The elements of a in row-major order, into an out of as many elements.
+void copy_into(const Tensor& a, const Tensor& out);
 Tensor add(const Tensor& a, const Tensor& b);
+void add_into(const Tensor& a, const Tensor& b, const Tensor& out);
 void add_(const Tensor& a, const Tensor& b);
 Tensor einsum(const Tensor &a, const Tensor &b, const std::string& equation);
+
+class EinsumEquation;
+
+// One label of a compiled contraction, with the stride it advances each operand by.
+struct EinsumLoop {
+  size_t size;
+  int a_stride;
+  int b_stride;
+  int c_stride;
+};
+
+// A contraction compiled for one equation and one pair of operand layouts.
+// Matrix-multiply shaped contractions (every label is batch, row, column or
+// contracted, at most one of the last three each) run as one sgemm per batch
+// index, everything else as a flat loop nest with the contracted labels innermost.
+struct EinsumPlan {
+  const EinsumEquation* equation;
+  std::vector<size_t> a_shape;
+  std::vector<int> a_strides;
+  std::vector<size_t> b_shape;
+  std::vector<int> b_strides;
+  std::vector<size_t> c_shape;
+  std::vector<int> c_strides;
+  size_t c_size;
+
+  bool gemm;
+  std::vector<EinsumLoop> loops; // batch labels for gemm, every label otherwise, outermost first
+  size_t M, N, K;
+  int a_rs, a_cs, b_rs, b_cs, c_rs, c_cs;
+};
+
+// A parsed equation "a labels, b labels -> c labels".
+// Equations are interned by parse_einsum, so a string is tokenized once, and each
+// equation caches the plans compiled for the kMaxEinsumPlans operand layouts it
+// used most recently.
+constexpr size_t kMaxEinsumPlans = 16;
+class EinsumEquation {
+public:
+  std::vector<std::string> a_labels_;
+  std::vector<std::string> b_labels_;
+  std::vector<std::string> c_labels_;
+
+  EinsumEquation(std::vector<std::string> a_labels, std::vector<std::string> b_labels, std::vector<std::string> c_labels);
+
+  // "c, b -> a" and "c, a -> b", the equations of the gradients with respect to a and b
+  const EinsumEquation& a_grad() const;
+  const EinsumEquation& b_grad() const;
+
+  // c_shape only needs to give sizes for output labels that neither operand has,
+  // which gradient equations of contractions that sum a label away need.
+  std::shared_ptr<const EinsumPlan> plan(utils::Span<size_t> a_shape, utils::Span<int> a_strides,
+      utils::Span<size_t> b_shape, utils::Span<int> b_strides,
+      utils::Span<size_t> c_shape = {}) const;
+
+private:
+  mutable std::mutex mutex_;
+  mutable std::unique_ptr<EinsumEquation> a_grad_;
+  mutable std::unique_ptr<EinsumEquation> b_grad_;
+  using PlanEntry = std::pair<std::vector<long>, std::shared_ptr<const EinsumPlan>>;
+  // most recently used first, plans_ points into it by key
+  mutable std::list<PlanEntry> lru_;
+  mutable std::map<std::vector<long>, std::list<PlanEntry>::iterator> plans_;
+};
+
+const EinsumEquation& parse_einsum(const std::string& equation);
+// Runs a compiled plan. Operands whose layout differs from the plan's are
+// planned again through the plan's equation.
+Tensor einsum(const EinsumPlan& plan, const Tensor& a, const Tensor& b);
+void einsum_into(const EinsumPlan& plan, const Tensor& a, const Tensor& b, const Tensor& out);
+// C += A * B for an M x K matrix A and a K x N matrix B.
+// Every operand is addressed through a row and a column stride, so transposed
+// operands need no copy, which is why this kernel does not need contiguous input.
+void sgemm(size_t M, size_t N, size_t K,
+    const float* a, int a_rs, int a_cs,
+    const float* b, int b_rs, int b_cs,
+    float* c, int c_rs, int c_cs);
 void mul_simd(size_t N, const float* x, float* y);
 Tensor mul(const Tensor& a, const Tensor& b);
+void mul_into(const Tensor& a, const Tensor& b, const Tensor& out);
 void div_simd(size_t N, const float* x, float* y);
 Tensor div(const Tensor& a, const Tensor& b);
+void div_into(const Tensor& a, const Tensor& b, const Tensor& out);
 void sub_simd(size_t N, const float* x, float* y);
 Tensor sub(const Tensor& a, const Tensor& b);
+void sub_into(const Tensor& a, const Tensor& b, const Tensor& out);
 void neg_simd(size_t N, float* y);
 Tensor neg(const Tensor& a);
+void neg_into(const Tensor& a, const Tensor& out);
 void inv_simd(size_t N, float* y);
 Tensor inv(const Tensor& a);
+void inv_into(const Tensor& a, const Tensor& out);
 void log_buf(size_t N, float* y);
 Tensor log(const Tensor& a);
+void log_into(const Tensor& a, const Tensor& out);
 void exp_buf(size_t N, float* y);
 Tensor exp(const Tensor& a);
-Tensor einsum(const Tensor& a, const Tensor& b, const std::string& equation);
+void exp_into(const Tensor& a, const Tensor& out);
 void root_buf(size_t N, float* y);
 Tensor root(const Tensor& a);
+void root_into(const Tensor& a, const Tensor& out);
 void mul_cons_simd(size_t N, float* y, float x);
 void inplace_add_square_const(size_t N, float a, const float* x, float* y);
 void adam_update(size_t N,
@@ -33,8 +135,47 @@ void adam_update(size_t N,
     const float* v,     // second moment
     float lr,
     float eps);
+// One parameter of a multi-tensor optimizer step, every buffer holds N floats.
+struct AdamTensor {
+  size_t N;
+  float* param;
+  const float* grad;
+  float* m;
+  float* v;
+};
+// Runs the fused Adam kernel over all the tensors in one parallel launch, split
+// into chunks so small and large parameters share the threads evenly.
+void adam_step(const std::vector<AdamTensor>& tensors, const kernels::AdamStep& step);
+// Reductions drop the reduced axes. The ReduceOp form runs the vector
+// kernels: a contiguous innermost axis is folded with several accumulators, an
+// outer axis folds whole rows into the output row, and a full reduction of a
+// contiguous tensor is split across threads. Sums are pairwise.
+enum class ReduceOp { kSum, kMax, kMin };
+Tensor reduce(const Tensor& a, ReduceOp op, std::unordered_set<size_t> axes);
+void reduce_into(const Tensor& a, ReduceOp op, const std::unordered_set<size_t>& axes, const Tensor& out);
+// applies op per element, for reductions without a kernel
 Tensor reduce(const Tensor& a, std::function<float(float, float)> op, std::unordered_set<size_t> axes, float fill);
 Tensor reduceSum(const Tensor& a, std::unordered_set<size_t> axes);
 Tensor reduceMax(const Tensor& a, std::unordered_set<size_t> axes);
+Tensor reduceMin(const Tensor& a, std::unordered_set<size_t> axes);
+Tensor reduceMean(const Tensor& a, std::unordered_set<size_t> axes);
+void reduceMean_into(const Tensor& a, const std::unordered_set<size_t>& axes, const Tensor& out);
+// The index of the first max or min along axis, as floats, with axis dropped.
+Tensor argReduce(const Tensor& a, size_t axis, ReduceOp op);
+void argReduce_into(const Tensor& a, size_t axis, ReduceOp op, const Tensor& out);
+Tensor argmax(const Tensor& a, size_t axis);
+Tensor argmin(const Tensor& a, size_t axis);
+// Indexing along one axis with class indices held as floats, see gooch::gather.
+// Results are float32 and contiguous. The in-place forms add into out, a
+// contiguous float32 tensor, and are the backward of the selections: repeated
+// indices accumulate, each thread owns whole slices before axis.
+Tensor index_select(const Tensor& a, size_t axis, const Tensor& index);
+void index_select_into(const Tensor& a, size_t axis, const Tensor& index, const Tensor& out);
+void index_add_(const Tensor& out, size_t axis, const Tensor& index, const Tensor& src);
+Tensor gather(const Tensor& a, size_t axis, const Tensor& index);
+void gather_into(const Tensor& a, size_t axis, const Tensor& index, const Tensor& out);
+void scatter_add_(const Tensor& out, size_t axis, const Tensor& index, const Tensor& src);
+Tensor scatter_add(const Tensor& a, size_t axis, const Tensor& index, const Tensor& src);
+void scatter_add_into(const Tensor& a, size_t axis, const Tensor& index, const Tensor& src, const Tensor& out);
 }
 }
\ No newline at end of file
@@ -0,0 +1,104 @@
+#include "graph.h"
+#include "glas.h"
+#include "utils.h"
+
+#include <stdexcept>
+
+namespace gooch {
+namespace graph {
+
+struct Capture {
+  std::vector<std::function<void()>> refresh;
+  std::vector<Tensor> results;
+  bool supported = true;
+};
+
+namespace {
+thread_local Capture* active = nullptr;
+
+// restores the enclosing capture even if forward throws
+struct CaptureGuard {
+  Capture* saved;
+  explicit CaptureGuard(Capture* capture) : saved(active) { active = capture; }
+  ~CaptureGuard() { active = saved; }
+};
+
+bool same_layout(const Tensor& input, const Tensor& captured) {
+  return input.shape() == captured.shape() && input.dtype() == DType::kFloat32 && captured.dtype() == DType::kFloat32;
+}
+}
+
+bool Capturing() {
+  return active != nullptr;
+}
+
+void Record(std::function<void()> refresh, const Tensor& result) {
+  if (active == nullptr) return;
+  active->refresh.push_back(std::move(refresh));
+  active->results.push_back(result);
+}
+
+void Unsupported() {
+  if (active != nullptr) active->supported = false;
+}
+
+StepGraph::StepGraph(std::function<Tensor(const std::vector<Tensor>&)> forward, std::function<void()> update)
+    : forward_(std::move(forward)), update_(std::move(update)), loss_(std::vector<size_t>{}) {}
+
+StepGraph::~StepGraph() = default;
+
+Tensor StepGraph::Step(const std::vector<Tensor>& inputs) {
+  bool replay = capture_ != nullptr && inputs.size() == inputs_.size();
+  for (size_t i = 0; replay && i < inputs.size(); ++i) {
+    replay = same_layout(inputs[i], inputs_[i]);
+  }
+  if (replay) {
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      utils::StridedCopy(inputs[i].shape(), inputs[i].data().get() + inputs[i].offset(), inputs[i].strides(),
+          inputs_[i].data().get(), inputs_[i].strides());
+    }
+    // the gradients of the inputs and intermediates are accumulated into, a fresh step starts them at zero
+    for (Tensor& input : inputs_) input.ZeroGrad();
+    for (Tensor& result : capture_->results) result.ZeroGrad();
+    for (const std::function<void()>& refresh : capture_->refresh) refresh();
+    autograd::RunBackward(loss_.grad_fn_, FromVector(1.0f));
+    if (update_) update_();
+    replays_++;
+    return loss_;
+  }
+
+  capture_ = nullptr;
+  inputs_.clear();
+  bool capture = !eager_;
+  for (const Tensor& input : inputs) {
+    Tensor copy = glas::cast(input, input.dtype());
+    copy.SetRequiresGrad(input.requires_grad());
+    capture = capture && input.dtype() == DType::kFloat32;
+    inputs_.push_back(copy);
+  }
+  auto recorded = std::make_unique<Capture>();
+  Tensor loss = [&] {
+    CaptureGuard guard(capture ? recorded.get() : nullptr);
+    return forward_(inputs_);
+  }();
+  if (!loss.grad_fn_) {
+    throw std::invalid_argument("StepGraph needs a loss that depends on something that requires a gradient");
+  }
+  loss.Backward();
+  if (update_) update_();
+  if (capture && recorded->supported) {
+    capture_ = std::move(recorded);
+    loss_ = loss;
+  } else {
+    eager_ = true;
+    inputs_.clear();
+  }
+  return loss;
+}
+
+size_t StepGraph::replays() const {
+  return replays_;
+}
+
+}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "tensor.h"
+
+#include <functional>
+#include <memory>
+#include <vector>
+
+// Capture and replay of static-shape training steps.
+// A StepGraph runs its step eagerly once while the ops record how to refresh
+// their results in place. Later steps whose inputs have the captured shapes
+// copy the new data into the captured inputs, rerun the recorded ops in order
+// and backpropagate through the autograd graph built during capture, so no
+// closure is built and no equation or plan is looked up again, and every
+// result keeps its buffer from step to step. Inputs of other shapes are
+// captured again, and a step that used an op which cannot be replayed (lazy
+// fusion, checkpointing, int8 einsum) always runs eagerly.
+namespace gooch {
+namespace graph {
+
+// Whether ops on this thread are being captured.
+bool Capturing();
+// Appends how to refresh result to the capture, replays run these in order.
+void Record(std::function<void()> refresh, const Tensor& result);
+// The capture cannot be replayed.
+void Unsupported();
+
+// the ops recorded by one capture
+struct Capture;
+
+class StepGraph {
+public:
+  // forward maps the inputs to a scalar loss and must be built from the Tensor
+  // ops. Tensors it reads besides its inputs, e.g. weights, are read afresh on
+  // every replay. update runs after backward, e.g. the optimizer step.
+  explicit StepGraph(std::function<Tensor(const std::vector<Tensor>&)> forward, std::function<void()> update = nullptr);
+  StepGraph(const StepGraph&) = delete;
+  StepGraph& operator=(const StepGraph&) = delete;
+  ~StepGraph();
+
+  // Runs forward, backward and update on inputs and returns the loss. The
+  // inputs are copied, gradients are not returned to them. A replay returns
+  // the same loss tensor with its new value.
+  Tensor Step(const std::vector<Tensor>& inputs);
+  // steps that were replayed rather than run eagerly
+  size_t replays() const;
+
+private:
+  std::function<Tensor(const std::vector<Tensor>&)> forward_;
+  std::function<void()> update_;
+  std::unique_ptr<Capture> capture_;
+  std::vector<Tensor> inputs_;
+  Tensor loss_;
+  bool eager_ = false;
+  size_t replays_ = 0;
+};
+
+}
+}
@@ -0,0 +1,127 @@
+#include "io.h"
+#include "glas.h"
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace gooch {
+namespace io {
+
+namespace {
+// followed by rank uint64 dimensions, then padding up to payload_offset
+struct Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t dtype;
+  uint64_t rank;
+  uint64_t payload_offset;
+};
+
+size_t payload_offset(size_t rank) {
+  size_t end = sizeof(Header) + rank * sizeof(uint64_t);
+  return (end + allocator::kAlignment - 1) / allocator::kAlignment * allocator::kAlignment;
+}
+
+std::runtime_error system_error(const std::string& what, const std::string& path) {
+  return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+
+// a mapped file, unmapped with the last tensor that shares it or as soon as its header is found invalid
+struct Mapping {
+  void* base;
+  size_t length;
+  ~Mapping() {
+    if (base != nullptr) munmap(base, length);
+  }
+};
+}
+
+void Save(const Tensor& t, const std::string& path) {
+  Tensor packed = t.is_contiguous() ? t : glas::cast(t, t.dtype());
+  utils::Span<size_t> shape = packed.shape();
+  Header header{};
+  std::memcpy(header.magic, kMagic, sizeof(kMagic));
+  header.version = kVersion;
+  header.dtype = (uint32_t) packed.dtype();
+  header.rank = shape.size();
+  header.payload_offset = payload_offset(shape.size());
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out) throw system_error("Cannot create", path);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (size_t dim : shape) {
+    uint64_t value = dim;
+    out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+  }
+  std::string padding(header.payload_offset - sizeof(header) - shape.size() * sizeof(uint64_t), '\0');
+  out.write(padding.data(), padding.size());
+  size_t bytes = packed.size() * SizeOf(packed.dtype());
+  if (packed.half_data()) {
+    out.write(reinterpret_cast<const char*>(packed.half_data().get() + packed.offset()), bytes);
+  } else {
+    out.write(reinterpret_cast<const char*>(packed.data().get() + packed.offset()), bytes);
+  }
+  out.close();
+  if (!out) throw system_error("Cannot write", path);
+}
+
+Tensor Load(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) throw system_error("Cannot open", path);
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    throw system_error("Cannot stat", path);
+  }
+  size_t length = info.st_size;
+  if (length < sizeof(Header)) {
+    close(fd);
+    throw std::invalid_argument(path + " is not a tensor file");
+  }
+  void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) throw system_error("Cannot map", path);
+  std::shared_ptr<Mapping> mapping(new Mapping{base, length});
+
+  const char* bytes = static_cast<const char*>(base);
+  Header header;
+  std::memcpy(&header, bytes, sizeof(header));
+  if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+      header.dtype > (uint32_t) DType::kFloat16 || header.rank > length / sizeof(uint64_t) || header.payload_offset != payload_offset(header.rank) ||
+      header.payload_offset > length) {
+    throw std::invalid_argument(path + " is not a tensor file");
+  }
+  std::vector<size_t> shape(header.rank);
+  size_t size = 1;
+  for (size_t d = 0; d < shape.size(); d++) {
+    uint64_t dim;
+    std::memcpy(&dim, bytes + sizeof(Header) + d * sizeof(uint64_t), sizeof(dim));
+    shape[d] = dim;
+    if (dim != 0 && size > SIZE_MAX / dim) throw std::invalid_argument(path + " has a shape too large to address");
+    size *= dim;
+  }
+  DType dtype = (DType) header.dtype;
+  if (size > SIZE_MAX / SizeOf(dtype)) throw std::invalid_argument(path + " has a shape too large to address");
+  if (length - header.payload_offset < size * SizeOf(dtype)) {
+    throw std::invalid_argument(path + " is shorter than its header says");
+  }
+
+  // the buffers share ownership of the mapping, which is unmapped with the last of them
+  void* payload = static_cast<char*>(base) + header.payload_offset;
+  if (dtype == DType::kFloat32) {
+    std::shared_ptr<float> data(mapping, static_cast<float*>(payload));
+    return Tensor(shape, utils::compute_strides(shape), 0, data);
+  }
+  std::shared_ptr<uint16_t> data(mapping, static_cast<uint16_t*>(payload));
+  return Tensor(shape, utils::compute_strides(shape), 0, data, dtype);
+}
+
+}
+}
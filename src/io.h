@@ -0,0 +1,29 @@
+#pragma once
+
+#include "tensor.h"
+
+#include <string>
+
+// Binary tensor files.
+// A file holds one tensor: a header with its dtype and shape, then its
+// elements in row-major order, starting at an offset aligned to
+// allocator::kAlignment. Loading maps the file instead of reading it, so the
+// tensor's storage is the mapping itself. Pages are read from disk on first
+// touch and the mapping is released with the last tensor that shares it. The
+// mapping is private, so writes through the tensor never reach the file.
+// Numbers are stored in the byte order of the machine that wrote them.
+namespace gooch {
+namespace io {
+
+// the first bytes of every tensor file
+constexpr char kMagic[8] = {'G', 'O', 'O', 'C', 'H', 'T', 'N', 'S'};
+constexpr uint32_t kVersion = 1;
+
+// Writes t's elements in its own dtype. A failed write throws std::runtime_error.
+void Save(const Tensor& t, const std::string& path);
+// Maps a file written by Save. Throws std::runtime_error if it cannot be
+// opened or mapped and std::invalid_argument if it is not a tensor file.
+Tensor Load(const std::string& path);
+
+}
+}
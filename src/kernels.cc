@@ -0,0 +1,376 @@
+#include "kernels.h"
+#include "parallel.h"
+#include "dtype.h"
+
+#include <immintrin.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// Each instruction set gets its own namespace, compiled under a GCC target
+// pragma, so no kernel of a wider set is ever inlined into or shared with a
+// narrower one. Only code defined inside a region uses its instructions, the
+// standard library is instantiated for the baseline.
+namespace gooch {
+namespace kernels {
+
+#pragma GCC push_options
+#pragma GCC target("sse4.2")
+namespace sse {
+struct Vec {
+  using Reg = __m128;
+  static constexpr size_t kWidth = 4;
+  static Reg load(const float* p) { return _mm_loadu_ps(p); }
+  static void store(float* p, Reg v) { _mm_storeu_ps(p, v); }
+  static Reg set1(float a) { return _mm_set1_ps(a); }
+  static Reg zero() { return _mm_setzero_ps(); }
+  static Reg add(Reg a, Reg b) { return _mm_add_ps(a, b); }
+  static Reg sub(Reg a, Reg b) { return _mm_sub_ps(a, b); }
+  static Reg mul(Reg a, Reg b) { return _mm_mul_ps(a, b); }
+  static Reg div(Reg a, Reg b) { return _mm_div_ps(a, b); }
+  static Reg sqrt(Reg a) { return _mm_sqrt_ps(a); }
+  static Reg fmadd(Reg a, Reg b, Reg c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+  static Reg min(Reg a, Reg b) { return _mm_min_ps(a, b); }
+  static Reg max(Reg a, Reg b) { return _mm_max_ps(a, b); }
+  static Reg round(Reg a) { return _mm_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+  static Reg rcp(Reg a) { return _mm_rcp_ps(a); }
+  static float reduce_add(Reg a) {
+    a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+    return _mm_cvtss_f32(_mm_add_ss(a, _mm_movehdup_ps(a)));
+  }
+  static float reduce_max(Reg a) {
+    a = _mm_max_ps(a, _mm_movehl_ps(a, a));
+    return _mm_cvtss_f32(_mm_max_ss(a, _mm_movehdup_ps(a)));
+  }
+  static float reduce_min(Reg a) {
+    a = _mm_min_ps(a, _mm_movehl_ps(a, a));
+    return _mm_cvtss_f32(_mm_min_ss(a, _mm_movehdup_ps(a)));
+  }
+  // a < b ? if_true : if_false, false whenever either side is NaN
+  static Reg select_less(Reg a, Reg b, Reg if_true, Reg if_false) { return _mm_blendv_ps(if_false, if_true, _mm_cmplt_ps(a, b)); }
+  // 2^n for integral n in [-126, 127]
+  static Reg pow2i(Reg n) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(_mm_cvtps_epi32(n), _mm_set1_epi32(127)), 23)); }
+  // the unbiased exponent of a normal float, as a float
+  static Reg exponent(Reg a) {
+    __m128i bits = _mm_srli_epi32(_mm_castps_si128(a), 23);
+    return _mm_cvtepi32_ps(_mm_sub_epi32(_mm_and_si128(bits, _mm_set1_epi32(0xff)), _mm_set1_epi32(127)));
+  }
+  // the significand of a normal float, in [1, 2)
+  static Reg significand(Reg a) {
+    __m128i bits = _mm_and_si128(_mm_castps_si128(a), _mm_set1_epi32(0x007fffff));
+    return _mm_castsi128_ps(_mm_or_si128(bits, _mm_set1_epi32(0x3f800000)));
+  }
+  static Reg load_bf16(const uint16_t* p) {
+    return _mm_castsi128_ps(_mm_slli_epi32(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*) p)), 16));
+  }
+  // rounds to nearest even like float_to_bf16, NaNs are kept quiet
+  static void store_bf16(uint16_t* p, Reg v) {
+    __m128i bits = _mm_castps_si128(v);
+    __m128i rounded = _mm_add_epi32(bits, _mm_add_epi32(_mm_set1_epi32(0x7fff), _mm_and_si128(_mm_srli_epi32(bits, 16), _mm_set1_epi32(1))));
+    __m128i quiet = _mm_or_si128(bits, _mm_set1_epi32(0x400000));
+    __m128i top = _mm_srli_epi32(_mm_castps_si128(_mm_blendv_ps(_mm_castsi128_ps(rounded), _mm_castsi128_ps(quiet), _mm_cmpunord_ps(v, v))), 16);
+    _mm_storel_epi64((__m128i*) p, _mm_packus_epi32(top, top));
+  }
+  // no F16C below AVX2, half floats convert one at a time
+  static Reg load_fp16(const uint16_t* p) {
+    alignas(16) float lanes[4];
+    for (size_t i = 0; i < 4; i++) lanes[i] = fp16_to_float(p[i]);
+    return _mm_load_ps(lanes);
+  }
+  static void store_fp16(uint16_t* p, Reg v) {
+    alignas(16) float lanes[4];
+    _mm_store_ps(lanes, v);
+    for (size_t i = 0; i < 4; i++) p[i] = float_to_fp16(lanes[i]);
+  }
+  // int8 dot products: |a| times b with the sign of a, maddubs sums pairs of
+  // products into int16 without saturating as long as |values| <= 127
+  using IReg = __m128i;
+  static constexpr size_t kDotWidth = 16;
+  static IReg izero() { return _mm_setzero_si128(); }
+  static IReg load_i8(const int8_t* p) { return _mm_loadu_si128((const __m128i*) p); }
+  static IReg abs_i8(IReg a) { return _mm_abs_epi8(a); }
+  static IReg dot_i8(IReg acc, IReg a_abs, IReg a, IReg b) {
+    __m128i pairs = _mm_maddubs_epi16(a_abs, _mm_sign_epi8(b, a));
+    return _mm_add_epi32(acc, _mm_madd_epi16(pairs, _mm_set1_epi16(1)));
+  }
+  static int32_t ireduce_add(IReg a) {
+    a = _mm_add_epi32(a, _mm_shuffle_epi32(a, 0x4e));
+    a = _mm_add_epi32(a, _mm_shuffle_epi32(a, 0xb1));
+    return _mm_cvtsi128_si32(a);
+  }
+};
+#include "kernels_impl.h"
+#include "gemm_impl.h"
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2,fma,f16c")
+namespace avx2 {
+struct Vec {
+  using Reg = __m256;
+  static constexpr size_t kWidth = 8;
+  static Reg load(const float* p) { return _mm256_loadu_ps(p); }
+  static void store(float* p, Reg v) { _mm256_storeu_ps(p, v); }
+  static Reg set1(float a) { return _mm256_set1_ps(a); }
+  static Reg zero() { return _mm256_setzero_ps(); }
+  static Reg add(Reg a, Reg b) { return _mm256_add_ps(a, b); }
+  static Reg sub(Reg a, Reg b) { return _mm256_sub_ps(a, b); }
+  static Reg mul(Reg a, Reg b) { return _mm256_mul_ps(a, b); }
+  static Reg div(Reg a, Reg b) { return _mm256_div_ps(a, b); }
+  static Reg sqrt(Reg a) { return _mm256_sqrt_ps(a); }
+  static Reg fmadd(Reg a, Reg b, Reg c) { return _mm256_fmadd_ps(a, b, c); }
+  static Reg min(Reg a, Reg b) { return _mm256_min_ps(a, b); }
+  static Reg max(Reg a, Reg b) { return _mm256_max_ps(a, b); }
+  static Reg round(Reg a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+  static Reg rcp(Reg a) { return _mm256_rcp_ps(a); }
+  static float reduce_add(Reg a) {
+    __m128 v = _mm_add_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    v = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_add_ss(v, _mm_movehdup_ps(v)));
+  }
+  static float reduce_max(Reg a) {
+    __m128 v = _mm_max_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    v = _mm_max_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_max_ss(v, _mm_movehdup_ps(v)));
+  }
+  static float reduce_min(Reg a) {
+    __m128 v = _mm_min_ps(_mm256_castps256_ps128(a), _mm256_extractf128_ps(a, 1));
+    v = _mm_min_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_min_ss(v, _mm_movehdup_ps(v)));
+  }
+  static Reg select_less(Reg a, Reg b, Reg if_true, Reg if_false) { return _mm256_blendv_ps(if_false, if_true, _mm256_cmp_ps(a, b, _CMP_LT_OQ)); }
+  static Reg pow2i(Reg n) { return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23)); }
+  static Reg exponent(Reg a) {
+    __m256i bits = _mm256_srli_epi32(_mm256_castps_si256(a), 23);
+    return _mm256_cvtepi32_ps(_mm256_sub_epi32(_mm256_and_si256(bits, _mm256_set1_epi32(0xff)), _mm256_set1_epi32(127)));
+  }
+  static Reg significand(Reg a) {
+    __m256i bits = _mm256_and_si256(_mm256_castps_si256(a), _mm256_set1_epi32(0x007fffff));
+    return _mm256_castsi256_ps(_mm256_or_si256(bits, _mm256_set1_epi32(0x3f800000)));
+  }
+  static Reg load_bf16(const uint16_t* p) {
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*) p)), 16));
+  }
+  static void store_bf16(uint16_t* p, Reg v) {
+    __m256i bits = _mm256_castps_si256(v);
+    __m256i rounded = _mm256_add_epi32(bits, _mm256_add_epi32(_mm256_set1_epi32(0x7fff), _mm256_and_si256(_mm256_srli_epi32(bits, 16), _mm256_set1_epi32(1))));
+    __m256i quiet = _mm256_or_si256(bits, _mm256_set1_epi32(0x400000));
+    __m256i top = _mm256_srli_epi32(_mm256_castps_si256(_mm256_blendv_ps(_mm256_castsi256_ps(rounded), _mm256_castsi256_ps(quiet), _mm256_cmp_ps(v, v, _CMP_UNORD_Q))), 16);
+    _mm_storeu_si128((__m128i*) p, _mm_packus_epi32(_mm256_castsi256_si128(top), _mm256_extracti128_si256(top, 1)));
+  }
+  static Reg load_fp16(const uint16_t* p) { return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*) p)); }
+  static void store_fp16(uint16_t* p, Reg v) { _mm_storeu_si128((__m128i*) p, _mm256_cvtps_ph(v, _MM_FROUND_TO_NEAREST_INT)); }
+  using IReg = __m256i;
+  static constexpr size_t kDotWidth = 32;
+  static IReg izero() { return _mm256_setzero_si256(); }
+  static IReg load_i8(const int8_t* p) { return _mm256_loadu_si256((const __m256i*) p); }
+  static IReg abs_i8(IReg a) { return _mm256_abs_epi8(a); }
+  static IReg dot_i8(IReg acc, IReg a_abs, IReg a, IReg b) {
+    __m256i pairs = _mm256_maddubs_epi16(a_abs, _mm256_sign_epi8(b, a));
+    return _mm256_add_epi32(acc, _mm256_madd_epi16(pairs, _mm256_set1_epi16(1)));
+  }
+  static int32_t ireduce_add(IReg a) {
+    __m128i v = _mm_add_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4e));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xb1));
+    return _mm_cvtsi128_si32(v);
+  }
+};
+#include "kernels_impl.h"
+#include "gemm_impl.h"
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx2,fma,f16c")
+namespace avx512 {
+struct Vec {
+  using Reg = __m512;
+  static constexpr size_t kWidth = 16;
+  static Reg load(const float* p) { return _mm512_loadu_ps(p); }
+  static void store(float* p, Reg v) { _mm512_storeu_ps(p, v); }
+  static Reg set1(float a) { return _mm512_set1_ps(a); }
+  static Reg zero() { return _mm512_setzero_ps(); }
+  static Reg add(Reg a, Reg b) { return _mm512_add_ps(a, b); }
+  static Reg sub(Reg a, Reg b) { return _mm512_sub_ps(a, b); }
+  static Reg mul(Reg a, Reg b) { return _mm512_mul_ps(a, b); }
+  static Reg div(Reg a, Reg b) { return _mm512_div_ps(a, b); }
+  // the unmasked forms trip GCC 12's -Wmaybe-uninitialized on their undefined passthrough
+  static Reg sqrt(Reg a) { return _mm512_maskz_sqrt_ps((__mmask16) -1, a); }
+  static Reg fmadd(Reg a, Reg b, Reg c) { return _mm512_fmadd_ps(a, b, c); }
+  static Reg min(Reg a, Reg b) { return _mm512_maskz_min_ps((__mmask16) -1, a, b); }
+  static Reg max(Reg a, Reg b) { return _mm512_maskz_max_ps((__mmask16) -1, a, b); }
+  static Reg round(Reg a) { return _mm512_maskz_roundscale_ps((__mmask16) -1, a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+  static Reg rcp(Reg a) { return _mm512_maskz_rcp14_ps((__mmask16) -1, a); }
+  // through memory, the casts behind _mm512_reduce_* trip -Wuninitialized on GCC 12
+  static float reduce_add(Reg a) {
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, a);
+    __m256 v = _mm256_add_ps(_mm256_load_ps(lanes), _mm256_load_ps(lanes + 8));
+    __m128 w = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    w = _mm_add_ps(w, _mm_movehl_ps(w, w));
+    return _mm_cvtss_f32(_mm_add_ss(w, _mm_movehdup_ps(w)));
+  }
+  static float reduce_max(Reg a) {
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, a);
+    __m256 v = _mm256_max_ps(_mm256_load_ps(lanes), _mm256_load_ps(lanes + 8));
+    __m128 w = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    w = _mm_max_ps(w, _mm_movehl_ps(w, w));
+    return _mm_cvtss_f32(_mm_max_ss(w, _mm_movehdup_ps(w)));
+  }
+  static float reduce_min(Reg a) {
+    alignas(64) float lanes[16];
+    _mm512_store_ps(lanes, a);
+    __m256 v = _mm256_min_ps(_mm256_load_ps(lanes), _mm256_load_ps(lanes + 8));
+    __m128 w = _mm_min_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    w = _mm_min_ps(w, _mm_movehl_ps(w, w));
+    return _mm_cvtss_f32(_mm_min_ss(w, _mm_movehdup_ps(w)));
+  }
+  static Reg select_less(Reg a, Reg b, Reg if_true, Reg if_false) { return _mm512_mask_blend_ps(_mm512_cmp_ps_mask(a, b, _CMP_LT_OQ), if_false, if_true); }
+  static Reg pow2i(Reg n) {
+    __m512i i = _mm512_maskz_cvtps_epi32((__mmask16) -1, n);
+    return _mm512_castsi512_ps(_mm512_maskz_slli_epi32((__mmask16) -1, _mm512_add_epi32(i, _mm512_set1_epi32(127)), 23));
+  }
+  static Reg exponent(Reg a) {
+    __m512i bits = _mm512_maskz_srli_epi32((__mmask16) -1, _mm512_castps_si512(a), 23);
+    return _mm512_maskz_cvtepi32_ps((__mmask16) -1, _mm512_sub_epi32(_mm512_and_si512(bits, _mm512_set1_epi32(0xff)), _mm512_set1_epi32(127)));
+  }
+  static Reg significand(Reg a) {
+    __m512i bits = _mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x007fffff));
+    return _mm512_castsi512_ps(_mm512_or_si512(bits, _mm512_set1_epi32(0x3f800000)));
+  }
+  static Reg load_bf16(const uint16_t* p) {
+    __m512i wide = _mm512_maskz_cvtepu16_epi32((__mmask16) -1, _mm256_loadu_si256((const __m256i*) p));
+    return _mm512_castsi512_ps(_mm512_maskz_slli_epi32((__mmask16) -1, wide, 16));
+  }
+  static void store_bf16(uint16_t* p, Reg v) {
+    __m512i bits = _mm512_castps_si512(v);
+    __m512i lsb = _mm512_and_si512(_mm512_maskz_srli_epi32((__mmask16) -1, bits, 16), _mm512_set1_epi32(1));
+    __m512i rounded = _mm512_add_epi32(bits, _mm512_add_epi32(_mm512_set1_epi32(0x7fff), lsb));
+    __m512i quiet = _mm512_or_si512(bits, _mm512_set1_epi32(0x400000));
+    __m512i chosen = _mm512_mask_blend_epi32(_mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q), rounded, quiet);
+    _mm256_storeu_si256((__m256i*) p, _mm512_maskz_cvtepi32_epi16((__mmask16) -1, _mm512_maskz_srli_epi32((__mmask16) -1, chosen, 16)));
+  }
+  static Reg load_fp16(const uint16_t* p) { return _mm512_maskz_cvtph_ps((__mmask16) -1, _mm256_loadu_si256((const __m256i*) p)); }
+  static void store_fp16(uint16_t* p, Reg v) {
+    _mm256_storeu_si256((__m256i*) p, _mm512_maskz_cvtps_ph((__mmask16) -1, v, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+  }
+  // byte and word arithmetic on 512 bits needs AVX-512BW, the int8 dot products stay on AVX2
+  using IReg = __m256i;
+  static constexpr size_t kDotWidth = 32;
+  static IReg izero() { return _mm256_setzero_si256(); }
+  static IReg load_i8(const int8_t* p) { return _mm256_loadu_si256((const __m256i*) p); }
+  static IReg abs_i8(IReg a) { return _mm256_abs_epi8(a); }
+  static IReg dot_i8(IReg acc, IReg a_abs, IReg a, IReg b) {
+    __m256i pairs = _mm256_maddubs_epi16(a_abs, _mm256_sign_epi8(b, a));
+    return _mm256_add_epi32(acc, _mm256_madd_epi16(pairs, _mm256_set1_epi16(1)));
+  }
+  static int32_t ireduce_add(IReg a) {
+    __m128i v = _mm_add_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0x4e));
+    v = _mm_add_epi32(v, _mm_shuffle_epi32(v, 0xb1));
+    return _mm_cvtsi128_si32(v);
+  }
+};
+#include "kernels_impl.h"
+#include "gemm_impl.h"
+}
+#pragma GCC pop_options
+
+namespace {
+#define GOOCH_KERNEL_TABLE(ns, isa, name) \
+  Table{isa, name, ns::Vec::kWidth, ns::axpy, \
+      ns::binary_row<ns::Add>, ns::binary_row<ns::Sub>, ns::binary_row<ns::Mul>, ns::binary_row<ns::Div>, \
+      ns::unary_row<ns::Neg>, ns::unary_row<ns::Inv>, ns::unary_row<ns::Root>, ns::unary_row<ns::Exp>, ns::unary_row<ns::Log>, \
+      ns::unary_row<ns::ExpFast>, ns::unary_row<ns::LogFast>, ns::unary_row<ns::InvFast>, \
+      ns::binary_row<ns::Max>, ns::binary_row<ns::Min>, \
+      ns::reduce_row<ns::Max>, ns::reduce_row<ns::Min>, ns::sum, ns::sum_exp, ns::scaled_exp, \
+      ns::widen_row<ns::BFloat16>, ns::narrow_row<ns::BFloat16>, ns::widen_row<ns::Float16>, ns::narrow_row<ns::Float16>, \
+      ns::scale, ns::add_square_scaled, ns::adam_update, ns::adam_step, ns::sgemm, ns::qgemm, ns::Vec::kDotWidth}
+
+const Table kSse = GOOCH_KERNEL_TABLE(sse, Isa::kSse, "sse");
+const Table kAvx2 = GOOCH_KERNEL_TABLE(avx2, Isa::kAvx2, "avx2");
+const Table kAvx512 = GOOCH_KERNEL_TABLE(avx512, Isa::kAvx512, "avx512");
+
+#undef GOOCH_KERNEL_TABLE
+
+const Table& table_of(Isa isa) {
+  switch (isa) {
+  case Isa::kAvx512: return kAvx512;
+  case Isa::kAvx2: return kAvx2;
+  default: return kSse;
+  }
+}
+
+const Table* Detect() {
+  if (const char* env = std::getenv("GOOCH_ISA")) {
+    for (Isa isa : {Isa::kSse, Isa::kAvx2, Isa::kAvx512}) {
+      if (std::strcmp(env, table_of(isa).name) == 0) {
+        if (!Supported(isa)) {
+          throw std::invalid_argument(std::string("GOOCH_ISA=") + env + " is not supported by this CPU");
+        }
+        return &table_of(isa);
+      }
+    }
+    throw std::invalid_argument(std::string("Unknown GOOCH_ISA=") + env + ", expected sse, avx2 or avx512");
+  }
+  for (Isa isa : {Isa::kAvx512, Isa::kAvx2}) {
+    if (Supported(isa)) return &table_of(isa);
+  }
+  return &kSse;
+}
+
+std::atomic<const Table*> current{nullptr};
+
+bool DefaultFastMath() {
+  const char* env = std::getenv("GOOCH_FAST_MATH");
+  return env != nullptr && std::strcmp(env, "1") == 0;
+}
+
+std::atomic<bool> fast_math{DefaultFastMath()};
+}
+
+bool Supported(Isa isa) {
+  __builtin_cpu_init();
+  switch (isa) {
+  case Isa::kAvx512: return __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+  case Isa::kAvx2: return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c");
+  default: return __builtin_cpu_supports("sse4.2");
+  }
+}
+
+const Table& Get() {
+  const Table* table = current.load(std::memory_order_acquire);
+  if (table == nullptr) {
+    const Table* detected = Detect();
+    current.compare_exchange_strong(table, detected);
+    table = current.load(std::memory_order_acquire);
+  }
+  return *table;
+}
+
+void Select(Isa isa) {
+  if (!Supported(isa)) {
+    throw std::invalid_argument(std::string("The CPU does not support ") + table_of(isa).name);
+  }
+  current.store(&table_of(isa), std::memory_order_release);
+}
+
+void SetFastMath(bool fast) {
+  fast_math = fast;
+}
+
+bool FastMath() {
+  return fast_math;
+}
+
+}
+}
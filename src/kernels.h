@@ -0,0 +1,108 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Instruction set dispatch for the innermost loops of glas.
+// Every kernel is compiled once per instruction set and the table for the
+// best one the CPU supports is picked on first use through cpuid, so a single
+// binary runs on SSE-only machines and uses FMA and 512-bit vectors where
+// they exist. GOOCH_ISA=sse|avx2|avx512 forces a path, e.g. for benchmarks.
+namespace gooch {
+namespace kernels {
+
+enum class Isa { kSse, kAvx2, kAvx512 };
+
+// out[i] = x[i * x_stride] op y[i * y_stride]. A stride of 0 broadcasts that
+// operand along the row. out may alias either operand when its stride is 1.
+using BinaryRow = void (*)(size_t N, const float* x, long x_stride, const float* y, long y_stride, float* out);
+// out[i] = op(x[i]), out may be x.
+using UnaryRow = void (*)(size_t N, const float* x, float* out);
+// conversions between float32 and a 16-bit storage type, see dtype.h
+using WidenRow = void (*)(size_t N, const uint16_t* x, float* out);
+using NarrowRow = void (*)(size_t N, const float* x, uint16_t* out);
+
+// The scalars of one fused Adam step. With g the gradient:
+//   m = beta1 * m + (1 - beta1) * g
+//   v = beta2 * v + (1 - beta2) * g * g
+//   param = decay * param - step_size * m / (sqrt(v) * v_scale + eps)
+// Bias correction folds into step_size and v_scale, decoupled weight decay into decay.
+struct AdamStep {
+  float beta1;
+  float beta2;
+  float step_size;
+  float v_scale;
+  float eps;
+  float decay;
+};
+
+struct Table {
+  Isa isa;
+  const char* name;
+  size_t width; // floats per vector register
+  // y += a * x
+  void (*axpy)(size_t N, float a, const float* x, float* y);
+  BinaryRow add;
+  BinaryRow sub;
+  BinaryRow mul;
+  BinaryRow div;
+  UnaryRow neg;
+  UnaryRow inv;
+  UnaryRow root;
+  UnaryRow exp;
+  UnaryRow log;
+  // approximations, see kernels_impl.h for the error of each
+  UnaryRow exp_fast;
+  UnaryRow log_fast;
+  UnaryRow inv_fast;
+  // elementwise max and min, also the vertical step of a max or min reduction
+  BinaryRow maximum;
+  BinaryRow minimum;
+  // reductions of x[0..N), the max of nothing is -inf and the min +inf.
+  // Sums are pairwise over blocks, their error grows with log N.
+  float (*max)(size_t N, const float* x);
+  float (*min)(size_t N, const float* x);
+  float (*sum)(size_t N, const float* x);
+  // sum of exp(x[i] - shift)
+  float (*sum_exp)(size_t N, const float* x, float shift);
+  // out[i] = scale * exp(x[i] - shift) + bias
+  void (*scaled_exp)(size_t N, const float* x, float shift, float scale, float bias, float* out);
+  WidenRow bf16_to_float;
+  NarrowRow float_to_bf16;
+  WidenRow fp16_to_float;
+  NarrowRow float_to_fp16;
+  // y *= a
+  void (*scale)(size_t N, float a, float* y);
+  // y += a * x * x
+  void (*add_square_scaled)(size_t N, float a, const float* x, float* y);
+  // theta -= lr * m / (sqrt(v) + eps)
+  void (*adam_update)(size_t N, float* theta, const float* m, const float* v, float lr, float eps);
+  // one pass over param, grad, m and v, see AdamStep
+  void (*adam_step)(size_t N, float* param, const float* grad, float* m, float* v, const AdamStep& step);
+  // C += A * B, see glas::sgemm
+  void (*sgemm)(size_t M, size_t N, size_t K,
+      const float* a, int a_rs, int a_cs,
+      const float* b, int b_rs, int b_cs,
+      float* c, int c_rs, int c_cs);
+  // C = diag(a_scale) * A * B^T * diag(b_scale) for int8 A (M x K) and B (N x K),
+  // both with rows K apart. K must be a multiple of dot_width, products are summed in int32.
+  void (*qgemm)(size_t M, size_t N, size_t K,
+      const int8_t* a, const float* a_scale,
+      const int8_t* b, const float* b_scale,
+      float* c, long c_rs, long c_cs);
+  size_t dot_width; // int8 per step of qgemm
+};
+
+// The kernels in use, chosen on the first call.
+const Table& Get();
+bool Supported(Isa isa);
+// Switches every later kernel call to isa, throws if the CPU lacks it.
+void Select(Isa isa);
+
+// With fast math on, glas exp, log and inv use the approximate kernels.
+// Defaults to GOOCH_FAST_MATH=1 if set, otherwise off.
+void SetFastMath(bool fast);
+bool FastMath();
+
+}
+}
@@ -0,0 +1,422 @@
+// Elementwise kernels, written once against a vector type Vec and included by
+// kernels.cc inside one namespace per instruction set. Vec provides Reg,
+// kWidth, load, store, set1, zero, add, sub, mul, div, sqrt and fmadd, the
+// transcendental and reduction kernels also use the helpers below them.
+// No include guard: this file is meant to be included several times.
+
+template <typename Op>
+void binary_row(size_t N, const float* x, long x_stride, const float* y, long y_stride, float* out) {
+  constexpr size_t W = Vec::kWidth;
+  size_t simd_end = N - N % W;
+  if (x_stride == 1 && y_stride == 1) {
+    for (size_t i = 0; i < simd_end; i += W) {
+      Vec::store(out + i, Op::vec(Vec::load(x + i), Vec::load(y + i)));
+    }
+    for (size_t i = simd_end; i < N; i++) {
+      out[i] = Op::scalar(x[i], y[i]);
+    }
+  } else if (x_stride == 1 && y_stride == 0) {
+    const typename Vec::Reg y_vec = Vec::set1(*y);
+    const float y_value = *y;
+    for (size_t i = 0; i < simd_end; i += W) {
+      Vec::store(out + i, Op::vec(Vec::load(x + i), y_vec));
+    }
+    for (size_t i = simd_end; i < N; i++) {
+      out[i] = Op::scalar(x[i], y_value);
+    }
+  } else if (x_stride == 0 && y_stride == 1) {
+    const typename Vec::Reg x_vec = Vec::set1(*x);
+    const float x_value = *x;
+    for (size_t i = 0; i < simd_end; i += W) {
+      Vec::store(out + i, Op::vec(x_vec, Vec::load(y + i)));
+    }
+    for (size_t i = simd_end; i < N; i++) {
+      out[i] = Op::scalar(x_value, y[i]);
+    }
+  } else if (x_stride == 0 && y_stride == 0) {
+    std::fill(out, out + N, Op::scalar(*x, *y));
+  } else {
+    for (size_t i = 0; i < N; i++) {
+      out[i] = Op::scalar(x[i * x_stride], y[i * y_stride]);
+    }
+  }
+}
+
+// The tail goes through a padded register too, so every element gets exactly
+// the same arithmetic whatever its position.
+template <typename Op>
+void unary_row(size_t N, const float* x, float* out) {
+  constexpr size_t W = Vec::kWidth;
+  size_t simd_end = N - N % W;
+  for (size_t i = 0; i < simd_end; i += W) {
+    Vec::store(out + i, Op::vec(Vec::load(x + i)));
+  }
+  if (simd_end < N) {
+    float tail[W] = {};
+    std::copy(x + simd_end, x + N, tail);
+    Vec::store(tail, Op::vec(Vec::load(tail)));
+    std::copy(tail, tail + (N - simd_end), out + simd_end);
+  }
+}
+
+struct Add {
+  static typename Vec::Reg vec(typename Vec::Reg x, typename Vec::Reg y) { return Vec::add(x, y); }
+  static float scalar(float x, float y) { return x + y; }
+};
+
+struct Sub {
+  static typename Vec::Reg vec(typename Vec::Reg x, typename Vec::Reg y) { return Vec::sub(x, y); }
+  static float scalar(float x, float y) { return x - y; }
+};
+
+struct Mul {
+  static typename Vec::Reg vec(typename Vec::Reg x, typename Vec::Reg y) { return Vec::mul(x, y); }
+  static float scalar(float x, float y) { return x * y; }
+};
+
+struct Div {
+  static typename Vec::Reg vec(typename Vec::Reg x, typename Vec::Reg y) { return Vec::div(x, y); }
+  static float scalar(float x, float y) { return x / y; }
+};
+
+struct Neg {
+  static typename Vec::Reg vec(typename Vec::Reg x) { return Vec::sub(Vec::zero(), x); }
+};
+
+// Correctly rounded, the IEEE division.
+struct Inv {
+  static typename Vec::Reg vec(typename Vec::Reg x) { return Vec::div(Vec::set1(1.0f), x); }
+};
+
+// Correctly rounded, the IEEE square root.
+struct Root {
+  static typename Vec::Reg vec(typename Vec::Reg x) { return Vec::sqrt(x); }
+};
+
+// exp(x) = 2^n * exp(r) with n = round(x / ln 2) and |r| <= ln 2 / 2, the
+// reduction done in two parts of ln 2 and exp(r) by the Cephes expf
+// polynomial. At most 1 ulp from the correctly rounded result over the whole
+// finite range. Results below FLT_MIN flush to 0, x > 88.72 gives inf and NaN
+// stays NaN.
+struct Exp {
+  static typename Vec::Reg vec(typename Vec::Reg x) {
+    using R = typename Vec::Reg;
+    const R lo = Vec::set1(-87.33654f), hi = Vec::set1(88.72284f);
+    R clamped = Vec::min(hi, Vec::max(lo, x));
+    R n = Vec::round(Vec::mul(clamped, Vec::set1(1.44269504088896341f)));
+    R r = Vec::fmadd(n, Vec::set1(-0.693359375f), clamped);
+    r = Vec::fmadd(n, Vec::set1(2.12194440e-4f), r);
+    R p = Vec::set1(1.9875691500e-4f);
+    p = Vec::fmadd(p, r, Vec::set1(1.3981999507e-3f));
+    p = Vec::fmadd(p, r, Vec::set1(8.3334519073e-3f));
+    p = Vec::fmadd(p, r, Vec::set1(4.1665795894e-2f));
+    p = Vec::fmadd(p, r, Vec::set1(1.6666665459e-1f));
+    p = Vec::fmadd(p, r, Vec::set1(5.0000001201e-1f));
+    p = Vec::add(Vec::fmadd(p, Vec::mul(r, r), r), Vec::set1(1.0f));
+    return finish(x, p, n);
+  }
+
+  // p * 2^n, in two steps since n reaches 128 just below the overflow threshold
+  static typename Vec::Reg finish(typename Vec::Reg x, typename Vec::Reg p, typename Vec::Reg n) {
+    using R = typename Vec::Reg;
+    R n_low = Vec::min(n, Vec::set1(127.0f));
+    R result = Vec::mul(Vec::mul(p, Vec::pow2i(n_low)), Vec::pow2i(Vec::sub(n, n_low)));
+    result = Vec::select_less(Vec::set1(88.72284f), x, Vec::set1(HUGE_VALF), result);
+    return Vec::select_less(x, Vec::set1(-87.33654f), Vec::zero(), result);
+  }
+};
+
+// log(x) = e * ln 2 + log(m) with m in [sqrt(1/2), sqrt(2)), log(1 + f) by the
+// Cephes logf polynomial. At most 1 ulp from the correctly rounded result for
+// normal and subnormal x. log(0) = -inf, log(x < 0) = NaN, log(inf) = inf.
+struct Log {
+  static typename Vec::Reg vec(typename Vec::Reg x) {
+    using R = typename Vec::Reg;
+    R e, f;
+    reduce(x, &e, &f);
+    R z = Vec::mul(f, f);
+    R p = Vec::set1(7.0376836292e-2f);
+    p = Vec::fmadd(p, f, Vec::set1(-1.1514610310e-1f));
+    p = Vec::fmadd(p, f, Vec::set1(1.1676998740e-1f));
+    p = Vec::fmadd(p, f, Vec::set1(-1.2420140846e-1f));
+    p = Vec::fmadd(p, f, Vec::set1(1.4249322787e-1f));
+    p = Vec::fmadd(p, f, Vec::set1(-1.6668057665e-1f));
+    p = Vec::fmadd(p, f, Vec::set1(2.0000714765e-1f));
+    p = Vec::fmadd(p, f, Vec::set1(-2.4999993993e-1f));
+    p = Vec::fmadd(p, f, Vec::set1(3.3333331174e-1f));
+    R y = Vec::mul(Vec::mul(p, f), z);
+    y = Vec::fmadd(e, Vec::set1(-2.12194440e-4f), y);
+    y = Vec::fmadd(z, Vec::set1(-0.5f), y);
+    R result = Vec::fmadd(e, Vec::set1(0.693359375f), Vec::add(f, y));
+    return finish(x, result);
+  }
+
+  // splits x into e and f = m - 1, scaling subnormals up first
+  static void reduce(typename Vec::Reg x, typename Vec::Reg* e, typename Vec::Reg* f) {
+    using R = typename Vec::Reg;
+    R tiny = Vec::set1(1.17549435e-38f);
+    R scaled = Vec::select_less(x, tiny, Vec::mul(x, Vec::set1(8388608.0f)), x);
+    R m = Vec::significand(scaled);
+    *e = Vec::add(Vec::exponent(scaled), Vec::select_less(x, tiny, Vec::set1(-23.0f), Vec::zero()));
+    // move m from [sqrt(2), 2) down to [sqrt(1/2), 1)
+    R big = Vec::set1(1.41421356f);
+    *e = Vec::add(*e, Vec::select_less(big, m, Vec::set1(1.0f), Vec::zero()));
+    m = Vec::select_less(big, m, Vec::mul(m, Vec::set1(0.5f)), m);
+    *f = Vec::sub(m, Vec::set1(1.0f));
+  }
+
+  static typename Vec::Reg finish(typename Vec::Reg x, typename Vec::Reg result) {
+    result = Vec::select_less(x, Vec::set1(1.4e-45f), Vec::set1(-HUGE_VALF), result);
+    result = Vec::select_less(x, Vec::zero(), Vec::set1(NAN), result);
+    // inf and NaN return themselves
+    return Vec::select_less(x, Vec::set1(HUGE_VALF), result, x);
+  }
+};
+
+// The fast variants trade accuracy for fewer operations, for callers that opt
+// in with kernels::SetFastMath.
+
+// exp with a degree 4 Taylor polynomial, relative error below 6e-5.
+struct ExpFast {
+  static typename Vec::Reg vec(typename Vec::Reg x) {
+    using R = typename Vec::Reg;
+    R clamped = Vec::min(Vec::set1(88.72284f), Vec::max(Vec::set1(-87.33654f), x));
+    R n = Vec::round(Vec::mul(clamped, Vec::set1(1.44269504088896341f)));
+    R r = Vec::fmadd(n, Vec::set1(-0.693147181f), clamped);
+    R p = Vec::set1(1.0f / 24);
+    p = Vec::fmadd(p, r, Vec::set1(1.0f / 6));
+    p = Vec::fmadd(p, r, Vec::set1(0.5f));
+    p = Vec::fmadd(p, r, Vec::set1(1.0f));
+    p = Vec::fmadd(p, r, Vec::set1(1.0f));
+    return Exp::finish(x, p, n);
+  }
+};
+
+// log through 2 atanh((m - 1) / (m + 1)) to the cubic term, absolute error below 7e-5.
+struct LogFast {
+  static typename Vec::Reg vec(typename Vec::Reg x) {
+    using R = typename Vec::Reg;
+    R e, f;
+    Log::reduce(x, &e, &f);
+    R t = Vec::div(f, Vec::add(f, Vec::set1(2.0f)));
+    R two_t = Vec::add(t, t);
+    R result = Vec::fmadd(Vec::mul(two_t, Vec::mul(t, t)), Vec::set1(1.0f / 3), two_t);
+    return Log::finish(x, Vec::fmadd(e, Vec::set1(0.693147181f), result));
+  }
+};
+
+// 1 / x from the hardware estimate and one Newton step, within 3 ulp for
+// 2^-126 < |x| < 2^126. Zero, infinities and the edges of that range go wrong.
+struct InvFast {
+  static typename Vec::Reg vec(typename Vec::Reg x) {
+    typename Vec::Reg r = Vec::rcp(x);
+    return Vec::mul(r, Vec::sub(Vec::set1(2.0f), Vec::mul(x, r)));
+  }
+};
+
+struct Max {
+  static typename Vec::Reg vec(typename Vec::Reg x, typename Vec::Reg y) { return Vec::max(x, y); }
+  static float scalar(float x, float y) { return std::max(x, y); }
+  static float horizontal(typename Vec::Reg x) { return Vec::reduce_max(x); }
+  static constexpr float kIdentity = -HUGE_VALF;
+};
+
+struct Min {
+  static typename Vec::Reg vec(typename Vec::Reg x, typename Vec::Reg y) { return Vec::min(x, y); }
+  static float scalar(float x, float y) { return std::min(x, y); }
+  static float horizontal(typename Vec::Reg x) { return Vec::reduce_min(x); }
+  static constexpr float kIdentity = HUGE_VALF;
+};
+
+struct Sum {
+  static typename Vec::Reg vec(typename Vec::Reg x, typename Vec::Reg y) { return Vec::add(x, y); }
+  static float scalar(float x, float y) { return x + y; }
+  static float horizontal(typename Vec::Reg x) { return Vec::reduce_add(x); }
+  static constexpr float kIdentity = 0.0f;
+};
+
+// Folds x[0..N) with four independent accumulators, so consecutive vectors do
+// not wait on each other's latency.
+template <typename Op>
+float reduce_row(size_t N, const float* x) {
+  constexpr size_t W = Vec::kWidth;
+  typename Vec::Reg acc0 = Vec::set1(Op::kIdentity), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+  size_t i = 0;
+  for (; i + 4 * W <= N; i += 4 * W) {
+    acc0 = Op::vec(acc0, Vec::load(x + i));
+    acc1 = Op::vec(acc1, Vec::load(x + i + W));
+    acc2 = Op::vec(acc2, Vec::load(x + i + 2 * W));
+    acc3 = Op::vec(acc3, Vec::load(x + i + 3 * W));
+  }
+  for (; i + W <= N; i += W) {
+    acc0 = Op::vec(acc0, Vec::load(x + i));
+  }
+  float result = Op::horizontal(Op::vec(Op::vec(acc0, acc1), Op::vec(acc2, acc3)));
+  for (; i < N; i++) {
+    result = Op::scalar(result, x[i]);
+  }
+  return result;
+}
+
+// rows up to this long are summed directly, longer ones are split in two
+constexpr size_t kPairwiseBlock = 1024;
+
+float sum(size_t N, const float* x) {
+  if (N <= kPairwiseBlock) {
+    return reduce_row<Sum>(N, x);
+  }
+  size_t half = N / 2 - N / 2 % (4 * Vec::kWidth);
+  return sum(half, x) + sum(N - half, x + half);
+}
+
+float sum_exp(size_t N, const float* x, float shift) {
+  constexpr size_t W = Vec::kWidth;
+  size_t simd_end = N - N % W;
+  const typename Vec::Reg shift_vec = Vec::set1(shift);
+  typename Vec::Reg acc = Vec::zero();
+  for (size_t i = 0; i < simd_end; i += W) {
+    acc = Vec::add(acc, Exp::vec(Vec::sub(Vec::load(x + i), shift_vec)));
+  }
+  if (simd_end < N) {
+    // padding with -inf adds exp(-inf) = 0
+    float tail[W];
+    std::fill(tail, tail + W, -HUGE_VALF);
+    std::copy(x + simd_end, x + N, tail);
+    acc = Vec::add(acc, Exp::vec(Vec::sub(Vec::load(tail), shift_vec)));
+  }
+  return Vec::reduce_add(acc);
+}
+
+void scaled_exp(size_t N, const float* x, float shift, float scale, float bias, float* out) {
+  constexpr size_t W = Vec::kWidth;
+  size_t simd_end = N - N % W;
+  const typename Vec::Reg shift_vec = Vec::set1(shift), scale_vec = Vec::set1(scale), bias_vec = Vec::set1(bias);
+  auto apply = [&] (typename Vec::Reg v) { return Vec::fmadd(scale_vec, Exp::vec(Vec::sub(v, shift_vec)), bias_vec); };
+  for (size_t i = 0; i < simd_end; i += W) {
+    Vec::store(out + i, apply(Vec::load(x + i)));
+  }
+  if (simd_end < N) {
+    float tail[W] = {};
+    std::copy(x + simd_end, x + N, tail);
+    Vec::store(tail, apply(Vec::load(tail)));
+    std::copy(tail, tail + (N - simd_end), out + simd_end);
+  }
+}
+
+struct BFloat16 {
+  static typename Vec::Reg load(const uint16_t* p) { return Vec::load_bf16(p); }
+  static void store(uint16_t* p, typename Vec::Reg v) { Vec::store_bf16(p, v); }
+  static float widen(uint16_t x) { return bf16_to_float(x); }
+  static uint16_t narrow(float x) { return float_to_bf16(x); }
+};
+
+struct Float16 {
+  static typename Vec::Reg load(const uint16_t* p) { return Vec::load_fp16(p); }
+  static void store(uint16_t* p, typename Vec::Reg v) { Vec::store_fp16(p, v); }
+  static float widen(uint16_t x) { return fp16_to_float(x); }
+  static uint16_t narrow(float x) { return float_to_fp16(x); }
+};
+
+template <typename Format>
+void widen_row(size_t N, const uint16_t* x, float* out) {
+  constexpr size_t W = Vec::kWidth;
+  size_t simd_end = N - N % W;
+  for (size_t i = 0; i < simd_end; i += W) {
+    Vec::store(out + i, Format::load(x + i));
+  }
+  for (size_t i = simd_end; i < N; i++) {
+    out[i] = Format::widen(x[i]);
+  }
+}
+
+template <typename Format>
+void narrow_row(size_t N, const float* x, uint16_t* out) {
+  constexpr size_t W = Vec::kWidth;
+  size_t simd_end = N - N % W;
+  for (size_t i = 0; i < simd_end; i += W) {
+    Format::store(out + i, Vec::load(x + i));
+  }
+  for (size_t i = simd_end; i < N; i++) {
+    out[i] = Format::narrow(x[i]);
+  }
+}
+
+void axpy(size_t N, float a, const float* x, float* y) {
+  constexpr size_t W = Vec::kWidth;
+  const typename Vec::Reg a_vec = Vec::set1(a);
+  size_t simd_end = N - N % W;
+  for (size_t i = 0; i < simd_end; i += W) {
+    Vec::store(y + i, Vec::fmadd(a_vec, Vec::load(x + i), Vec::load(y + i)));
+  }
+  for (size_t i = simd_end; i < N; i++) {
+    y[i] += a * x[i];
+  }
+}
+
+void scale(size_t N, float a, float* y) {
+  constexpr size_t W = Vec::kWidth;
+  const typename Vec::Reg a_vec = Vec::set1(a);
+  size_t simd_end = N - N % W;
+  for (size_t i = 0; i < simd_end; i += W) {
+    Vec::store(y + i, Vec::mul(a_vec, Vec::load(y + i)));
+  }
+  for (size_t i = simd_end; i < N; i++) {
+    y[i] *= a;
+  }
+}
+
+void add_square_scaled(size_t N, float a, const float* x, float* y) {
+  constexpr size_t W = Vec::kWidth;
+  const typename Vec::Reg a_vec = Vec::set1(a);
+  size_t simd_end = N - N % W;
+  for (size_t i = 0; i < simd_end; i += W) {
+    typename Vec::Reg x_vec = Vec::load(x + i);
+    Vec::store(y + i, Vec::fmadd(Vec::mul(a_vec, x_vec), x_vec, Vec::load(y + i)));
+  }
+  for (size_t i = simd_end; i < N; i++) {
+    y[i] += x[i] * x[i] * a;
+  }
+}
+
+void adam_update(size_t N, float* theta, const float* m, const float* v, float lr, float eps) {
+  constexpr size_t W = Vec::kWidth;
+  const typename Vec::Reg lr_vec = Vec::set1(lr);
+  const typename Vec::Reg eps_vec = Vec::set1(eps);
+  size_t simd_end = N - N % W;
+  for (size_t i = 0; i < simd_end; i += W) {
+    typename Vec::Reg denom = Vec::add(Vec::sqrt(Vec::load(v + i)), eps_vec);
+    typename Vec::Reg update = Vec::mul(lr_vec, Vec::div(Vec::load(m + i), denom));
+    Vec::store(theta + i, Vec::sub(Vec::load(theta + i), update));
+  }
+  for (size_t i = simd_end; i < N; i++) {
+    theta[i] -= lr * (m[i] / (std::sqrt(v[i]) + eps));
+  }
+}
+
+// Each element is loaded and stored once. The arithmetic is the same as the
+// separate scale, axpy, add_square_scaled and adam_update passes.
+void adam_step(size_t N, float* param, const float* grad, float* m, float* v, const AdamStep& step) {
+  constexpr size_t W = Vec::kWidth;
+  const typename Vec::Reg beta1 = Vec::set1(step.beta1), one_minus_beta1 = Vec::set1(1.0f - step.beta1);
+  const typename Vec::Reg beta2 = Vec::set1(step.beta2), one_minus_beta2 = Vec::set1(1.0f - step.beta2);
+  const typename Vec::Reg step_size = Vec::set1(step.step_size), v_scale = Vec::set1(step.v_scale);
+  const typename Vec::Reg eps = Vec::set1(step.eps), decay = Vec::set1(step.decay);
+  size_t simd_end = N - N % W;
+  for (size_t i = 0; i < simd_end; i += W) {
+    typename Vec::Reg g = Vec::load(grad + i);
+    typename Vec::Reg m_new = Vec::fmadd(one_minus_beta1, g, Vec::mul(beta1, Vec::load(m + i)));
+    typename Vec::Reg v_new = Vec::fmadd(Vec::mul(one_minus_beta2, g), g, Vec::mul(beta2, Vec::load(v + i)));
+    typename Vec::Reg denom = Vec::fmadd(Vec::sqrt(v_new), v_scale, eps);
+    typename Vec::Reg update = Vec::mul(step_size, Vec::div(m_new, denom));
+    Vec::store(m + i, m_new);
+    Vec::store(v + i, v_new);
+    Vec::store(param + i, Vec::sub(Vec::mul(decay, Vec::load(param + i)), update));
+  }
+  for (size_t i = simd_end; i < N; i++) {
+    m[i] *= step.beta1;
+    m[i] += (1.0f - step.beta1) * grad[i];
+    v[i] *= step.beta2;
+    v[i] += grad[i] * grad[i] * (1.0f - step.beta2);
+    param[i] = step.decay * param[i] - step.step_size * (m[i] / (std::sqrt(v[i]) * step.v_scale + step.eps));
+  }
+}
@@ -0,0 +1,214 @@
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gooch {
+namespace parallel {
+
+namespace {
+// the state of one parallel_for call, it lives on the caller's stack
+struct Job {
+  const std::function<void(size_t, size_t)>* f;
+  size_t remaining;
+  std::mutex mutex;
+  std::condition_variable done;
+  std::exception_ptr error;
+};
+
+struct Task {
+  Job* job;
+  size_t begin;
+  size_t end;
+};
+
+thread_local bool in_parallel = false;
+
+void RunTask(const Task& task) {
+  bool was_parallel = in_parallel;
+  in_parallel = true;
+  std::exception_ptr error;
+  try {
+    (*task.job->f)(task.begin, task.end);
+  } catch (...) {
+    error = std::current_exception();
+  }
+  in_parallel = was_parallel;
+  std::lock_guard<std::mutex> lock(task.job->mutex);
+  if (error && !task.job->error) task.job->error = error;
+  if (--task.job->remaining == 0) task.job->done.notify_all();
+}
+
+// Every worker owns a deque. It pops its own work from the back and, once that
+// runs dry, steals from the front of the others.
+class ThreadPool {
+public:
+  explicit ThreadPool(size_t num_workers) {
+    for (size_t i = 0; i < num_workers; ++i) {
+      queues_.push_back(std::make_unique<Queue>());
+    }
+    for (size_t i = 0; i < num_workers; ++i) {
+      threads_.emplace_back([this, i] { WorkerLoop(i); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto& thread : threads_) {
+      thread.join();
+    }
+  }
+
+  void Submit(const std::vector<Task>& tasks) {
+    for (size_t i = 0; i < tasks.size(); ++i) {
+      Queue& queue = *queues_[i % queues_.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(tasks[i]);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      queued_ += tasks.size();
+    }
+    wake_.notify_all();
+  }
+
+  size_t num_workers() const { return threads_.size(); }
+
+  // runs one task, preferring the home queue, returns false if there was none
+  bool TryRun(size_t home) {
+    Task task{nullptr, 0, 0};
+    for (size_t i = 0; i < queues_.size(); ++i) {
+      Queue& queue = *queues_[(home + i) % queues_.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      if (queue.tasks.empty()) continue;
+      if (i == 0) {
+        task = queue.tasks.back();
+        queue.tasks.pop_back();
+      } else {
+        task = queue.tasks.front();
+        queue.tasks.pop_front();
+      }
+      {
+        std::lock_guard<std::mutex> queued_lock(mutex_);
+        --queued_;
+      }
+      RunTask(task);
+      return true;
+    }
+    return false;
+  }
+
+private:
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  void WorkerLoop(size_t index) {
+    while (true) {
+      if (TryRun(index)) continue;
+      std::unique_lock<std::mutex> lock(mutex_);
+      wake_.wait(lock, [this] { return stop_ || queued_ > 0; });
+      if (stop_ && queued_ == 0) return;
+    }
+  }
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable wake_;
+  size_t queued_ = 0;
+  bool stop_ = false;
+};
+
+size_t DefaultNumThreads() {
+  if (const char* env = std::getenv("GOOCH_NUM_THREADS")) {
+    int num_threads = std::atoi(env);
+    if (num_threads > 0) return num_threads;
+  }
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+std::mutex pool_mutex;
+std::atomic<size_t> num_threads{0};
+std::shared_ptr<ThreadPool> pool;
+
+// The pool has one worker less than there are threads, the caller is the last
+// one. Callers hold a reference for as long as their job runs, so a pool
+// replaced by SetNumThreads is only joined once the last job using it is done,
+// and always by a caller, never by one of its own workers.
+std::shared_ptr<ThreadPool> GetPool() {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  if (num_threads == 0) num_threads = DefaultNumThreads();
+  if (!pool) pool = std::make_shared<ThreadPool>(num_threads - 1);
+  return pool;
+}
+}
+
+void SetNumThreads(size_t threads) {
+  std::shared_ptr<ThreadPool> old_pool;
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  num_threads = std::max<size_t>(threads, 1);
+  old_pool = std::move(pool);
+}
+
+size_t GetNumThreads() {
+  size_t threads = num_threads.load();
+  if (threads != 0) return threads;
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  if (num_threads == 0) num_threads = DefaultNumThreads();
+  return num_threads;
+}
+
+void parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& f) {
+  if (end <= begin) return;
+  size_t n = end - begin;
+  grain = std::max<size_t>(grain, 1);
+  if (in_parallel || n < 2 * grain) {
+    f(begin, end);
+    return;
+  }
+  // the thread count comes from the pool itself, a concurrent SetNumThreads
+  // cannot make it disagree with the pool the tasks are submitted to
+  std::shared_ptr<ThreadPool> thread_pool = GetPool();
+  size_t threads = thread_pool->num_workers() + 1;
+  if (threads <= 1) {
+    f(begin, end);
+    return;
+  }
+  // a few chunks per thread so that stealing can even out the imbalance
+  size_t num_chunks = std::min(n / grain, threads * 4);
+  size_t chunk = (n + num_chunks - 1) / num_chunks;
+  Job job;
+  job.f = &f;
+  std::vector<Task> tasks;
+  for (size_t i = begin; i < end; i += chunk) {
+    tasks.push_back(Task{&job, i, std::min(i + chunk, end)});
+  }
+  job.remaining = tasks.size();
+
+  thread_pool->Submit(tasks);
+  while (thread_pool->TryRun(0)) {
+    std::lock_guard<std::mutex> lock(job.mutex);
+    if (job.remaining == 0) break;
+  }
+  std::unique_lock<std::mutex> lock(job.mutex);
+  job.done.wait(lock, [&job] { return job.remaining == 0; });
+  if (job.error) std::rethrow_exception(job.error);
+}
+
+}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+namespace gooch {
+namespace parallel {
+
+// Below this many elements an elementwise kernel is not worth splitting.
+constexpr size_t kGrainSize = 1 << 15;
+
+// Sets the number of threads used by parallel_for, including the calling thread.
+// Defaults to GOOCH_NUM_THREADS if set, otherwise the number of hardware threads.
+// Safe to call while other threads are inside parallel_for, their jobs finish on
+// the pool they started with.
+void SetNumThreads(size_t num_threads);
+size_t GetNumThreads();
+
+// Calls f(chunk_begin, chunk_end) on disjoint chunks covering [begin, end), spread
+// over a process-wide work-stealing pool, and returns once all of them ran.
+// Chunks are at least grain long, so ranges shorter than two grains run serially
+// on the caller, as do calls made from inside another parallel_for.
+void parallel_for(size_t begin, size_t end, size_t grain, const std::function<void(size_t, size_t)>& f);
+
+}
+}
@@ -0,0 +1,93 @@
+#include "parameters.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+
+namespace gooch {
+
+namespace {
+constexpr size_t kSlotAlignment = allocator::kAlignment / sizeof(float);
+
+size_t num_elements(const std::vector<size_t>& shape) {
+  return std::accumulate(shape.begin(), shape.end(), (size_t) 1, std::multiplies<size_t>());
+}
+
+// a slice of an arena that keeps the whole arena alive
+std::shared_ptr<float> slice(const std::shared_ptr<float>& arena, size_t offset) {
+  return std::shared_ptr<float>(arena, arena.get() + offset);
+}
+}
+
+ParameterGroup::ParameterGroup(const std::vector<Tensor*>& params) : params_(params), size_(0), flat_(std::vector<size_t>{0}) {
+  for (Tensor* p : params_) {
+    offsets_.push_back(size_);
+    size_t n = num_elements(p->shape());
+    size_ += (n + kSlotAlignment - 1) / kSlotAlignment * kSlotAlignment;
+  }
+  data_ = allocator::Allocate(size_);
+  grad_ = allocator::Allocate(size_);
+  std::fill(data_.get(), data_.get() + size_, 0.0f);
+  std::fill(grad_.get(), grad_.get() + size_, 0.0f);
+  for (size_t i = 0; i < params_.size(); ++i) {
+    Tensor& p = *params_[i];
+    std::vector<size_t> shape = p.shape();
+    utils::BufferCopy(p, data_.get() + offsets_[i]);
+    p = Tensor(shape, utils::compute_strides(shape), 0, slice(data_, offsets_[i]));
+    *p.grad_ = slice(grad_, offsets_[i]);
+  }
+  flat_ = Tensor({size_}, {1}, 0, data_);
+  *flat_.grad_ = grad_;
+}
+
+size_t ParameterGroup::size() const {
+  return size_;
+}
+
+const std::vector<Tensor*>& ParameterGroup::params() const {
+  return params_;
+}
+
+Tensor ParameterGroup::flat() const {
+  return flat_;
+}
+
+Tensor ParameterGroup::AddState() {
+  Tensor state = zeros({size_});
+  states_.push_back(state);
+  return state;
+}
+
+void ParameterGroup::ZeroGrad() {
+  std::memset(grad_.get(), 0, size_ * sizeof(float));
+}
+
+void ParameterGroup::Save(std::ostream& out) const {
+  uint64_t header[2] = {size_, states_.size()};
+  out.write(reinterpret_cast<const char*>(header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(data_.get()), size_ * sizeof(float));
+  for (const Tensor& state : states_) {
+    out.write(reinterpret_cast<const char*>(state.data().get()), size_ * sizeof(float));
+  }
+}
+
+void ParameterGroup::Load(std::istream& in) {
+  uint64_t header[2];
+  in.read(reinterpret_cast<char*>(header), sizeof(header));
+  if (!in || header[0] != size_ || header[1] != states_.size()) {
+    throw std::invalid_argument("Checkpoint does not match the parameter group");
+  }
+  in.read(reinterpret_cast<char*>(data_.get()), size_ * sizeof(float));
+  for (const Tensor& state : states_) {
+    in.read(reinterpret_cast<char*>(state.data().get()), size_ * sizeof(float));
+  }
+  if (!in) {
+    throw std::invalid_argument("Checkpoint is truncated");
+  }
+}
+
+}
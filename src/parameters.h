@@ -0,0 +1,53 @@
+#pragma once
+
+#include "tensor.h"
+
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+// Contiguous storage for the parameters of a model.
+// A ParameterGroup moves the values of its parameters into one data arena and
+// gives them one gradient arena, rebinding every tensor to its own slice of
+// each. Slices are padded to allocator::kAlignment, so each parameter starts
+// aligned. Zeroing the gradients is then a single memset, an optimizer built on
+// flat() takes one streaming pass over all parameters, and a checkpoint is one
+// block write per arena.
+namespace gooch {
+
+class ParameterGroup {
+public:
+  // The tensors are rebound in place. Copies made before the group was created
+  // keep their old storage.
+  explicit ParameterGroup(const std::vector<Tensor*>& params);
+  ParameterGroup(const ParameterGroup&) = delete;
+  ParameterGroup& operator=(const ParameterGroup&) = delete;
+
+  // floats in each arena, padding included
+  size_t size() const;
+  const std::vector<Tensor*>& params() const;
+  // The whole data arena as one 1d tensor, its gradient is the gradient arena.
+  Tensor flat() const;
+  // A zeroed arena laid out like the parameters, e.g. for optimizer moments.
+  // It is saved and loaded with the group.
+  Tensor AddState();
+
+  // Zeroes the whole gradient arena in one memset.
+  void ZeroGrad();
+
+  // The data arena followed by every state arena, as raw floats after a size header.
+  void Save(std::ostream& out) const;
+  // Reads what Save wrote, throws std::invalid_argument if the layout differs.
+  void Load(std::istream& in);
+
+private:
+  std::vector<Tensor*> params_;
+  std::vector<size_t> offsets_;
+  size_t size_;
+  std::shared_ptr<float> data_;
+  std::shared_ptr<float> grad_;
+  Tensor flat_;
+  std::vector<Tensor> states_;
+};
+
+}
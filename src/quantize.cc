@@ -0,0 +1,180 @@
+#include "quantize.h"
+#include "glas.h"
+#include "kernels.h"
+#include "parallel.h"
+#include "graph.h"
+#include "allocator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+namespace gooch {
+namespace quantize {
+
+namespace {
+size_t padded(size_t n) {
+  return (n + kRowAlignment - 1) / kRowAlignment * kRowAlignment;
+}
+
+std::shared_ptr<int8_t> allocate_rows(size_t rows, size_t row_stride) {
+  std::shared_ptr<int8_t> data(new int8_t[std::max<size_t>(1, rows * row_stride)], std::default_delete<int8_t[]>());
+  std::memset(data.get(), 0, rows * row_stride);
+  return data;
+}
+}
+
+float QuantizeRow(size_t n, const float* x, int8_t* out) {
+  const kernels::Table& k = kernels::Get();
+  float max_abs = n == 0 ? 0.0f : std::max(k.max(n, x), -k.min(n, x));
+  if (max_abs == 0.0f) {
+    std::fill(out, out + n, 0);
+    return 0.0f;
+  }
+  float scale = max_abs / 127.0f;
+  float inv_scale = 127.0f / max_abs;
+  for (size_t i = 0; i < n; ++i) {
+    out[i] = (int8_t) std::clamp(std::nearbyint(x[i] * inv_scale), -127.0f, 127.0f);
+  }
+  return scale;
+}
+
+QuantizedTensor QuantizeWeights(const Tensor& w, size_t channel_axis) {
+  std::vector<size_t> shape = w.shape();
+  if (shape.size() != 2 || channel_axis > 1) {
+    throw std::invalid_argument("QuantizeWeights expects a 2d tensor and a channel axis of 0 or 1");
+  }
+  std::vector<int> strides = w.strides();
+  QuantizedTensor q;
+  q.shape = shape;
+  q.channel_axis = channel_axis;
+  q.channels = shape[channel_axis];
+  q.cols = shape[1 - channel_axis];
+  q.row_stride = padded(q.cols);
+  q.data = allocate_rows(q.channels, q.row_stride);
+  q.scales.resize(q.channels);
+  const float* w_data = w.data().get() + w.offset();
+  int channel_stride = strides[channel_axis], col_stride = strides[1 - channel_axis];
+  std::vector<float> row(q.cols);
+  for (size_t c = 0; c < q.channels; ++c) {
+    for (size_t i = 0; i < q.cols; ++i) {
+      row[i] = w_data[(ptrdiff_t) c * channel_stride + (ptrdiff_t) i * col_stride];
+    }
+    q.scales[c] = QuantizeRow(q.cols, row.data(), q.data.get() + c * q.row_stride);
+  }
+  return q;
+}
+
+Tensor Dequantize(const QuantizedTensor& w) {
+  std::shared_ptr<float> buffer = allocator::Allocate(w.channels * w.cols);
+  // channel-major, then transposed back to the original layout by the view's strides
+  for (size_t c = 0; c < w.channels; ++c) {
+    const int8_t* row = w.data.get() + c * w.row_stride;
+    for (size_t i = 0; i < w.cols; ++i) {
+      buffer.get()[c * w.cols + i] = row[i] * w.scales[c];
+    }
+  }
+  std::vector<int> strides(2);
+  strides[w.channel_axis] = (int) w.cols;
+  strides[1 - w.channel_axis] = 1;
+  return Tensor(w.shape, strides, 0, buffer);
+}
+
+Tensor Einsum(const Tensor& a, const QuantizedTensor& w, const std::string& equation) {
+  // the int8 rows are planned as a float operand with the same layout, the
+  // contracted label then advances w by 1 and the channel label by row_stride
+  std::vector<int> w_strides(2);
+  w_strides[w.channel_axis] = (int) w.row_stride;
+  w_strides[1 - w.channel_axis] = 1;
+  std::shared_ptr<const glas::EinsumPlan> plan = glas::parse_einsum(equation).plan(a.shape(), a.strides(), w.shape, w_strides);
+
+  // every other label must be a row of a that is kept in the output
+  std::vector<glas::EinsumLoop> rows;
+  int a_k = 0, c_n = 0;
+  bool fits = false;
+  if (plan->gemm) {
+    fits = plan->b_rs == 1 && plan->b_cs == (int) w.row_stride && plan->N == w.channels && plan->K == w.cols;
+    rows = plan->loops;
+    rows.push_back(glas::EinsumLoop{plan->M, plan->a_rs, 0, plan->c_rs});
+    a_k = plan->a_cs;
+    c_n = plan->c_cs;
+  } else {
+    bool has_k = false, has_n = false;
+    for (const glas::EinsumLoop& loop : plan->loops) {
+      if (loop.b_stride == 1 && loop.c_stride == 0 && loop.size == w.cols) {
+        has_k = true;
+        a_k = loop.a_stride;
+      } else if (loop.b_stride == (int) w.row_stride && loop.a_stride == 0 && loop.size == w.channels) {
+        has_n = true;
+        c_n = loop.c_stride;
+      } else {
+        rows.push_back(loop);
+      }
+    }
+    fits = has_k && has_n;
+  }
+  for (const glas::EinsumLoop& row : rows) {
+    fits = fits && row.b_stride == 0 && (row.c_stride != 0 || row.size == 1);
+  }
+  if (!fits) {
+    throw std::invalid_argument("quantize::Einsum needs a matrix product over the non-channel axis of the weights: " + equation);
+  }
+
+  // inference only, a replay has nothing to refresh it with
+  graph::Unsupported();
+  std::shared_ptr<float> c_buffer = allocator::Allocate(plan->c_size);
+  Tensor c(plan->c_shape, plan->c_strides, 0, c_buffer);
+  c.SetRequiresGrad(false);
+  if (plan->c_size == 0) return c;
+  // the row label innermost in the output is the kernel's M, the others are looped over
+  glas::EinsumLoop m{1, 0, 0, 0};
+  auto inner = std::min_element(rows.begin(), rows.end(), [] (const glas::EinsumLoop& x, const glas::EinsumLoop& y) {
+    return std::abs(x.c_stride) < std::abs(y.c_stride);
+  });
+  if (inner != rows.end()) {
+    m = *inner;
+    rows.erase(inner);
+  }
+  const float* a_data = a.data().get() + a.offset();
+  float* c_data = c_buffer.get();
+  const kernels::Table& k = kernels::Get();
+  size_t K = w.cols, N = w.channels;
+  size_t grain = std::max<size_t>(1, parallel::kGrainSize / std::max<size_t>(1, N * K));
+
+  std::vector<size_t> index(rows.size(), 0);
+  ptrdiff_t a_offset = 0, c_offset = 0;
+  while (true) {
+    const float* a_block = a_data + a_offset;
+    float* c_block = c_data + c_offset;
+    parallel::parallel_for(0, m.size, grain, [&] (size_t begin, size_t end) {
+      size_t count = end - begin;
+      std::unique_ptr<int8_t[]> a_q(new int8_t[count * w.row_stride]());
+      std::vector<float> a_scale(count), row(K);
+      for (size_t i = 0; i < count; ++i) {
+        const float* x = a_block + (ptrdiff_t) (begin + i) * m.a_stride;
+        for (size_t p = 0; p < K; ++p) row[p] = x[(ptrdiff_t) p * a_k];
+        a_scale[i] = QuantizeRow(K, row.data(), a_q.get() + i * w.row_stride);
+      }
+      k.qgemm(count, N, w.row_stride, a_q.get(), a_scale.data(), w.data.get(), w.scales.data(),
+          c_block + (ptrdiff_t) begin * m.c_stride, m.c_stride, c_n);
+    });
+    // advance the remaining rows like an odometer, innermost last
+    size_t d = rows.size();
+    while (d > 0) {
+      const glas::EinsumLoop& loop = rows[d - 1];
+      a_offset += loop.a_stride;
+      c_offset += loop.c_stride;
+      if (++index[d - 1] < loop.size) break;
+      a_offset -= (ptrdiff_t) loop.size * loop.a_stride;
+      c_offset -= (ptrdiff_t) loop.size * loop.c_stride;
+      index[d - 1] = 0;
+      --d;
+    }
+    if (d == 0) break;
+  }
+  return c;
+}
+
+}
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "tensor.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Int8 inference for matrix-multiply shaped einsums.
+// Weights are quantized once, symmetrically per output channel: each channel
+// gets the scale max|w| / 127 and its values are rounded to int8, a quarter of
+// their float32 size. Activations are quantized per row as they arrive, the
+// product is summed exactly in int32 and scaled back to float32 as it is
+// stored. Results have no gradient, this is for inference-only graphs.
+namespace gooch {
+namespace quantize {
+
+// int8 rows are padded with zeros to a multiple of this, which every kernel's dot width divides
+constexpr size_t kRowAlignment = 32;
+
+// A 2d weight tensor stored as int8, one row of `cols` values per output channel
+// with the scale of that channel.
+struct QuantizedTensor {
+  std::vector<size_t> shape;
+  size_t channel_axis;
+  size_t channels;
+  size_t cols;
+  size_t row_stride; // cols rounded up to kRowAlignment
+  std::shared_ptr<int8_t> data;
+  std::vector<float> scales;
+};
+
+// Quantizes w with one scale per index of channel_axis, which is the axis
+// the einsum keeps in its output (e.g. hidden_dim of "hidden_dim input_dim").
+// Throws std::invalid_argument unless w is 2d and channel_axis is 0 or 1.
+QuantizedTensor QuantizeWeights(const Tensor& w, size_t channel_axis);
+// The float32 tensor the quantized weights stand for.
+Tensor Dequantize(const QuantizedTensor& w);
+// Quantizes n values with the scale max|x| / 127 into out and returns the scale.
+float QuantizeRow(size_t n, const float* x, int8_t* out);
+
+// einsum(a, w, equation) through the int8 kernel, a is quantized per row of the product.
+// Throws std::invalid_argument if the equation does not contract a against the
+// non-channel axis of w and keep the channel axis, or if it has w in a batch label.
+Tensor Einsum(const Tensor& a, const QuantizedTensor& w, const std::string& equation);
+
+}
+}
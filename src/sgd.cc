@@ -2,12 +2,24 @@
 
 #include "tensor.h"
 #include "glas.h"
+#include "parameters.h"
 #include <vector>
 #include <algorithm>
 #include <cstddef>
+#include <cmath>
+#include <stdexcept>
 
 namespace gooch {
 
+// The optimizers update parameters through data(), which is a widened copy for
+// reduced precision tensors. Parameters stay float32 master weights and forward
+// casts them to the compute type.
+inline void check_master_weights(const Tensor& p) {
+    if (p.dtype() != DType::kFloat32) {
+        throw std::invalid_argument("Optimizers need float32 parameters, cast them in forward instead");
+    }
+}
+
 struct SGD {
     std::vector<Tensor> params;
     float lr; // learning rate
@@ -24,11 +36,17 @@ struct SGD {
         // Initialize momentums
         vel.reserve(params.size());
         for (const auto& p : params) {
+            check_master_weights(p);
             vel.push_back( zeros(p.shape()) );
             vel_sq.push_back( zeros(p.shape()) );
         }
       }
 
+    // Steps the whole group as one flat tensor, the moments live in its state arenas
+    SGD(ParameterGroup& group, float learning_rate, float momentum = 0.9f, float momentum_beta = 0.99f)
+      : params{group.flat()}, lr(learning_rate), mu(momentum), beta(momentum_beta), epsilon(1e-8f),
+        vel{group.AddState()}, vel_sq{group.AddState()} {}
+
     // // Clear gradients on all parameters
     // void zero_grad() {
     //     for (auto& p : params) {
@@ -38,47 +56,65 @@ struct SGD {
     //     }
     // }
 
-    // Perform one SGD update: θ <- θ - lr * grad
+    // Perform one SGD update: θ <- θ - lr * m / (sqrt(v) + eps), with running
+    // averages m and v of the gradient and its square, in one fused pass
     void step() {
+        std::vector<glas::AdamTensor> tensors;
+        tensors.reserve(params.size());
         for (size_t idx = 0; idx < params.size(); ++idx) {
             Tensor& p = params[idx];
-            Tensor& v = vel[idx];
-            Tensor& vsq = vel_sq[idx];
-
             p.TouchGrad();
+            tensors.push_back({p.size(), p.data().get(), p.grad_data().get(), vel[idx].data().get(), vel_sq[idx].data().get()});
+        }
+        glas::adam_step(tensors, {mu, beta, lr, 1.0f, epsilon, 1.0f});
+    }
+};
 
-            size_t N = p.size();
-            float* data = p.data().get();
-            float* grad = p.grad_data().get();
-            float* v_ptr = v.data().get();
-            float* sq_ptr = vsq.data().get();
-
-            // first moment (momentum) update
-            glas::mul_cons_simd(N, v_ptr, mu);
-            glas::axpy(N, (1.0f - mu), grad, v_ptr);
-
-            // Tensor prod = glas::mul_simd(N, sq_ptr, sq_ptr);
-
-            glas::mul_cons_simd(N, sq_ptr, beta);
-            // glas::inplace_add_square_const(N, (1.0f - beta), grad, sq_ptr);
-            glas::inplace_add_square_const(N, (1.0f - beta), grad, sq_ptr);
-
-
+// Adam with bias correction. A nonzero weight decay is decoupled from the
+// gradient (AdamW): θ <- θ - lr * weight_decay * θ before the Adam update.
+// Every parameter is updated in one multi-tensor launch that reads θ, its
+// gradient and both moments once.
+struct Adam {
+    std::vector<Tensor> params;
+    float lr;
+    const float beta1;
+    const float beta2;
+    const float epsilon;
+    const float weight_decay;
+    size_t t; // steps taken so far
 
-            // // second moment update
-            // for (size_t i = 0; i < N; ++i) {
-            //     float gval = grad[i];
-            //     sq_ptr[i] = beta * sq_ptr[i] + (1.0f - beta) * gval * gval;
-            // }
+    std::vector<Tensor> m;
+    std::vector<Tensor> v;
 
-            // parameter update
-            // for (size_t i = 0; i < N; ++i) {
-            //     data[i] -= lr * (v_ptr[i] / (std::sqrt(sq_ptr[i]) + epsilon));
-            // }
-            glas::adam_update(N, data, v_ptr, sq_ptr, lr, epsilon);
+    Adam(const std::vector<Tensor>& parameters, float learning_rate, float beta1 = 0.9f, float beta2 = 0.999f, float eps = 1e-8f, float weight_decay = 0.0f)
+      : params(parameters), lr(learning_rate), beta1(beta1), beta2(beta2), epsilon(eps), weight_decay(weight_decay), t(0) {
+        m.reserve(params.size());
+        v.reserve(params.size());
+        for (const auto& p : params) {
+            check_master_weights(p);
+            m.push_back( zeros(p.shape()) );
+            v.push_back( zeros(p.shape()) );
+        }
+      }
 
+    // Steps the whole group as one flat tensor, the moments live in its state arenas
+    Adam(ParameterGroup& group, float learning_rate, float beta1 = 0.9f, float beta2 = 0.999f, float eps = 1e-8f, float weight_decay = 0.0f)
+      : params{group.flat()}, lr(learning_rate), beta1(beta1), beta2(beta2), epsilon(eps), weight_decay(weight_decay), t(0),
+        m{group.AddState()}, v{group.AddState()} {}
 
+    void step() {
+        ++t;
+        std::vector<glas::AdamTensor> tensors;
+        tensors.reserve(params.size());
+        for (size_t idx = 0; idx < params.size(); ++idx) {
+            Tensor& p = params[idx];
+            p.TouchGrad();
+            tensors.push_back({p.size(), p.data().get(), p.grad_data().get(), m[idx].data().get(), v[idx].data().get()});
         }
+        // m_hat = m / (1 - beta1^t) and v_hat = v / (1 - beta2^t), folded into the step scalars
+        float correction1 = 1.0f - std::pow(beta1, (float) t);
+        float correction2 = 1.0f - std::pow(beta2, (float) t);
+        glas::adam_step(tensors, {beta1, beta2, lr / correction1, 1.0f / std::sqrt(correction2), epsilon, 1.0f - lr * weight_decay});
     }
 };
 
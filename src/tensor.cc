@@ -1,6 +1,10 @@
 #include "tensor.h"
 #include "glas.h"
 #include "utils.h"
+#include "fusion.h"
+#include "graph.h"
+#include "kernels.h"
+#include "parallel.h"
 
 #include <vector>
 #include <memory>
@@ -8,30 +12,33 @@
 #include <numeric>
 #include <sstream>
 #include <iomanip>
-#include <immintrin.h>
 #include <set>
 #include <unordered_set>
 #include <random>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
 
 namespace gooch {
 
 // Standard tensor constructor with uninitialized data
 Tensor::Tensor(std::vector<size_t> shape) {
   shape_ = shape;
-  strides_ = std::vector<int>(shape.size());
+  strides_.resize(shape.size());
   size_ = 1;
   offset_ = 0;
   for (int i = shape.size() - 1; i >= 0; i--) {
     strides_[i] = size_;
     size_ *= shape_[i];
   }
-  data_ = std::shared_ptr<float>(new float[size_], std::default_delete<float[]>());
+  data_ = allocator::Allocate(size_);
   grad_ = std::shared_ptr<std::shared_ptr<float>>(new std::shared_ptr<float>(nullptr));
   original_size_ = size_;
+  contiguous_ = true;
 }
 
 // View constructor
-Tensor::Tensor(std::vector<size_t> shape, std::vector<int> strides, size_t offset, Tensor t) : shape_(shape), strides_(strides), data_(t.data_), grad_(t.grad_), offset_(offset), size_(t.size_), original_size_(t.original_size_) {}
+Tensor::Tensor(utils::Span<size_t> shape, utils::Span<int> strides, size_t offset, const Tensor& t) : shape_(shape), strides_(strides), data_(t.data_), grad_(t.grad_), offset_(offset), size_(t.size_), original_size_(t.original_size_), expr_(t.expr_), contiguous_(utils::is_contiguous(shape, strides)), dtype_(t.dtype_), half_(t.half_), requires_grad_(t.requires_grad_) {}
 
 std::ostream& operator<<(std::ostream& os, const Tensor& t) {
   os << t.str();
@@ -39,24 +46,59 @@ std::ostream& operator<<(std::ostream& os, const Tensor& t) {
 }
 
 // new tensor w/ data
-Tensor::Tensor(std::vector<size_t> shape, std::vector<int> strides, size_t offset, std::shared_ptr<float> data) : shape_(shape), strides_(strides), data_(data), grad_(std::shared_ptr<std::shared_ptr<float>>(new std::shared_ptr<float>(nullptr))), offset_(offset), size_(std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<size_t>())), original_size_(std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<size_t>())) {}
+Tensor::Tensor(utils::Span<size_t> shape, utils::Span<int> strides, size_t offset, std::shared_ptr<float> data) : shape_(shape), strides_(strides), data_(data), grad_(std::shared_ptr<std::shared_ptr<float>>(new std::shared_ptr<float>(nullptr))), offset_(offset), size_(std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<size_t>())), original_size_(std::accumulate(shape.begin(), shape.end(), 1, std::multiplies<size_t>())), contiguous_(utils::is_contiguous(shape, strides)) {}
+
+// lazy tensor
+Tensor::Tensor(utils::Span<size_t> shape, std::shared_ptr<fusion::Expr> expr) : Tensor(shape, utils::compute_strides(shape), 0, std::shared_ptr<float>(nullptr)) {
+  expr_ = expr;
+}
+
+// reduced precision
+Tensor::Tensor(utils::Span<size_t> shape, utils::Span<int> strides, size_t offset, std::shared_ptr<uint16_t> data, DType dtype) : Tensor(shape, strides, offset, std::shared_ptr<float>(nullptr)) {
+  dtype_ = dtype;
+  half_ = data;
+}
 
 std::shared_ptr<float> Tensor::data() const {
+  if (this->expr_) return fusion::Materialize(*this->expr_);
+  if (this->half_) {
+    // widens everything up to the last element reached, so offset and strides still apply
+    size_t extent = offset_ + 1;
+    for (size_t d = 0; d < shape_.size(); d++) {
+      if (shape_[d] == 0) return allocator::Allocate(0);
+      extent += (shape_[d] - 1) * (size_t) std::abs(strides_[d]);
+    }
+    std::shared_ptr<float> widened = allocator::Allocate(extent);
+    glas::widen(dtype_, extent, half_.get(), widened.get());
+    return widened;
+  }
   return this->data_;
 }
 
+DType Tensor::dtype() const {
+  return this->dtype_;
+}
+
+std::shared_ptr<uint16_t> Tensor::half_data() const {
+  return this->half_;
+}
+
+std::shared_ptr<fusion::Expr> Tensor::expr() const {
+  return this->expr_;
+}
+
 std::shared_ptr<float> Tensor::grad_data() const {
   return *this->grad_;
 }
 
 void Tensor::TouchGrad() const {
   if (*this->grad_ == nullptr) {
-    *this->grad_ = std::shared_ptr<float>(new float[original_size_], std::default_delete<float[]>());
+    *this->grad_ = allocator::Allocate(original_size_);
     std::fill((*this->grad_).get(), (*this->grad_).get() + original_size_, 0.0f);
   }
 }
 
-std::vector<size_t> Tensor::shape() const {
+utils::Span<size_t> Tensor::shape() const {
   return this->shape_;
 }
 
@@ -68,10 +110,14 @@ size_t Tensor::offset() const {
   return this->offset_;
 }
 
-std::vector<int> Tensor::strides() const {
+utils::Span<int> Tensor::strides() const {
   return this->strides_;
 }
 
+bool Tensor::is_contiguous() const {
+  return this->contiguous_;
+}
+
 Tensor zeros(std::vector<size_t> shape) {
   Tensor t(shape);
   std::fill(t.data().get(), t.data().get() + t.size(), 0.0f);
@@ -107,31 +153,39 @@ std::string Tensor::str() const {
   }
   ss << ")" << std::endl;
 
-  std::function<std::string(Tensor)> recursive_print = [&](Tensor t) -> std::string {
-    if (t.shape().size() == 0) {
-      std::string result = "";
-      std::stringstream temp;
-      temp << std::fixed << std::setprecision(3) << t.data().get()[t.offset()];
-      result += temp.str();
-      return result;
+  // walks the elements in row-major order, closing and reopening brackets for
+  // every dimension whose index wrapped around
+  std::vector<size_t> shape = shape_;
+  size_t rank = shape.size();
+  // dimensions past an empty one are never reached, it prints as []
+  size_t depth = std::find(shape.begin(), shape.end(), (size_t) 0) - shape.begin();
+  const float* values = data().get();
+  std::vector<size_t> index(depth, 0);
+  ss << std::string(depth, '[');
+  while (true) {
+    if (depth == rank) {
+      long offset = offset_;
+      for (size_t d = 0; d < rank; d++) offset += (long) index[d] * strides_[d];
+      ss << std::fixed << std::setprecision(3) << values[offset];
+    } else {
+      ss << "[]";
     }
-    std::string result = "[";
-    for (int i = 0; i < (int) t.shape()[0]; i++) {
-      result += recursive_print(t(i));
-      if (i < (int) t.shape()[0] - 1) {
-        result += t.shape().size() == 1 ? ", " : ",\n";
-      }
+    size_t wrapped = 0;
+    while (wrapped < depth && ++index[depth - 1 - wrapped] == shape[depth - 1 - wrapped]) {
+      index[depth - 1 - wrapped] = 0;
+      wrapped++;
     }
-    result += "]";
-    return result;
-  };
-  return ss.str() + recursive_print(*this);
+    ss << std::string(wrapped, ']');
+    if (wrapped == depth) break;
+    ss << (wrapped + rank - depth == 0 ? ", " : ",\n") << std::string(wrapped, '[');
+  }
+  return ss.str();
 }
 
 Tensor Tensor::grad() const {
   if (*grad_ == nullptr) {
     //throw std::runtime_error("Gradient not set");
-    *grad_ = std::shared_ptr<float>(new float[size_], std::default_delete<float[]>());
+    *grad_ = allocator::Allocate(size_);
     std::fill((*grad_).get(), (*grad_).get() + size_, 0.0f);
   }
   Tensor t(shape_, strides_, offset_, *grad_);
@@ -140,21 +194,29 @@ Tensor Tensor::grad() const {
   return t;
 }
 
-int num = 0;
 // backward is only defined on scalar tensors
 void Tensor::Backward() {
-  if (size_ != 1) {
-    std::invalid_argument("Backward can only be called on scalar tensors");
+  // a view's size_ is its parent's, so the element count comes from the shape
+  if (std::accumulate(shape_.begin(), shape_.end(), (size_t) 1, std::multiplies<size_t>()) != 1) {
+    throw std::invalid_argument("Backward can only be called on scalar tensors");
   }
   if (!grad_fn_) {
-    std::invalid_argument("Tensor must have grad function defined");
+    throw std::invalid_argument("Tensor must have grad function defined");
   }
-  num=0;
-  grad_fn_(FromVector(1.0f));
+  autograd::RunBackward(grad_fn_, FromVector(1.0f));
 }
 
+// zeroed in place, a gradient bound to shared storage such as a ParameterGroup arena stays bound
 void Tensor::ZeroGrad() {
-  *grad_ = nullptr;
+  if (*grad_ != nullptr) std::memset((*grad_).get(), 0, original_size_ * sizeof(float));
+}
+
+bool Tensor::requires_grad() const {
+  return grad_fn_ != nullptr || requires_grad_;
+}
+
+void Tensor::SetRequiresGrad(bool requires_grad) {
+  requires_grad_ = requires_grad;
 }
 
 Slice::Slice(int start, int end, int step) {
@@ -179,29 +241,29 @@ Slice Slice::all() {
   return Slice(0, -1, 1);
 }
 
-View::View(std::vector<size_t> shape, std::vector<int> strides, size_t offset, Tensor t) : Tensor(shape, strides, offset, t) {}
+View::View(utils::Span<size_t> shape, utils::Span<int> strides, size_t offset, const Tensor& t) : Tensor(shape, strides, offset, t) {}
 
-std::vector<size_t> Tensor::GetBroadcastShape(const Tensor& a, const Tensor& b) {
-  Tensor larger = a.shape().size() > b.shape().size() ? a : b;
-  Tensor smaller = a.shape().size() > b.shape().size() ? b : a;
-  // pad the front of the smaller tensor shape with 1s
-  std::vector<size_t> padded_shape(larger.shape().size() - smaller.shape().size(), 1);
-  for (size_t i = 0; i < smaller.shape().size(); i++) {
-    padded_shape.push_back(smaller.shape()[i]);
-  }
-  std::vector<size_t> resulting_shape;
+utils::Shape Tensor::GetBroadcastShape(const Tensor& a, const Tensor& b) {
+  const Tensor& larger = a.shape().size() > b.shape().size() ? a : b;
+  const Tensor& smaller = a.shape().size() > b.shape().size() ? b : a;
+  // the smaller shape is padded at the front with 1s
+  size_t padding = larger.shape().size() - smaller.shape().size();
+  utils::Shape resulting_shape;
+  resulting_shape.resize(larger.shape().size());
   for (size_t i = 0; i < larger.shape().size(); i++) {
+    size_t padded = i < padding ? 1 : smaller.shape()[i - padding];
     // assert that the shapes are compatible
-    if (larger.shape()[i] != padded_shape[i] && larger.shape()[i] != 1 && padded_shape[i] != 1) {
+    if (larger.shape()[i] != padded && larger.shape()[i] != 1 && padded != 1) {
       throw std::invalid_argument("Shapes are not broadcastable");
     }
-    resulting_shape.push_back(std::max(larger.shape()[i], padded_shape[i]));
+    resulting_shape[i] = std::max(larger.shape()[i], padded);
   }
   return resulting_shape;
 }
 
-Tensor Tensor::Broadcast(const Tensor& a, const std::vector<size_t>& shape) {
-  std::vector<int> new_strides(shape.size());
+Tensor Tensor::Broadcast(const Tensor& a, utils::Span<size_t> shape) {
+  utils::Strides new_strides;
+  new_strides.resize(shape.size());
   for (size_t i = 0; i < shape.size(); i++) {
     // a might be smaller than shape, so this is like padding with 1s
     size_t a_index = i - (shape.size() - a.shape().size());
@@ -216,149 +278,356 @@ Tensor Tensor::Broadcast(const Tensor& a, const std::vector<size_t>& shape) {
 }
 
 void View::operator=(const Tensor& other) {
+  if (dtype_ != DType::kFloat32) {
+    throw std::invalid_argument("Cannot assign into a reduced precision tensor");
+  }
   Tensor t = Tensor::Broadcast(other, this->shape_);
-  std::function<void(Tensor, Tensor)> recursive_copy = [&recursive_copy](Tensor a, Tensor b) {
-    if (a.shape().size() == 0) {
-      a.data().get()[a.offset()] = b.data().get()[b.offset()];
-    } else {
-      for (int i = 0; i < (int) a.shape()[0]; i++) {
-        recursive_copy(a(i), b(i));
-      }
-    }
-  };
-  recursive_copy(*this, t);
+  utils::StridedCopy(shape_, t.data().get() + t.offset(), t.strides(), data().get() + offset_, strides_);
 }
 
 View::View(const Tensor& t) : Tensor(t.shape(), t.strides(), t.offset(), t.data()) {}
 
 void propagate_grad(const Tensor& grad, const Tensor& op) {
-  if (op.grad_fn_) op.grad_fn_(grad);
+  if (op.grad_fn_) autograd::Accumulate(op.grad_fn_, grad);
 }
 
-void update_grad(const Tensor& grad, const Tensor& op) {
+// sums grad over the axes that were broadcast to reach its shape, the result has the given shape
+Tensor reduce_to_shape(const Tensor& grad, const std::vector<size_t>& shape) {
   std::unordered_set<size_t> axes;
-  Tensor broadcast = Tensor::Broadcast(op, grad.shape());
-  for (size_t i = 0; i < broadcast.shape().size(); ++i) {
-    if (broadcast.strides()[i] == 0) {
-      int reverse_index = i - (int)(broadcast.shape().size() - op.shape().size());
-      if (reverse_index >= 0 && broadcast.shape()[i] != op.shape()[reverse_index]) {
-        axes.insert(i);
-      }
+  size_t padding = grad.shape().size() - shape.size();
+  for (size_t i = 0; i < grad.shape().size(); ++i) {
+    if (i < padding || (shape[i - padding] == 1 && grad.shape()[i] != 1)) {
+      axes.insert(i);
     }
   }
-  Tensor reduced_grad = glas::reduceSum(grad, axes);
+  if (axes.empty()) return grad;
+  Tensor reduced = glas::reduceSum(grad, axes);
+  return Tensor(shape, utils::compute_strides(shape), 0, reduced.data());
+}
+
+namespace {
+// while a step is captured, replays recompute result straight into its buffer
+void record(const Tensor& result, std::function<void(const Tensor&)> compute) {
+  if (!graph::Capturing()) return;
+  graph::Record([result, compute] {
+    if (!result.half_data()) {
+      compute(result);
+      return;
+    }
+    // the kernels write float32, a reduced precision result is narrowed from scratch
+    Tensor wide(result.shape());
+    compute(wide);
+    glas::narrow(result.dtype(), result.size(), wide.data().get(), result.half_data().get() + result.offset());
+  }, result);
+}
+}
+
+void update_grad(const Tensor& grad, const Tensor& op) {
+  if (!op.requires_grad()) return;
+  Tensor reduced_grad = reduce_to_shape(grad, op.shape());
 
   op.TouchGrad();
   glas::add_(reduced_grad, op.grad());
 
-  propagate_grad(grad, op);
+  propagate_grad(reduced_grad, op);
 }
 
 Tensor operator+(const Tensor& a, const Tensor& b) {
+  if (fusion::Enabled()) return fusion::Binary(fusion::Op::kAdd, a, b);
   Tensor result = glas::add(a, b);
-  result.grad_fn_ = [a, b] (Tensor grad) {
-    update_grad(grad, a);
-    update_grad(grad, b);
-  };
+  record(result, [a, b] (const Tensor& out) { glas::add_into(a, b, out); });
+  if (autograd::Track(result, {&a, &b})) {
+    result.grad_fn_ = autograd::MakeNode({a, b}, [a, b] (const Tensor& grad) {
+      update_grad(grad, a);
+      update_grad(grad, b);
+    });
+  }
   return result;
 }
 
 Tensor operator*(const Tensor& a, const Tensor& b) {
+  if (fusion::Enabled()) return fusion::Binary(fusion::Op::kMul, a, b);
   Tensor result = glas::mul(a, b);
-  result.grad_fn_ = [a, b] (Tensor grad) {
-    Tensor a_grad = glas::mul(grad, b);
-    Tensor b_grad = glas::mul(grad, a);
-    update_grad(a_grad, a);
-    update_grad(b_grad, b);
-  };
+  record(result, [a, b] (const Tensor& out) { glas::mul_into(a, b, out); });
+  if (autograd::Track(result, {&a, &b})) {
+    result.grad_fn_ = autograd::MakeNode({a, b}, [a, b] (const Tensor& grad) {
+      if (a.requires_grad()) update_grad(glas::mul(grad, b), a);
+      if (b.requires_grad()) update_grad(glas::mul(grad, a), b);
+    });
+  }
   return result;
 }
 
 Tensor operator/(const Tensor& a, const Tensor& b) {
+  if (fusion::Enabled()) return fusion::Binary(fusion::Op::kDiv, a, b);
   Tensor result = glas::div(a, b);
-  result.grad_fn_ = [a, b, result] (Tensor grad) {
-    Tensor a_grad = glas::mul(glas::inv(b), grad);
-    Tensor b_grad = glas::neg(glas::mul(a_grad, result));
-    update_grad(a_grad, a);
-    update_grad(b_grad, b);
-  };
+  record(result, [a, b] (const Tensor& out) { glas::div_into(a, b, out); });
+  if (autograd::Track(result, {&a, &b})) {
+    result.grad_fn_ = autograd::MakeNode({a, b}, [a, b, result] (const Tensor& grad) {
+      Tensor a_grad = glas::mul(glas::inv(b), grad);
+      Tensor b_grad = glas::neg(glas::mul(a_grad, result));
+      update_grad(a_grad, a);
+      update_grad(b_grad, b);
+    });
+  }
   return result;
 }
 
 Tensor operator-(const Tensor& a, const Tensor& b) {
+  if (fusion::Enabled()) return fusion::Binary(fusion::Op::kSub, a, b);
   Tensor result = glas::sub(a, b);
-  result.grad_fn_ = [a, b] (Tensor grad) {
-    Tensor b_grad = glas::neg(grad);
-    update_grad(grad, a);
-    update_grad(b_grad, b);
-  };
+  record(result, [a, b] (const Tensor& out) { glas::sub_into(a, b, out); });
+  if (autograd::Track(result, {&a, &b})) {
+    result.grad_fn_ = autograd::MakeNode({a, b}, [a, b] (const Tensor& grad) {
+      Tensor b_grad = glas::neg(grad);
+      update_grad(grad, a);
+      update_grad(b_grad, b);
+    });
+  }
   return result;
 }
 
 Tensor operator-(const Tensor& a) {
+  if (fusion::Enabled()) return fusion::Unary(fusion::Op::kNeg, a);
   Tensor result = glas::neg(a);
-  result.grad_fn_ = [a] (Tensor grad) {
-    Tensor a_grad = glas::neg(grad);
-    update_grad(a_grad, a);
-  };
+  record(result, [a] (const Tensor& out) { glas::neg_into(a, out); });
+  if (autograd::Track(result, {&a})) {
+    result.grad_fn_ = autograd::MakeNode({a}, [a] (const Tensor& grad) {
+      Tensor a_grad = glas::neg(grad);
+      update_grad(a_grad, a);
+    });
+  }
   return result;
 }
 
-Tensor Einsum(const Tensor& a, const Tensor& b, const std::string& equation) {
-  Tensor result = glas::einsum(a, b, equation); 
-  result.grad_fn_ = [a, b, equation](Tensor grad) {
-    // decompose equation into a, b and c
-    std::string a_string; 
-    std::string b_string; 
-    std::string c_string; 
-
-    for(size_t i = 0, state = 0; i < equation.size(); i++) {
-      switch (state)
-      {
-      case 0:
-        if (equation[i] == ',') state++;
-        else a_string.push_back(equation[i]);
-        break;
-      case 1:
-        if (equation[i] == '-' && equation[i + 1] == '>') {
-          i += 2;
-          state++;
-        } else b_string.push_back(equation[i]);
-        break;
-      case 2:
-        c_string.push_back(equation[i]);
-        break; 
-      default:
-        break;
-      }
-    }
+Tensor exp(const Tensor& a) {
+  if (fusion::Enabled()) return fusion::Unary(fusion::Op::kExp, a);
+  Tensor result = glas::exp(a);
+  record(result, [a] (const Tensor& out) { glas::exp_into(a, out); });
+  if (autograd::Track(result, {&a})) {
+    result.grad_fn_ = autograd::MakeNode({a}, [a, result] (const Tensor& grad) {
+      update_grad(glas::mul(grad, result), a);
+    });
+  }
+  return result;
+}
 
-    Tensor a_grad = glas::einsum(grad, b, c_string + ", " + b_string + " -> " + a_string);
-    Tensor b_grad = glas::einsum(grad, a, c_string + ", " + a_string + " -> " + b_string);
+Tensor log(const Tensor& a) {
+  if (fusion::Enabled()) return fusion::Unary(fusion::Op::kLog, a);
+  Tensor result = glas::log(a);
+  record(result, [a] (const Tensor& out) { glas::log_into(a, out); });
+  if (autograd::Track(result, {&a})) {
+    result.grad_fn_ = autograd::MakeNode({a}, [a] (const Tensor& grad) {
+      update_grad(glas::div(grad, a), a);
+    });
+  }
+  return result;
+}
 
+Tensor inv(const Tensor& a) {
+  if (fusion::Enabled()) return fusion::Unary(fusion::Op::kInv, a);
+  Tensor result = glas::inv(a);
+  record(result, [a] (const Tensor& out) { glas::inv_into(a, out); });
+  if (autograd::Track(result, {&a})) {
+    result.grad_fn_ = autograd::MakeNode({a}, [a, result] (const Tensor& grad) {
+      update_grad(glas::neg(glas::mul(grad, glas::mul(result, result))), a);
+    });
+  }
+  return result;
+}
 
+Tensor root(const Tensor& a) {
+  if (fusion::Enabled()) return fusion::Unary(fusion::Op::kRoot, a);
+  Tensor result = glas::root(a);
+  record(result, [a] (const Tensor& out) { glas::root_into(a, out); });
+  if (autograd::Track(result, {&a})) {
+    result.grad_fn_ = autograd::MakeNode({a}, [a, result] (const Tensor& grad) {
+      update_grad(glas::div(glas::mul(grad, FromVector(0.5f)), result), a);
+    });
+  }
+  return result;
+}
 
-    update_grad(a_grad, a);
-    update_grad(b_grad, b);
-  };
+Tensor Einsum(const Tensor& a, const Tensor& b, const std::string& equation) {
+  const glas::EinsumEquation& parsed = glas::parse_einsum(equation);
+  std::shared_ptr<const glas::EinsumPlan> plan = parsed.plan(a.shape(), a.strides(), b.shape(), b.strides());
+  Tensor result = glas::einsum(*plan, a, b);
+  record(result, [plan, a, b] (const Tensor& out) { glas::einsum_into(*plan, a, b, out); });
+  if (autograd::Track(result, {&a, &b})) {
+    // the gradient arrives in the layout of result, so both gradient plans can be compiled now
+    std::shared_ptr<const glas::EinsumPlan> a_grad_plan = parsed.a_grad().plan(result.shape(), result.strides(), b.shape(), b.strides(), a.shape());
+    std::shared_ptr<const glas::EinsumPlan> b_grad_plan = parsed.b_grad().plan(result.shape(), result.strides(), a.shape(), a.strides(), b.shape());
+    result.grad_fn_ = autograd::MakeNode({a, b}, [a, b, a_grad_plan, b_grad_plan] (const Tensor& grad) {
+      if (a.requires_grad()) update_grad(glas::einsum(*a_grad_plan, grad, b), a);
+      if (b.requires_grad()) update_grad(glas::einsum(*b_grad_plan, grad, a), b);
+    });
+  }
   return result;
 }
 
+namespace {
+// t, a reduction of a over axes, viewed at a's shape by stepping 0 along the reduced axes
+Tensor expand_reduced(const Tensor& t, const Tensor& a, const std::unordered_set<size_t>& axes) {
+  std::vector<int> strides(a.shape().size());
+  for (size_t i = 0, j = 0; i < a.shape().size(); ++i) {
+    if (axes.find(i) != axes.end()) {
+      strides[i] = 0;
+    }
+    else {
+      strides[i] = t.strides()[j++];
+    }
+  }
+  return Tensor(a.shape(), strides, t.offset(), t.data());
+}
+
+size_t reduced_count(const Tensor& a, const std::unordered_set<size_t>& axes) {
+  size_t count = 1;
+  for (size_t axis : axes) {
+    if (axis >= a.shape().size()) throw std::invalid_argument("Axis out of range");
+    count *= a.shape()[axis];
+  }
+  return count;
+}
+
+// the gradient of a max or min goes to the elements equal to it, split evenly between ties
+Tensor extremum(const Tensor& a, std::unordered_set<size_t> axes, glas::ReduceOp op) {
+  Tensor result = glas::reduce(a, op, axes);
+  record(result, [a, op, axes] (const Tensor& out) { glas::reduce_into(a, op, axes, out); });
+  if (autograd::Track(result, {&a})) {
+    result.grad_fn_ = autograd::MakeNode({a}, [a, axes, result] (const Tensor& grad) {
+      Tensor expanded = expand_reduced(result, a, axes);
+      Tensor mask(a.shape());
+      float* m = mask.data().get();
+      const float* x = a.data().get() + a.offset();
+      const float* r = expanded.data().get() + expanded.offset();
+      utils::StridedIterator it(a.shape(), {utils::compute_strides(a.shape()), a.strides(), expanded.strides()});
+      size_t cols = it.row_size();
+      long m_cs = it.row_stride(0), x_cs = it.row_stride(1), r_cs = it.row_stride(2);
+      for (size_t step = 0, steps = it.steps(); step < steps; step++, it.next()) {
+        for (size_t j = 0; j < cols; j++) {
+          m[it.offset(0) + (long) j * m_cs] = x[it.offset(1) + (long) j * x_cs] == r[it.offset(2) + (long) j * r_cs] ? 1.0f : 0.0f;
+        }
+      }
+      Tensor share = glas::div(grad, glas::reduceSum(mask, axes));
+      update_grad(glas::mul(mask, expand_reduced(share, a, axes)), a);
+    });
+  }
+  return result;
+}
+}
+
 Tensor reduceSum(const Tensor& a, std::unordered_set<size_t> axes) {
   Tensor result = glas::reduceSum(a, axes);
-  result.grad_fn_ = [a, axes] (Tensor grad) {
-    std::vector<int> strides(a.strides().size());
-    for (size_t i = 0; i < a.shape().size(); ++i) {
-      if (axes.find(i) != axes.end()) {
-        strides[i] = 0;
-      }
-      else {
-        strides[i] = a.strides()[i];
-      }
-    }
-    Tensor a_grad(a.shape(), strides, grad.offset(), grad.data());
-    update_grad(a_grad, a);
-  };
+  record(result, [a, axes] (const Tensor& out) { glas::reduce_into(a, glas::ReduceOp::kSum, axes, out); });
+  if (autograd::Track(result, {&a})) {
+    result.grad_fn_ = autograd::MakeNode({a}, [a, axes] (const Tensor& grad) {
+      // the reduced axes are missing from grad, broadcast it back along them
+      update_grad(expand_reduced(grad, a, axes), a);
+    });
+  }
+  return result;
+}
+
+Tensor reduceMax(const Tensor& a, std::unordered_set<size_t> axes) {
+  return extremum(a, axes, glas::ReduceOp::kMax);
+}
+
+Tensor reduceMin(const Tensor& a, std::unordered_set<size_t> axes) {
+  return extremum(a, axes, glas::ReduceOp::kMin);
+}
+
+Tensor reduceMean(const Tensor& a, std::unordered_set<size_t> axes) {
+  Tensor result = glas::reduceMean(a, axes);
+  record(result, [a, axes] (const Tensor& out) { glas::reduceMean_into(a, axes, out); });
+  if (autograd::Track(result, {&a})) {
+    result.grad_fn_ = autograd::MakeNode({a}, [a, axes] (const Tensor& grad) {
+      Tensor scaled = glas::mul(grad, FromVector(1.0f / reduced_count(a, axes)));
+      update_grad(expand_reduced(scaled, a, axes), a);
+    });
+  }
+  return result;
+}
+
+Tensor variance(const Tensor& a, std::unordered_set<size_t> axes, bool unbiased) {
+  size_t count = reduced_count(a, axes);
+  if (unbiased && count < 2) {
+    throw std::invalid_argument("The unbiased variance needs at least two elements");
+  }
+  float divisor = unbiased ? count - 1.0f : (float) count;
+  // two passes, the deviations from the mean keep the squares well conditioned
+  Tensor mean = glas::reduceMean(a, axes);
+  Tensor centered = glas::sub(a, expand_reduced(mean, a, axes));
+  Tensor squares = glas::mul(centered, centered);
+  Tensor result = glas::reduceSum(squares, axes);
+  glas::mul_cons_simd(result.size(), result.data().get(), 1.0f / divisor);
+  // backward reads centered, so it is refreshed too, before the result that is computed from it.
+  // Replays reuse the mean and the squares as scratch.
+  record(centered, [a, axes, mean] (const Tensor& out) {
+    glas::reduceMean_into(a, axes, mean);
+    glas::sub_into(a, expand_reduced(mean, a, axes), out);
+  });
+  record(result, [axes, divisor, centered, squares] (const Tensor& out) {
+    glas::mul_into(centered, centered, squares);
+    glas::reduce_into(squares, glas::ReduceOp::kSum, axes, out);
+    glas::mul_cons_simd(out.size(), out.data().get(), 1.0f / divisor);
+  });
+  if (autograd::Track(result, {&a})) {
+    result.grad_fn_ = autograd::MakeNode({a}, [a, axes, centered, divisor] (const Tensor& grad) {
+      // the mean's own gradient sums to zero against the deviations and drops out
+      Tensor scaled = glas::mul(grad, FromVector(2.0f / divisor));
+      update_grad(glas::mul(centered, expand_reduced(scaled, a, axes)), a);
+    });
+  }
+  return result;
+}
+
+Tensor argmax(const Tensor& a, size_t axis) {
+  Tensor result = glas::argmax(a, axis);
+  record(result, [a, axis] (const Tensor& out) { glas::argReduce_into(a, axis, glas::ReduceOp::kMax, out); });
+  return result;
+}
+
+Tensor argmin(const Tensor& a, size_t axis) {
+  Tensor result = glas::argmin(a, axis);
+  record(result, [a, axis] (const Tensor& out) { glas::argReduce_into(a, axis, glas::ReduceOp::kMin, out); });
+  return result;
+}
+
+Tensor index_select(const Tensor& a, size_t axis, const Tensor& index) {
+  Tensor result = glas::index_select(a, axis, index);
+  record(result, [a, axis, index] (const Tensor& out) { glas::index_select_into(a, axis, index, out); });
+  if (autograd::Track(result, {&a})) {
+    result.grad_fn_ = autograd::MakeNode({a}, [a, axis, index] (const Tensor& grad) {
+      Tensor a_grad = zeros(a.shape());
+      glas::index_add_(a_grad, axis, index, grad);
+      update_grad(a_grad, a);
+    });
+  }
+  return result;
+}
+
+Tensor gather(const Tensor& a, size_t axis, const Tensor& index) {
+  Tensor result = glas::gather(a, axis, index);
+  record(result, [a, axis, index] (const Tensor& out) { glas::gather_into(a, axis, index, out); });
+  if (autograd::Track(result, {&a})) {
+    result.grad_fn_ = autograd::MakeNode({a}, [a, axis, index] (const Tensor& grad) {
+      Tensor a_grad = zeros(a.shape());
+      glas::scatter_add_(a_grad, axis, index, grad);
+      update_grad(a_grad, a);
+    });
+  }
+  return result;
+}
+
+Tensor scatter_add(const Tensor& a, size_t axis, const Tensor& index, const Tensor& src) {
+  Tensor result = glas::scatter_add(a, axis, index, src);
+  record(result, [a, axis, index, src] (const Tensor& out) { glas::scatter_add_into(a, axis, index, src, out); });
+  if (autograd::Track(result, {&a, &src})) {
+    result.grad_fn_ = autograd::MakeNode({a, src}, [a, axis, index, src] (const Tensor& grad) {
+      update_grad(grad, a);
+      if (src.requires_grad()) update_grad(glas::gather(grad, axis, index), src);
+    });
+  }
   return result;
 }
 
@@ -373,8 +642,41 @@ Tensor reshape(const Tensor& a , std::vector<size_t> newShape){
     prod/=dim;
   }
   assert(prod == 1);
-  Tensor result = Tensor(newShape , utils::compute_strides(newShape) , a.offset() , a);
-  result.grad_fn_ = a.grad_fn_;
+  std::vector<size_t> oldShape = a.shape();
+  size_t size = std::accumulate(oldShape.begin(), oldShape.end(), (size_t) 1, std::multiplies<size_t>());
+  // a contiguous tensor is reinterpreted in place and shares a's grad buffer, so
+  // only a's own node needs the gradient. Anything else is copied first.
+  bool shares = a.is_contiguous();
+  Tensor result = shares
+      ? Tensor(newShape , utils::compute_strides(newShape) , a.offset() , a)
+      : Tensor(newShape , utils::compute_strides(newShape) , 0 , utils::broadcast_tensor_to_buf(a, oldShape, size));
+  if (!shares) {
+    record(result, [a] (const Tensor& out) { glas::copy_into(a, out); });
+  }
+  if (autograd::Track(result, {&a})) {
+    result.grad_fn_ = autograd::MakeNode({a}, [a, oldShape, size, shares] (const Tensor& grad) {
+      Tensor old_grad = grad.is_contiguous()
+          ? Tensor(oldShape, utils::compute_strides(oldShape), grad.offset(), grad)
+          : Tensor(oldShape, utils::compute_strides(oldShape), 0, utils::broadcast_tensor_to_buf(grad, grad.shape(), size));
+      if (shares) {
+        propagate_grad(old_grad, a);
+      } else {
+        update_grad(old_grad, a);
+      }
+    });
+  }
+  return result;
+}
+
+Tensor cast(const Tensor& a, DType dtype) {
+  if (a.dtype() == dtype) return a;
+  Tensor result = glas::cast(a, dtype);
+  record(result, [a] (const Tensor& out) { glas::copy_into(a, out); });
+  if (autograd::Track(result, {&a})) {
+    result.grad_fn_ = autograd::MakeNode({a}, [a] (const Tensor& grad) {
+      update_grad(grad, a);
+    });
+  }
   return result;
 }
 
@@ -387,23 +689,175 @@ Tensor logSumExp(const Tensor& a, std::unordered_set<size_t> axes) {
   Tensor exp = glas::exp(glas::sub(a, max));
   Tensor reducedSum = glas::reduceSum(exp, axes);
   Tensor result = glas::add(reducedMax , glas::log(reducedSum));
+  // replays reuse the intermediates as scratch
+  record(result, [a, axes, reducedMax, max, exp, reducedSum] (const Tensor& out) {
+    glas::reduce_into(a, glas::ReduceOp::kMax, axes, reducedMax);
+    glas::sub_into(a, max, exp);
+    glas::exp_into(exp, exp);
+    glas::reduce_into(exp, glas::ReduceOp::kSum, axes, reducedSum);
+    glas::log_into(reducedSum, reducedSum);
+    glas::add_into(reducedMax, reducedSum, out);
+  });
   Tensor reshapedResult  = reshape(result , std::vector<size_t>{batchSize , 1});
-  result.grad_fn_ = [a, reshapedResult] (Tensor grad) {
-    Tensor reshapedGrad = reshape(grad , reshapedResult.shape());
-    Tensor a_grad = glas::mul(reshapedGrad , glas::exp(glas::sub(a, reshapedResult)));
-    update_grad(a_grad, a);
-  };
+  if (autograd::Track(result, {&a})) {
+    result.grad_fn_ = autograd::MakeNode({a}, [a, reshapedResult] (const Tensor& grad) {
+      Tensor reshapedGrad = reshape(grad , reshapedResult.shape());
+      Tensor a_grad = glas::mul(reshapedGrad , glas::exp(glas::sub(a, reshapedResult)));
+      update_grad(a_grad, a);
+    });
+  }
   return result;
 }
 
 Tensor crossEntropyLoss(const Tensor& a, std::vector<size_t> correct) {
-  size_t N = a.shape()[0];
-  Tensor result = zeros({});
-  std::unordered_set<size_t> axes = {1};
-  Tensor lse = logSumExp(a, axes);
-  for (size_t i = 0; i < N; ++i) {
-    result = result + lse((int) i) - a((int) i, (int) correct[i]);
+  return crossEntropyLoss(a, correct, Reduction::kMean);
+}
+
+namespace {
+// what the forward of crossEntropyLoss leaves for its backward, replays refresh it in place
+struct CrossEntropyState {
+  std::vector<size_t> labels;
+  std::shared_ptr<float> z;
+  size_t z_offset = 0;
+  std::shared_ptr<float> packed; // non-contiguous logits, packed
+  std::shared_ptr<float> lse;
+  std::shared_ptr<float> losses;
+};
+
+// the class indices held by a 1-d float tensor
+void read_labels(const Tensor& labels, size_t C, std::vector<size_t>& out) {
+  const float* data = labels.data().get() + labels.offset();
+  long stride = labels.strides()[0];
+  for (size_t i = 0; i < out.size(); ++i) {
+    float label = data[(long) i * stride];
+    if (!(label >= 0.0f && label < (float) C)) throw std::invalid_argument("crossEntropyLoss label out of range");
+    if (label != std::floor(label)) throw std::invalid_argument("crossEntropyLoss labels must be class indices");
+    out[i] = (size_t) label;
+  }
+}
+}
+
+Tensor crossEntropyLoss(const Tensor& logits, const std::vector<size_t>& labels, Reduction reduction, float label_smoothing) {
+  Tensor indices({labels.size()});
+  for (size_t i = 0; i < labels.size(); ++i) indices.data().get()[i] = (float) labels[i];
+  indices.SetRequiresGrad(false);
+  return crossEntropyLoss(logits, indices, reduction, label_smoothing);
+}
+
+Tensor crossEntropyLoss(const Tensor& logits, const Tensor& labels, Reduction reduction, float label_smoothing) {
+  if (logits.shape().size() != 2) {
+    throw std::invalid_argument("crossEntropyLoss expects (N, C) logits");
   }
-  return result / FromVector((float)N);
+  size_t N = logits.shape()[0], C = logits.shape()[1];
+  if (labels.shape().size() != 1 || labels.shape()[0] != N) {
+    throw std::invalid_argument("crossEntropyLoss expects one label per row");
+  }
+  if (C == 0 && N > 0) {
+    throw std::invalid_argument("crossEntropyLoss expects at least one class");
+  }
+  if (label_smoothing < 0.0f || label_smoothing > 1.0f) {
+    throw std::invalid_argument("crossEntropyLoss label smoothing must be in [0, 1]");
+  }
+
+  float on = 1.0f - label_smoothing, off = C > 0 ? label_smoothing / C : 0.0f;
+  float scale = reduction == Reduction::kMean && N > 0 ? 1.0f / N : 1.0f;
+  auto state = std::make_shared<CrossEntropyState>();
+  state->labels.resize(N);
+  state->lse = allocator::Allocate(N);
+  state->losses = allocator::Allocate(N);
+  Tensor result = reduction == Reduction::kNone ? Tensor({N}, {1}, 0, state->losses) : Tensor(std::vector<size_t>{});
+  auto forward = [logits, labels, state, result, reduction, on, off, scale, N, C] {
+    read_labels(labels, C, state->labels);
+    // rows are read straight from the buffer, anything else is packed once
+    state->z = logits.data();
+    state->z_offset = logits.offset();
+    if (!logits.is_contiguous()) {
+      if (!state->packed) state->packed = allocator::Allocate(N * C);
+      state->z = state->packed;
+      utils::BufferCopy(logits, state->z.get());
+      state->z_offset = 0;
+    }
+
+    const kernels::Table& k = kernels::Get();
+    const float* z = state->z.get() + state->z_offset;
+    float* lse = state->lse.get();
+    float* losses = state->losses.get();
+    parallel::parallel_for(0, N, std::max<size_t>(1, parallel::kGrainSize / std::max<size_t>(1, C)), [&] (size_t begin, size_t end) {
+      for (size_t i = begin; i < end; ++i) {
+        const float* row = z + i * C;
+        float max = k.max(C, row);
+        lse[i] = max + std::log(k.sum_exp(C, row, max));
+        float loss = lse[i] - on * row[state->labels[i]];
+        if (off != 0.0f) loss -= off * k.sum(C, row);
+        losses[i] = loss;
+      }
+    });
+
+    if (reduction != Reduction::kNone) {
+      float total = 0.0f;
+      for (size_t i = 0; i < N; ++i) total += losses[i];
+      *result.data() = total * scale;
+    }
+  };
+  forward();
+  graph::Record(forward, result);
+
+  if (autograd::Track(result, {&logits})) {
+    result.grad_fn_ = autograd::MakeNode({logits}, [logits, state, reduction, on, off, scale, N, C] (const Tensor& grad) {
+      // per-row weight of the upstream gradient
+      Tensor g = grad.is_contiguous() ? grad : Tensor(grad.shape());
+      if (!grad.is_contiguous()) utils::BufferCopy(grad, g.data().get());
+      const float* g_data = g.data().get() + g.offset();
+      const kernels::Table& k = kernels::Get();
+      const float* z = state->z.get() + state->z_offset;
+      const float* lse = state->lse.get();
+      Tensor z_grad({N, C});
+      float* out = z_grad.data().get();
+      parallel::parallel_for(0, N, std::max<size_t>(1, parallel::kGrainSize / std::max<size_t>(1, C)), [&] (size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+          float weight = (reduction == Reduction::kNone ? g_data[i] : g_data[0]) * scale;
+          // weight * (softmax - target), the smoothing term folds into the bias
+          k.scaled_exp(C, z + i * C, lse[i], weight, -weight * off, out + i * C);
+          out[i * C + state->labels[i]] -= weight * on;
+        }
+      });
+      update_grad(z_grad, logits);
+    });
+  }
+  return result;
+}
+namespace {
+// the values of a, with a gradient of its own and no node
+Tensor detach(const Tensor& a) {
+  Tensor detached = !a.is_contiguous() || a.offset() != 0 ? glas::cast(a, a.dtype())
+      : a.half_data() ? Tensor(a.shape(), a.strides(), 0, a.half_data(), a.dtype())
+      : Tensor(a.shape(), a.strides(), 0, a.data());
+  detached.SetRequiresGrad(a.requires_grad());
+  return detached;
+}
+}
+
+Tensor Checkpoint(const std::function<Tensor(const std::vector<Tensor>&)>& fn, const std::vector<Tensor>& inputs) {
+  // fn runs again inside backward, outside of what a replay refreshes
+  graph::Unsupported();
+  Tensor result = [&] {
+    autograd::NoGradMode mode;
+    return fn(inputs);
+  }();
+  if (!autograd::GradEnabled()) return result;
+  // fn may read weights besides its inputs, so the node is recorded even if no input needs a gradient
+  result.SetRequiresGrad(true);
+  result.grad_fn_ = autograd::MakeNode(inputs, [fn, inputs] (const Tensor& grad) {
+    std::vector<Tensor> detached;
+    for (const Tensor& input : inputs) detached.push_back(detach(input));
+    Tensor recomputed = fn(detached);
+    // a pass of its own, the recomputed nodes are not part of the outer graph
+    if (recomputed.grad_fn_) autograd::RunBackward(recomputed.grad_fn_, grad);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      if (detached[i].grad_data()) update_grad(detached[i].grad(), inputs[i]);
+    }
+  });
+  return result;
+}
+
 }
-}
\ No newline at end of file
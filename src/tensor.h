@@ -1,6 +1,9 @@
 #pragma once
 
 #include "utils.h"
+#include "autograd.h"
+#include "allocator.h"
+#include "dtype.h"
 
 #include <vector>
 #include <memory>
@@ -9,12 +12,18 @@
 #include <cassert>
 #include <iostream>
 #include <numeric>
+#include <array>
+#include <stdexcept>
 #include <unordered_set>
 
 namespace gooch {
 
 class Tensor;
 
+namespace fusion {
+  struct Expr;
+}
+
 namespace detail {
   template<typename T>
   struct is_tensor_type : std::false_type {};
@@ -83,6 +92,37 @@ public:
 };
 
 class View;
+class ParameterGroup;
+
+// Plain strided access to the elements of a rank N float32 tensor, with no
+// autograd node and no allocation. Reads and writes go to the tensor's buffer
+// in place, the accessor is valid while that buffer is alive.
+template<size_t N>
+class Accessor {
+public:
+  Accessor(float* data, const size_t* shape, const int* strides) : data_(data) {
+    std::copy(shape, shape + N, shape_.begin());
+    std::copy(strides, strides + N, strides_.begin());
+  }
+
+  template<typename... Indices>
+  float& operator()(Indices... indices) const {
+    static_assert(sizeof...(Indices) == N, "An accessor takes one index per dimension");
+    ptrdiff_t offset = 0;
+    [[maybe_unused]] size_t d = 0;
+    ((offset += (ptrdiff_t) indices * strides_[d++]), ...);
+    return data_[offset];
+  }
+  size_t size(size_t dim) const { return shape_[dim]; }
+  long stride(size_t dim) const { return strides_[dim]; }
+  // the element at index 0 in every dimension
+  float* data() const { return data_; }
+
+private:
+  float* data_;
+  std::array<size_t, N> shape_;
+  std::array<long, N> strides_;
+};
 
 // A class representing a multi-dimensional tensor.
 // This class provides functionality for creating and manipulating tensors with arbitrary dimensions.
@@ -93,8 +133,8 @@ class View;
 //   Tensor t2 = t[{1, Slice::all(), 2}];  // Creates a 3x2 tensor
 class Tensor {
 protected:
-  std::vector<size_t> shape_;
-  std::vector<int> strides_;
+  utils::Shape shape_;
+  utils::Strides strides_;
 
 
   std::shared_ptr<float> data_;
@@ -103,41 +143,68 @@ protected:
   size_t offset_;
   size_t size_;
   size_t original_size_; // the size of the tensor at initialization, use to properly size the grad buffer
+  std::shared_ptr<fusion::Expr> expr_; // set on unevaluated results of lazy elementwise ops
+  bool contiguous_; // the elements are dense and row-major starting at offset_
+  friend class ParameterGroup; // binds gradients to its arena
+  DType dtype_ = DType::kFloat32;
+  std::shared_ptr<uint16_t> half_; // the elements of a reduced precision tensor, data_ is unused
+  bool requires_grad_ = true;
 
 public:
-  std::function<void(Tensor)> grad_fn_;
+  std::shared_ptr<autograd::Node> grad_fn_;
   bool is_leaf_;
   Tensor(std::vector<size_t> shape); // creates a tensor with no data
-  Tensor(std::vector<size_t> shape, std::vector<int> strides, size_t offset, Tensor t); // creates a view of t
-  Tensor(std::vector<size_t> shape, std::vector<int> strides, size_t offset, std::shared_ptr<float> data); // create a new tensor with the given shape and strides, and data
+  Tensor(utils::Span<size_t> shape, utils::Span<int> strides, size_t offset, const Tensor& t); // creates a view of t
+  Tensor(utils::Span<size_t> shape, utils::Span<int> strides, size_t offset, std::shared_ptr<float> data); // create a new tensor with the given shape and strides, and data
+  Tensor(utils::Span<size_t> shape, std::shared_ptr<fusion::Expr> expr); // a contiguous tensor whose data is computed on first read
+  Tensor(utils::Span<size_t> shape, utils::Span<int> strides, size_t offset, std::shared_ptr<uint16_t> data, DType dtype); // a reduced precision tensor
 
   template<typename... Args>
   View operator()(Args... indices) const;
+  // Element access for data preparation, metrics and custom kernels, where
+  // operator() would build a view and a node per element. N must be the rank
+  // and the tensor float32, else std::invalid_argument.
+  template<size_t N>
+  Accessor<N> accessor() const;
   friend std::ostream& operator<<(std::ostream& os, const Tensor& t);
 
+  // For reduced precision tensors, a float32 copy of the elements, at the same strides and offset.
   std::shared_ptr<float> data() const;
+  DType dtype() const;
+  // the 16-bit elements of a reduced precision tensor, null for float32
+  std::shared_ptr<uint16_t> half_data() const;
+  std::shared_ptr<fusion::Expr> expr() const;
   std::shared_ptr<float> grad_data() const;
   void TouchGrad() const;
-  std::vector<size_t> shape() const;
+  // views of the tensor's own metadata, valid while it is alive
+  utils::Span<size_t> shape() const;
   size_t size() const;
   size_t offset() const;
-  std::vector<int> strides() const;
+  utils::Span<int> strides() const;
+  bool is_contiguous() const;
   std::string str() const;
 
   Tensor grad() const;
   void Backward();
   void ZeroGrad();
+  // Leaves require a gradient unless told otherwise, e.g. input data. Results
+  // require one if an op recorded a node for them. Ops only record a node if
+  // one of their inputs requires a gradient, and backward skips the gradients
+  // of inputs that do not. The flag belongs to this handle, copies taken
+  // before it is set keep theirs.
+  bool requires_grad() const;
+  void SetRequiresGrad(bool requires_grad);
 
 
 
-  static std::vector<size_t> GetBroadcastShape(const Tensor& a, const Tensor& b);
-  static Tensor Broadcast(const Tensor& a, const std::vector<size_t>& shape);
+  static utils::Shape GetBroadcastShape(const Tensor& a, const Tensor& b);
+  static Tensor Broadcast(const Tensor& a, utils::Span<size_t> shape);
 
 };
 
 class View : public Tensor {
 public:
-  View(std::vector<size_t> shape, std::vector<int> strides, size_t offset, Tensor t);
+  View(utils::Span<size_t> shape, utils::Span<int> strides, size_t offset, const Tensor& t);
   View(const Tensor& t);
   void operator=(const Tensor& other);
 };
@@ -147,13 +214,15 @@ Tensor zeros(std::vector<size_t> shape);
 Tensor ones(std::vector<size_t> shape);
 Tensor randn(std::vector<size_t> shape);
 void propagate_grad(const Tensor& grad, const Tensor& op);
+void update_grad(const Tensor& grad, const Tensor& op);
 
 
 template<typename... Args>
 View Tensor::operator()(Args... indices) const {
-  std::vector<Slice> slices = {indices...};
-  std::vector<size_t> new_shape;
-  std::vector<int> new_strides;
+  // the slices, shape and strides stay on the stack, so taking a view does not allocate
+  std::array<Slice, sizeof...(Args)> slices = {Slice(indices)...};
+  utils::Shape new_shape;
+  utils::Strides new_strides;
   size_t new_size = 1;
   size_t new_offset = offset_;
   // using given slices
@@ -176,21 +245,34 @@ View Tensor::operator()(Args... indices) const {
     new_size *= shape_[i];
   }
   View result = View(new_shape, new_strides, new_offset, *this);
-  Tensor this_tensor = *this;
-  result.grad_fn_ = [this_tensor, new_shape , slices](Tensor grad) {
-    std::vector<int> new_grad_strides = utils::compute_strides(new_shape);
-    size_t new_grad_offset = 0;
-    for (size_t i = 0; i < slices.size(); i++) {
-      int start = slices[i].start_ < 0 ? slices[i].start_ + this_tensor.shape()[i] : slices[i].start_;
-      new_grad_offset += start * utils::compute_strides(this_tensor.shape())[i];
-    }
-    Tensor new_grad = zeros(this_tensor.shape());
-    View(new_shape, new_grad_strides, new_grad_offset, new_grad) = grad;
-    propagate_grad(new_grad, this_tensor);
-  };
+  if (autograd::Track(result, {this})) {
+    Tensor this_tensor = *this;
+    result.grad_fn_ = autograd::MakeNode({this_tensor}, [this_tensor, new_shape , slices](const Tensor& grad) {
+      utils::Strides new_grad_strides = utils::compute_strides(new_shape);
+      utils::Strides this_strides = utils::compute_strides(this_tensor.shape());
+      size_t new_grad_offset = 0;
+      for (size_t i = 0; i < slices.size(); i++) {
+        int start = slices[i].start_ < 0 ? slices[i].start_ + this_tensor.shape()[i] : slices[i].start_;
+        new_grad_offset += start * this_strides[i];
+      }
+      Tensor new_grad = zeros(this_tensor.shape());
+      View(new_shape, new_grad_strides, new_grad_offset, new_grad) = grad;
+      propagate_grad(new_grad, this_tensor);
+    });
+  }
   return result;
 }
 
+template<size_t N>
+Accessor<N> Tensor::accessor() const {
+  if (shape_.size() != N) {
+    throw std::invalid_argument("accessor<" + std::to_string(N) + "> of a tensor of rank " + std::to_string(shape_.size()));
+  }
+  if (dtype_ != DType::kFloat32) {
+    throw std::invalid_argument("accessor needs a float32 tensor, reduced precision data() is a copy");
+  }
+  return Accessor<N>(data().get() + offset_, shape_.data(), strides_.data());
+}
 
 // Vector constructor
 template<typename T>
@@ -213,7 +295,7 @@ Tensor FromVector(T data) {
       strides[i] = size;
       size *= shape[i];
     }
-    std::shared_ptr<float> data_ptr = std::shared_ptr<float>(new float[size], std::default_delete<float[]>());
+    std::shared_ptr<float> data_ptr = allocator::Allocate(size);
     detail::recursive_fill(data, data_ptr, 0, 0, strides);
     Tensor t(shape, strides, 0, data_ptr);
     return t;
@@ -225,9 +307,58 @@ Tensor operator-(const Tensor& a, const Tensor& b);
 Tensor operator*(const Tensor& a, const Tensor& b);
 Tensor operator/(const Tensor& a, const Tensor& b);
 Tensor operator-(const Tensor& a);
-Tensor reshape(const Tensor& a);
+Tensor exp(const Tensor& a);
+Tensor log(const Tensor& a);
+Tensor inv(const Tensor& a);
+Tensor root(const Tensor& a);
+Tensor reshape(const Tensor& a, std::vector<size_t> newShape);
+// Converts to dtype, the gradient flows back to a in float32.
+Tensor cast(const Tensor& a, DType dtype);
 Tensor Einsum(const Tensor& a, const Tensor& b, const std::string& equation);
 Tensor reduceSum(const Tensor& a, std::unordered_set<size_t> axes);
+// the gradient of a max or min is split evenly between the elements that attain it
+Tensor reduceMax(const Tensor& a, std::unordered_set<size_t> axes);
+Tensor reduceMin(const Tensor& a, std::unordered_set<size_t> axes);
+Tensor reduceMean(const Tensor& a, std::unordered_set<size_t> axes);
+// divides by the count, or by the count - 1 when unbiased
+Tensor variance(const Tensor& a, std::unordered_set<size_t> axes, bool unbiased = false);
+// the index of the first max or min along axis, with axis dropped. Indices are
+// stored as floats and have no gradient.
+Tensor argmax(const Tensor& a, size_t axis);
+Tensor argmin(const Tensor& a, size_t axis);
+// Indexing along axis with an index tensor of whole numbers stored as floats,
+// which has no gradient. Each is a single kernel, and its backward adds into
+// one gradient buffer, so the cost is that of the selected elements rather
+// than one node and one full-size gradient per index.
+// index_select takes whole slices: the result is a with axis resized to the
+// (K) index and result[.., k, ..] = a[.., index[k], ..].
+Tensor index_select(const Tensor& a, size_t axis, const Tensor& index);
+// gather picks one element per position: index has a's shape except along axis
+// and result[.., k, ..] = a[.., index[.., k, ..], ..], e.g. a label per row.
+Tensor gather(const Tensor& a, size_t axis, const Tensor& index);
+// The reverse of gather: a copy of a with each src element added at its index
+// along axis, repeated indices accumulate. src has the shape of index.
+Tensor scatter_add(const Tensor& a, size_t axis, const Tensor& index, const Tensor& src);
 Tensor logSumExp(const Tensor& a, std::unordered_set<size_t> axes);
 Tensor crossEntropyLoss(const Tensor& a, std::vector<size_t> correct);
+
+// how a per-example loss is combined over the batch
+enum class Reduction { kMean, kSum, kNone };
+
+// Fused softmax cross-entropy of (N, C) logits against class indices. Each row is
+// read once for its max, log-sum-exp and loss, only the N log-sum-exps are kept
+// for backward, which writes softmax - target in a single pass. With label
+// smoothing eps the target is (1 - eps) * onehot + eps / C.
+// kNone returns the (N) per-example losses.
+Tensor crossEntropyLoss(const Tensor& logits, const std::vector<size_t>& labels, Reduction reduction, float label_smoothing = 0.0f);
+// The same with the class indices held as floats in an (N) tensor, which a
+// captured step can take as an input and refill on every replay.
+Tensor crossEntropyLoss(const Tensor& logits, const Tensor& labels, Reduction reduction, float label_smoothing = 0.0f);
+
+// Activation checkpointing. Runs fn on inputs without recording, so none of its
+// intermediates are kept, only the inputs. Backward runs fn again with recording
+// on and backpropagates through the recomputed segment, one extra forward for
+// the activation memory of the whole segment. fn must compute the same thing
+// both times, and tensors it reads besides its inputs (e.g. weights) must be leaves.
+Tensor Checkpoint(const std::function<Tensor(const std::vector<Tensor>&)>& fn, const std::vector<Tensor>& inputs);
 }
\ No newline at end of file
@@ -1,26 +1,17 @@
 #include "tensor.h"
 #include "utils.h"
+#include "parallel.h"
 
 #include <set>
+#include <numeric>
+#include <algorithm>
+#include <stdexcept>
 
 namespace gooch {
 namespace utils {
 void BufferCopy(const Tensor& a, float* buffer) {
-  std::function<void(Tensor, float*, int, int, int)> recursive_copy = [&](Tensor t, float* buffer, int buffer_offset, int tensor_offset, int N) {
-    if (N == 0) {
-      buffer[buffer_offset] = t.data().get()[tensor_offset + t.offset()];
-    } else {
-      for (size_t i = 0; i < t.shape()[N - 1]; i++) {
-        size_t buffer_stride = 1;
-        for (size_t j = N; j < t.shape().size(); j++) {
-          buffer_stride *= t.shape()[j];
-        }
-        int tensor_stride = t.strides()[N - 1];
-        recursive_copy(t, buffer, buffer_offset + i * buffer_stride, tensor_offset + i * tensor_stride, N - 1);
-      }
-    }
-  };
-  recursive_copy(a, buffer, 0, 0, a.shape().size());
+  Span<size_t> shape = a.shape();
+  StridedCopy(shape, a.data().get() + a.offset(), a.strides(), buffer, compute_strides(shape));
 }
 
 void BufferAssign(const Tensor& a, std::shared_ptr<float> buffer) {
@@ -29,15 +20,16 @@ void BufferAssign(const Tensor& a, std::shared_ptr<float> buffer) {
   a_prime = b;
 }
 
-std::shared_ptr<float> broadcast_tensor_to_buf(const Tensor& a, const std::vector<size_t>& shape, size_t size) {
+std::shared_ptr<float> broadcast_tensor_to_buf(const Tensor& a, Span<size_t> shape, size_t size) {
   Tensor broadcast = Tensor::Broadcast(a, shape);
-  std::shared_ptr<float> buffer(new float[size], std::default_delete<float[]>());
+  std::shared_ptr<float> buffer = allocator::Allocate(size);
   utils::BufferCopy(broadcast, buffer.get());
   return buffer;
 }
 
-std::vector<int> compute_strides(const std::vector<size_t>& shape) {
-  std::vector<int> strides(shape.size());
+Strides compute_strides(Span<size_t> shape) {
+  Strides strides;
+  strides.resize(shape.size());
   int shape_accumulator = 1;
   for (int i = (int) strides.size() - 1; i >= 0; --i) {
     strides[i] = shape_accumulator;
@@ -45,5 +37,136 @@ std::vector<int> compute_strides(const std::vector<size_t>& shape) {
   }
   return strides;
 }
+
+bool is_contiguous(Span<size_t> shape, Span<int> strides) {
+  long expected = 1;
+  for (size_t d = shape.size(); d-- > 0;) {
+    if (shape[d] == 1) continue;
+    if (strides[d] != expected) return false;
+    expected *= shape[d];
+  }
+  return true;
+}
+
+StridedIterator::StridedIterator(Span<size_t> shape, std::initializer_list<Span<int>> strides) {
+  if (strides.size() > kMaxOperands) {
+    throw std::invalid_argument("Too many operands for a strided walk");
+  }
+  num_operands_ = strides.size();
+  ndim_ = 0;
+  for (size_t d = 0; d < shape.size(); d++) {
+    if (shape[d] == 1) continue;
+    // merge into the previous kept dimension if every operand steps through both as one
+    bool merge = ndim_ > 0;
+    size_t op = 0;
+    for (Span<int> s : strides) {
+      merge = merge && strides_[op][ndim_ - 1] == (long) s[d] * (long) shape[d];
+      op++;
+    }
+    if (merge) {
+      shape_[ndim_ - 1] *= shape[d];
+      op = 0;
+      for (Span<int> s : strides) strides_[op++][ndim_ - 1] = s[d];
+      continue;
+    }
+    if (ndim_ == kMaxDims) {
+      throw std::invalid_argument("Too many dimensions for a strided walk");
+    }
+    shape_[ndim_] = shape[d];
+    op = 0;
+    for (Span<int> s : strides) strides_[op++][ndim_] = s[d];
+    ndim_++;
+  }
+  if (ndim_ == 0) {
+    // a single element is walked as a row of one
+    shape_[0] = 1;
+    for (size_t op = 0; op < num_operands_; op++) strides_[op][0] = 0;
+    ndim_ = 1;
+  }
+  set_inner_dims(1);
+}
+
+void StridedIterator::set_inner_dims(size_t n) {
+  outer_dims_ = ndim_ - std::min(n, ndim_);
+  seek(0);
+}
+
+size_t StridedIterator::steps() const {
+  size_t steps = 1;
+  for (size_t d = 0; d < outer_dims_; d++) steps *= shape_[d];
+  return steps;
+}
+
+void StridedIterator::seek(size_t step) {
+  offset_.fill(0);
+  for (size_t d = outer_dims_; d-- > 0;) {
+    if (shape_[d] == 0) {
+      // an empty walk, there is nowhere to go
+      index_[d] = 0;
+      continue;
+    }
+    index_[d] = step % shape_[d];
+    step /= shape_[d];
+    for (size_t op = 0; op < num_operands_; op++) offset_[op] += strides_[op][d] * (long) index_[d];
+  }
+}
+
+namespace {
+// Side of the square tiles used when the source and destination are contiguous
+// along different dimensions. Two tiles of floats fit comfortably in L1.
+constexpr size_t kTransposeTile = 32;
+}
+
+void StridedCopy(Span<size_t> shape, const float* src, Span<int> src_strides, float* dst, Span<int> dst_strides) {
+  StridedIterator it(shape, {dst_strides, src_strides});
+  size_t nd = it.ndim();
+  if (nd >= 2 && it.row_stride(1) != 1 && it.stride(1, nd - 2) == 1) {
+    // the source is read along the second innermost dimension, copy tile by tile
+    it.set_inner_dims(2);
+    size_t rows = it.shape(nd - 2), cols = it.row_size();
+    long dst_rs = it.stride(0, nd - 2), dst_cs = it.row_stride(0);
+    long src_cs = it.row_stride(1);
+    size_t row_tiles = (rows + kTransposeTile - 1) / kTransposeTile;
+    size_t tasks = it.steps() * row_tiles;
+    size_t grain = std::max<size_t>(1, parallel::kGrainSize / (kTransposeTile * cols));
+    parallel::parallel_for(0, tasks, grain, [&] (size_t begin, size_t end) {
+      StridedIterator local = it;
+      for (size_t task = begin; task < end; task++) {
+        local.seek(task / row_tiles);
+        size_t i0 = (task % row_tiles) * kTransposeTile;
+        size_t i1 = std::min(rows, i0 + kTransposeTile);
+        float* d = dst + local.offset(0);
+        const float* s = src + local.offset(1);
+        for (size_t j0 = 0; j0 < cols; j0 += kTransposeTile) {
+          size_t j1 = std::min(cols, j0 + kTransposeTile);
+          for (size_t i = i0; i < i1; i++) {
+            for (size_t j = j0; j < j1; j++) {
+              d[i * dst_rs + j * dst_cs] = s[i + j * src_cs];
+            }
+          }
+        }
+      }
+    });
+    return;
+  }
+
+  size_t cols = it.row_size();
+  long dst_cs = it.row_stride(0), src_cs = it.row_stride(1);
+  parallel::parallel_for(0, it.steps(), std::max<size_t>(1, parallel::kGrainSize / std::max<size_t>(1, cols)), [&] (size_t begin, size_t end) {
+    StridedIterator local = it;
+    local.seek(begin);
+    for (size_t step = begin; step < end; step++, local.next()) {
+      float* d = dst + local.offset(0);
+      const float* s = src + local.offset(1);
+      if (dst_cs == 1 && src_cs == 1) {
+        std::copy(s, s + cols, d);
+      } else if (src_cs == 0) {
+        for (size_t j = 0; j < cols; j++) d[j * dst_cs] = *s;
+      } else {
+        for (size_t j = 0; j < cols; j++) d[j * dst_cs] = s[j * src_cs];
+      }
+    }
+  });
+}
 }
 }
\ No newline at end of file
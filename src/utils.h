@@ -3,14 +3,171 @@
 #include <set>
 #include <vector>
 #include <memory>
+#include <array>
+#include <algorithm>
+#include <initializer_list>
 
 namespace gooch {
 class Tensor;
 namespace utils {
 
+// A read-only view of consecutive elements, e.g. the shape of a tensor. It is
+// only valid while what it views is alive and unchanged, copy it into a
+// std::vector to keep it.
+template<typename T>
+class Span {
+public:
+  Span() : data_(nullptr), size_(0) {}
+  Span(const T* data, size_t size) : data_(data), size_(size) {}
+  Span(const std::vector<T>& values) : data_(values.data()), size_(values.size()) {}
+  // for arguments only, the list dies with the full expression
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winit-list-lifetime"
+  Span(std::initializer_list<T> values) : data_(values.begin()), size_(values.size()) {}
+#pragma GCC diagnostic pop
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  const T* data() const { return data_; }
+  const T* begin() const { return data_; }
+  const T* end() const { return data_ + size_; }
+  const T& operator[](size_t i) const { return data_[i]; }
+  const T& back() const { return data_[size_ - 1]; }
+  operator std::vector<T>() const { return std::vector<T>(begin(), end()); }
+
+  friend bool operator==(Span a, Span b) { return a.size_ == b.size_ && std::equal(a.begin(), a.end(), b.begin()); }
+  friend bool operator!=(Span a, Span b) { return !(a == b); }
+
+private:
+  const T* data_;
+  size_t size_;
+};
+
+// A vector that keeps up to N elements inline and only allocates past that.
+template<typename T, size_t N>
+class SmallVector {
+public:
+  SmallVector() = default;
+  SmallVector(Span<T> values) { assign(values); }
+  SmallVector(const SmallVector& other) { assign(other); }
+  SmallVector& operator=(const SmallVector& other) {
+    if (this != &other) assign(other);
+    return *this;
+  }
+  SmallVector& operator=(Span<T> values) {
+    assign(values);
+    return *this;
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  T* data() { return size_ > N ? heap_.data() : inline_.data(); }
+  const T* data() const { return size_ > N ? heap_.data() : inline_.data(); }
+  T* begin() { return data(); }
+  T* end() { return data() + size_; }
+  const T* begin() const { return data(); }
+  const T* end() const { return data() + size_; }
+  T& operator[](size_t i) { return data()[i]; }
+  const T& operator[](size_t i) const { return data()[i]; }
+  operator Span<T>() const { return Span<T>(data(), size_); }
+  operator std::vector<T>() const { return std::vector<T>(begin(), end()); }
+
+  // new elements are value-initialized
+  void resize(size_t size) {
+    if (size > N) {
+      if (size_ <= N) heap_.assign(inline_.begin(), inline_.begin() + size_);
+      heap_.resize(size);
+    } else {
+      if (size_ > N) std::copy(heap_.begin(), heap_.begin() + size, inline_.begin());
+      else if (size > size_) std::fill(inline_.begin() + size_, inline_.begin() + size, T());
+      heap_.clear();
+    }
+    size_ = size;
+  }
+
+  void push_back(const T& value) {
+    resize(size_ + 1);
+    data()[size_ - 1] = value;
+  }
+
+private:
+  void assign(Span<T> values) {
+    if (values.size() > N) {
+      heap_.assign(values.begin(), values.end());
+    } else {
+      std::copy(values.begin(), values.end(), inline_.begin());
+      heap_.clear();
+    }
+    size_ = values.size();
+  }
+
+  std::array<T, N> inline_{};
+  std::vector<T> heap_; // only used past N elements
+  size_t size_ = 0;
+};
+
+// tensors up to this rank keep their shape and strides without allocating
+constexpr size_t kInlineDims = 8;
+using Shape = SmallVector<size_t, kInlineDims>;
+using Strides = SmallVector<int, kInlineDims>;
+
 void BufferCopy(const Tensor& a, float* buffer);
 void BufferAssign(const Tensor& a, std::shared_ptr<float> buffer);
-std::shared_ptr<float> broadcast_tensor_to_buf(const Tensor& a, const std::vector<size_t>& shape, size_t size);
-std::vector<int> compute_strides(const std::vector<size_t>& shape);
+std::shared_ptr<float> broadcast_tensor_to_buf(const Tensor& a, Span<size_t> shape, size_t size);
+Strides compute_strides(Span<size_t> shape);
+// true if the strides lay the shape out densely in row-major order, ignoring size-1 dimensions
+bool is_contiguous(Span<size_t> shape, Span<int> strides);
+
+// Walks the index space of a shape without allocating, keeping one offset per
+// operand, each operand having its own strides over that shape. Size-1
+// dimensions are dropped and neighbouring dimensions that are contiguous with
+// each other in every operand are merged, so a contiguous tensor is walked as a
+// single row. The walk visits the outer dimensions in row-major order and leaves
+// the innermost inner_dims (one by default) to the caller.
+class StridedIterator {
+public:
+  static constexpr size_t kMaxDims = 16;
+  static constexpr size_t kMaxOperands = 3;
+
+  StridedIterator(Span<size_t> shape, std::initializer_list<Span<int>> strides);
+
+  size_t ndim() const { return ndim_; }
+  size_t shape(size_t dim) const { return shape_[dim]; }
+  long stride(size_t operand, size_t dim) const { return strides_[operand][dim]; }
+  size_t row_size() const { return shape_[ndim_ - 1]; }
+  long row_stride(size_t operand) const { return strides_[operand][ndim_ - 1]; }
+
+  // Hands the innermost n dimensions to the caller and restarts the walk.
+  void set_inner_dims(size_t n);
+  // The number of positions in the walk.
+  size_t steps() const;
+  void seek(size_t step);
+  long offset(size_t operand) const { return offset_[operand]; }
+
+  void next() {
+    for (size_t d = outer_dims_; d-- > 0;) {
+      if (++index_[d] < shape_[d]) {
+        for (size_t op = 0; op < num_operands_; op++) offset_[op] += strides_[op][d];
+        return;
+      }
+      index_[d] = 0;
+      for (size_t op = 0; op < num_operands_; op++) offset_[op] -= strides_[op][d] * (long) (shape_[d] - 1);
+    }
+  }
+
+private:
+  size_t ndim_;
+  size_t outer_dims_;
+  size_t num_operands_;
+  std::array<size_t, kMaxDims> shape_;
+  std::array<std::array<long, kMaxDims>, kMaxOperands> strides_;
+  std::array<size_t, kMaxDims> index_;
+  std::array<long, kMaxOperands> offset_;
+};
+
+// dst[i] = src[i] for every index of shape, each side laid out by its own
+// strides. Rows are copied directly when the source is read along them, and
+// transposing copies go through cache-sized tiles instead.
+void StridedCopy(Span<size_t> shape, const float* src, Span<int> src_strides, float* dst, Span<int> dst_strides);
+}
 }
-}
\ No newline at end of file
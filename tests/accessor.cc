@@ -0,0 +1,53 @@
+#include "tensor.h"
+#include <cassert>
+#include <stdexcept>
+
+int main() {
+  const size_t N = 4, M = 6;
+  gooch::Tensor a = gooch::randn({N, M});
+  gooch::Accessor<2> x = a.accessor<2>();
+  assert(x.size(0) == N && x.size(1) == M);
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < M; j++) {
+      assert(x(i, j) == a.data().get()[i * M + j]);
+    }
+  }
+
+  // writes land in the tensor, views see them through their own strides
+  gooch::Tensor columns = a(gooch::Slice::all(), gooch::Slice(1, -1, 2));
+  gooch::Accessor<2> c = columns.accessor<2>();
+  assert(c.size(1) == M / 2 && c.stride(1) == 2);
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < M / 2; j++) {
+      c(i, j) = (float) (i * 10 + j);
+    }
+  }
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < M / 2; j++) {
+      assert(x(i, 2 * j + 1) == (float) (i * 10 + j));
+    }
+  }
+
+  // broadcast views repeat the element, scalars take no index
+  gooch::Tensor row = gooch::Tensor::Broadcast(gooch::ones({M}), {N, M});
+  assert(row.accessor<2>()(N - 1, 2) == 1.0f);
+  gooch::Tensor scalar = gooch::FromVector(3.0f);
+  assert(scalar.accessor<0>()() == 3.0f);
+
+  // the rank has to match and the data has to be float32
+  bool thrown = false;
+  try {
+    a.accessor<3>();
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  assert(thrown);
+  thrown = false;
+  try {
+    gooch::cast(a, gooch::DType::kBFloat16).accessor<2>();
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  assert(thrown);
+  return 0;
+}
@@ -0,0 +1,74 @@
+#include "tensor.h"
+#include "allocator.h"
+#include <cassert>
+#include <cstdint>
+#include <thread>
+
+// counts what passes through it and hands the work to the system allocator
+class Counting : public gooch::allocator::Allocator {
+public:
+  void* Allocate(size_t bytes) override {
+    allocated++;
+    return gooch::allocator::SystemAllocator()->Allocate(bytes);
+  }
+  void Free(void* ptr, size_t bytes) override {
+    freed++;
+    gooch::allocator::SystemAllocator()->Free(ptr, bytes);
+  }
+  size_t allocated = 0;
+  size_t freed = 0;
+};
+
+int main() {
+  gooch::allocator::SetAllocator(gooch::allocator::CachingAllocator());
+  gooch::allocator::Trim();
+
+  // blocks are aligned, freed blocks are reused for requests of the same class
+  float* first;
+  {
+    std::shared_ptr<float> buffer = gooch::allocator::Allocate(1000);
+    first = buffer.get();
+    assert(reinterpret_cast<uintptr_t>(first) % gooch::allocator::kAlignment == 0);
+  }
+  gooch::allocator::Stats before = gooch::allocator::GetStats();
+  assert(before.bytes_cached >= 1000 * sizeof(float));
+  {
+    std::shared_ptr<float> buffer = gooch::allocator::Allocate(990);
+    assert(buffer.get() == first);
+  }
+  gooch::allocator::Stats after = gooch::allocator::GetStats();
+  assert(after.hits == before.hits + 1 && after.misses == before.misses);
+
+  // a training step's worth of tensors and gradients comes from the cache the second time
+  gooch::Tensor w = gooch::randn({64, 32});
+  for (int step = 0; step < 2; step++) {
+    before = gooch::allocator::GetStats();
+    gooch::Tensor x = gooch::randn({16, 64});
+    gooch::Tensor loss = gooch::reduceSum(gooch::Einsum(x, w, "b i, i o -> b o") * gooch::ones({32}), {0, 1});
+    loss.Backward();
+    w.ZeroGrad();
+    after = gooch::allocator::GetStats();
+    if (step == 1) assert(after.misses == before.misses);
+  }
+
+  // blocks freed by a thread that has exited go back to the shared pool
+  std::thread([] { gooch::allocator::Allocate(1 << 16); }).join();
+  {
+    before = gooch::allocator::GetStats();
+    std::shared_ptr<float> buffer = gooch::allocator::Allocate(1 << 16);
+    assert(gooch::allocator::GetStats().hits == before.hits + 1);
+  }
+
+  gooch::allocator::Trim();
+  assert(gooch::allocator::GetStats().bytes_cached == 0);
+
+  // buffers are returned to the allocator they came from
+  Counting counting;
+  gooch::allocator::SetAllocator(&counting);
+  {
+    gooch::Tensor t = gooch::zeros({10, 10});
+    gooch::allocator::SetAllocator(gooch::allocator::CachingAllocator());
+  }
+  assert(counting.allocated == 1 && counting.freed == 1);
+  return 0;
+}
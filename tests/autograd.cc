@@ -0,0 +1,54 @@
+#include "tensor.h"
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+
+// reads the first element a tensor points at
+float value(const gooch::Tensor& t) {
+  return t.data().get()[t.offset()];
+}
+
+int main() {
+  // shared subgraph: every consumer of y contributes to the same node
+  gooch::Tensor x = gooch::FromVector(3.0f);
+  gooch::Tensor y = x * x;
+  gooch::Tensor z = y + y;
+  for (int i = 0; i < 20; i++) {
+    z = z + z;
+  }
+  z.Backward();
+  // z = 2^21 * x^2
+  assert(fabs(value(x.grad()) - (float) (1 << 21) * 6.0f) < 1.0f);
+
+  // long chains neither overflow the stack in backward nor on destruction
+  gooch::Tensor w = gooch::FromVector(1.0f);
+  gooch::Tensor loss = gooch::zeros({});
+  for (int i = 0; i < 100000; i++) {
+    loss = loss + w;
+  }
+  loss.Backward();
+  assert(fabs(value(w.grad()) - 100000.0f) < 1e-1);
+
+  // broadcast operands receive gradients of their own shape
+  gooch::Tensor a = gooch::ones({4, 3});
+  gooch::Tensor b = gooch::ones({4, 1});
+  gooch::Tensor c = gooch::ones({3});
+  gooch::Tensor s = gooch::reduceSum(a * b + c, {0, 1});
+  s.Backward();
+  for (int i = 0; i < 4; i++) {
+    assert(fabs(value(b.grad()(i, 0)) - 3.0f) < 1e-6);
+  }
+  for (int j = 0; j < 3; j++) {
+    assert(fabs(value(c.grad()(j)) - 4.0f) < 1e-6);
+  }
+
+  // only a single element can seed backward
+  bool thrown = false;
+  try {
+    (a * b + c).Backward();
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  assert(thrown);
+  return 0;
+}
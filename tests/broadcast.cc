@@ -0,0 +1,54 @@
+#include "tensor.h"
+#include "glas.h"
+#include <cassert>
+#include <cmath>
+
+// reads element (i, j) of a 2-d tensor through its strides
+float at(const gooch::Tensor& t, size_t i, size_t j) {
+  std::vector<int> strides = t.strides();
+  return t.data().get()[t.offset() + i * strides[0] + j * strides[1]];
+}
+
+// checks every element of a op b against op applied to the broadcast operands
+template <typename Op>
+void check(const gooch::Tensor& result, const gooch::Tensor& a, const gooch::Tensor& b, Op op) {
+  std::vector<size_t> shape = result.shape();
+  gooch::Tensor x = gooch::Tensor::Broadcast(a, shape), y = gooch::Tensor::Broadcast(b, shape);
+  for (size_t i = 0; i < shape[0]; i++) {
+    for (size_t j = 0; j < shape[1]; j++) {
+      float expected = op(at(x, i, j), at(y, i, j));
+      assert(fabs(at(result, i, j) - expected) < 1e-5 * (1 + fabs(expected)));
+    }
+  }
+}
+
+void check_all(const gooch::Tensor& a, const gooch::Tensor& b) {
+  check(a + b, a, b, [] (float x, float y) { return x + y; });
+  check(a - b, a, b, [] (float x, float y) { return x - y; });
+  check(a * b, a, b, [] (float x, float y) { return x * y; });
+  check(a / b, a, b, [] (float x, float y) { return x / y; });
+}
+
+int main() {
+  const size_t N = 37, M = 1029;
+  gooch::Tensor full = gooch::randn({N, M});
+  // both contiguous
+  check_all(full, gooch::randn({N, M}));
+  // one value per row
+  check_all(full, gooch::randn({N, 1}));
+  check_all(gooch::randn({N, 1}), full);
+  // one row repeated down the columns
+  check_all(full, gooch::randn({M}));
+  check_all(gooch::randn({1, M}), full);
+  // scalars
+  check_all(full, gooch::FromVector(3.0f));
+  check_all(gooch::FromVector(3.0f), full);
+  // outer product shaped broadcast
+  check_all(gooch::randn({N, 1}), gooch::randn({1, M}));
+  // non-contiguous operand read through its strides
+  gooch::Tensor wide = gooch::randn({N, 2 * M});
+  gooch::Tensor strided = wide(gooch::Slice::all(), gooch::Slice(0, -1, 2));
+  check_all(strided, full);
+  check_all(strided, gooch::randn({N, 1}));
+  return 0;
+}
@@ -0,0 +1,64 @@
+#include "tensor.h"
+#include "helpers.h"
+#include <cassert>
+#include <cmath>
+#include <memory>
+#include <vector>
+
+int main() {
+  const size_t N = 6, D = 7, H = 9;
+  gooch::Tensor x = gooch::randn({N, D});
+  gooch::Tensor w_1 = gooch::randn({H, D}) / gooch::FromVector(3.0f);
+  gooch::Tensor w_2 = gooch::randn({D, H}) / gooch::FromVector(3.0f);
+
+  // a gated block like the demo's, reading weights that are not inputs
+  size_t calls = 0;
+  std::weak_ptr<float> hidden;
+  auto block = [&] (const std::vector<gooch::Tensor>& inputs) {
+    calls++;
+    gooch::Tensor h = gooch::Einsum(inputs[0], w_1, "n d, h d -> n h");
+    hidden = h.data();
+    return gooch::Einsum(h * gooch::exp(-h * h), w_2, "n h, d h -> n d") + inputs[0];
+  };
+
+  gooch::Tensor plain = block({x});
+  gooch::reduceSum(plain * plain, {0, 1}).Backward();
+  std::vector<std::vector<float>> expected;
+  for (gooch::Tensor* t : {&x, &w_1, &w_2}) {
+    expected.emplace_back(t->grad().data().get(), t->grad().data().get() + t->size());
+    t->ZeroGrad();
+  }
+
+  // nothing inside the segment outlives the forward pass
+  gooch::Tensor checkpointed = gooch::Checkpoint(block, {x});
+  assert(calls == 2);
+  assert(hidden.expired());
+  for (size_t i = 0; i < N * D; i++) {
+    assert(at(checkpointed, i) == at(plain, i));
+  }
+
+  // backward runs the segment once more and gives the same gradients
+  gooch::reduceSum(checkpointed * checkpointed, {0, 1}).Backward();
+  assert(calls == 3);
+  std::vector<gooch::Tensor*> tensors = {&x, &w_1, &w_2};
+  for (size_t t = 0; t < tensors.size(); t++) {
+    for (size_t i = 0; i < tensors[t]->size(); i++) {
+      assert(fabs(at(tensors[t]->grad(), i) - expected[t][i]) < 1e-4 * (1 + fabs(expected[t][i])));
+    }
+  }
+
+  // inputs that need no gradient still let the weights get theirs, segments nest
+  w_1.ZeroGrad();
+  x.ZeroGrad();
+  x.SetRequiresGrad(false);
+  auto outer = [&] (const std::vector<gooch::Tensor>& inputs) {
+    return gooch::Checkpoint(block, {inputs[0] * gooch::FromVector(1.0f)});
+  };
+  gooch::Tensor nested = gooch::Checkpoint(outer, {x});
+  gooch::reduceSum(nested * nested, {0, 1}).Backward();
+  for (size_t i = 0; i < x.size(); i++) assert(at(x.grad(), i) == 0);
+  for (size_t i = 0; i < w_1.size(); i++) {
+    assert(fabs(at(w_1.grad(), i) - expected[1][i]) < 1e-4 * (1 + fabs(expected[1][i])));
+  }
+  return 0;
+}
@@ -0,0 +1,100 @@
+#include "tensor.h"
+#include "helpers.h"
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+// the unfused definition, in double precision
+double reference(const std::vector<float>& z, size_t C, size_t i, size_t label, double eps) {
+  double max = -INFINITY;
+  for (size_t j = 0; j < C; j++) max = std::max<double>(max, z[i * C + j]);
+  double sum = 0, total = 0;
+  for (size_t j = 0; j < C; j++) {
+    sum += std::exp(z[i * C + j] - max);
+    total += z[i * C + j];
+  }
+  double lse = max + std::log(sum);
+  return lse - (1 - eps) * z[i * C + label] - eps / C * total;
+}
+
+int main() {
+  // C is not a multiple of any vector width, so the tails are covered
+  const size_t N = 37, C = 23;
+  gooch::Tensor logits = gooch::randn({N, C}) * gooch::FromVector(5.0f);
+  std::vector<float> z(logits.data().get(), logits.data().get() + N * C);
+  std::vector<size_t> labels(N);
+  for (size_t i = 0; i < N; i++) labels[i] = (i * 7) % C;
+
+  for (float eps : {0.0f, 0.1f}) {
+    gooch::Tensor none = gooch::crossEntropyLoss(logits, labels, gooch::Reduction::kNone, eps);
+    gooch::Tensor sum = gooch::crossEntropyLoss(logits, labels, gooch::Reduction::kSum, eps);
+    gooch::Tensor mean = gooch::crossEntropyLoss(logits, labels, gooch::Reduction::kMean, eps);
+    assert(none.shape() == std::vector<size_t>{N});
+    assert(mean.shape().empty());
+    double total = 0;
+    for (size_t i = 0; i < N; i++) {
+      double expected = reference(z, C, i, labels[i], eps);
+      assert(fabs(at(none, i) - expected) < 1e-4 * (1 + fabs(expected)));
+      total += expected;
+    }
+    assert(fabs(at(sum, 0) - total) < 1e-3 * (1 + fabs(total)));
+    assert(fabs(at(mean, 0) - total / N) < 1e-4 * (1 + fabs(total / N)));
+
+    // the closed form gradient matches central differences of the reference
+    logits.ZeroGrad();
+    mean.Backward();
+    for (size_t i = 0; i < N; i += 5) {
+      for (size_t j = 0; j < C; j++) {
+        std::vector<float> plus = z, minus = z;
+        plus[i * C + j] += 1e-2f;
+        minus[i * C + j] -= 1e-2f;
+        double numeric = (reference(plus, C, i, labels[i], eps) - reference(minus, C, i, labels[i], eps)) / (plus[i * C + j] - minus[i * C + j]) / N;
+        assert(fabs(at(logits.grad(), i * C + j) - numeric) < 1e-4);
+      }
+    }
+  }
+
+  // kNone backpropagates a per-row upstream gradient, strided logits are packed
+  gooch::Tensor wide = gooch::randn({N, 2 * C});
+  gooch::Tensor strided = wide(gooch::Slice::all(), gooch::Slice(0, -1, 2));
+  gooch::Tensor weights = gooch::randn({N});
+  gooch::Tensor weighted = gooch::reduceSum(gooch::crossEntropyLoss(strided, labels, gooch::Reduction::kNone) * weights, {0});
+  weighted.Backward();
+  gooch::Tensor unfused = gooch::zeros({});
+  gooch::Tensor copy = gooch::randn({N, C});
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < C; j++) {
+      copy.data().get()[i * C + j] = wide.data().get()[i * 2 * C + 2 * j];
+    }
+  }
+  gooch::Tensor lse = gooch::logSumExp(copy, {1});
+  for (size_t i = 0; i < N; i++) {
+    unfused = unfused + (lse((int) i) - copy((int) i, (int) labels[i])) * weights((int) i);
+  }
+  unfused.Backward();
+  assert(fabs(at(weighted, 0) - at(unfused, 0)) < 1e-3 * (1 + fabs(at(unfused, 0))));
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < C; j++) {
+      float fused = at(wide.grad(), i * 2 * C + 2 * j);
+      assert(fabs(fused - at(copy.grad(), i * C + j)) < 1e-4);
+      assert(at(wide.grad(), i * 2 * C + 2 * j + 1) == 0);
+    }
+  }
+
+  bool thrown = false;
+  try {
+    gooch::crossEntropyLoss(logits, {0, 1}, gooch::Reduction::kMean);
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  assert(thrown);
+  thrown = false;
+  try {
+    gooch::crossEntropyLoss(logits, std::vector<size_t>(N, C), gooch::Reduction::kMean);
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  assert(thrown);
+  return 0;
+}
@@ -0,0 +1,77 @@
+#include "tensor.h"
+#include "data.h"
+#include <cassert>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+int main() {
+  // example i holds i in every feature and i as its label
+  const size_t N = 23, D = 5, B = 4;
+  gooch::Tensor x({N, D}), y({N});
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < D; j++) x.data().get()[i * D + j] = (float) i;
+    y.data().get()[i] = (float) i;
+  }
+
+  // in order without shuffling, the partial batch at the end is dropped
+  {
+    gooch::data::DataLoader loader({x, y}, B, false);
+    assert(loader.batches_per_epoch() == N / B);
+    for (size_t epoch = 0; epoch < 2; epoch++) {
+      for (size_t b = 0; b < loader.batches_per_epoch(); b++) {
+        const std::vector<gooch::Tensor>& batch = loader.Next();
+        assert(batch[0].shape() == std::vector<size_t>({B, D}) && batch[1].shape() == std::vector<size_t>({B}));
+        assert(!batch[0].requires_grad());
+        for (size_t i = 0; i < B; i++) {
+          assert(batch[1].data().get()[i] == (float) (b * B + i));
+        }
+      }
+    }
+  }
+
+  // shuffled, each epoch visits distinct examples in a new order, rows stay together
+  gooch::data::DataLoader loader({x, y}, B, true, 7, 2);
+  std::vector<std::vector<float>> orders;
+  std::set<float*> buffers;
+  for (size_t epoch = 0; epoch < 3; epoch++) {
+    std::vector<float> order;
+    for (size_t b = 0; b < loader.batches_per_epoch(); b++) {
+      const std::vector<gooch::Tensor>& batch = loader.Next();
+      buffers.insert(batch[0].data().get());
+      gooch::Accessor<2> features = batch[0].accessor<2>();
+      for (size_t i = 0; i < B; i++) {
+        float label = batch[1].data().get()[i];
+        for (size_t j = 0; j < D; j++) assert(features(i, j) == label);
+        order.push_back(label);
+      }
+    }
+    assert(std::set<float>(order.begin(), order.end()).size() == order.size());
+    orders.push_back(order);
+  }
+  assert(orders[0] != orders[1] && orders[1] != orders[2]);
+  // the batches cycle through the preallocated buffers
+  assert(buffers.size() == 2);
+
+  // strided sources are packed once
+  gooch::Tensor columns = x(gooch::Slice::all(), gooch::Slice(0, -1, 2));
+  gooch::data::DataLoader strided({columns}, N, false);
+  const gooch::Tensor& all = strided.Next()[0];
+  assert(all.shape() == std::vector<size_t>({N, (D + 1) / 2}));
+  assert(all.data().get()[(N - 1) * ((D + 1) / 2)] == (float) (N - 1));
+
+  // the examples must line up and the batch must fit
+  auto rejects = [] (std::vector<gooch::Tensor> tensors, size_t batch_size) {
+    try {
+      gooch::data::DataLoader bad(tensors, batch_size);
+    } catch (const std::invalid_argument&) {
+      return true;
+    }
+    return false;
+  };
+  assert(rejects({x, gooch::zeros({N - 1})}, B));
+  assert(rejects({x}, N + 1));
+  assert(rejects({x}, 0));
+  assert(rejects({}, B));
+  return 0;
+}
@@ -0,0 +1,160 @@
+#include "tensor.h"
+#include "helpers.h"
+#include "glas.h"
+#include "kernels.h"
+#include "sgd.cc"
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+// reads element i of a contiguous bfloat16 tensor
+float at_bf16(const gooch::Tensor& t, size_t i) {
+  return gooch::bf16_to_float(t.half_data().get()[t.offset() + i]);
+}
+
+// float32 to bfloat16 and back, what storing a float32 result costs
+float round_bf16(float x) {
+  return gooch::bf16_to_float(gooch::float_to_bf16(x));
+}
+
+int main() {
+  // the scalar conversions round to nearest even and keep specials
+  assert(gooch::float_to_bf16(1.0f) == 0x3f80);
+  assert(gooch::float_to_bf16(1.0f + 1.0f / 256) == 0x3f80); // a tie, to even
+  assert(gooch::float_to_bf16(1.0f + 3.0f / 256) == 0x3f82);
+  assert(std::isnan(gooch::bf16_to_float(gooch::float_to_bf16(NAN))));
+  assert(gooch::float_to_fp16(1.0f) == 0x3c00);
+  assert(gooch::float_to_fp16(65504.0f) == 0x7bff);
+  assert(gooch::float_to_fp16(65520.0f) == 0x7c00);
+  assert(gooch::float_to_fp16(-0.0f) == 0x8000);
+  assert(gooch::float_to_fp16(5.9604644775390625e-8f) == 0x0001);
+  assert(gooch::fp16_to_float(0x0001) == 5.9604644775390625e-8f);
+  assert(gooch::fp16_to_float(0x7bff) == 65504.0f);
+  assert(std::isnan(gooch::fp16_to_float(gooch::float_to_fp16(NAN))));
+
+  // every vector path converts exactly like the scalar one, tails included
+  std::default_random_engine generator;
+  std::uniform_real_distribution<float> exponent(-30.0f, 20.0f);
+  const size_t N = 1001;
+  std::vector<float> values(N);
+  for (size_t i = 0; i < N; i++) values[i] = (i % 2 ? -1.0f : 1.0f) * std::exp2(exponent(generator));
+  values[0] = 0.0f;
+  values[1] = INFINITY;
+  values[2] = 1e6f;
+  values[3] = 3e-8f;
+  for (auto isa : {gooch::kernels::Isa::kSse, gooch::kernels::Isa::kAvx2, gooch::kernels::Isa::kAvx512}) {
+    if (!gooch::kernels::Supported(isa)) continue;
+    gooch::kernels::Select(isa);
+    const gooch::kernels::Table& k = gooch::kernels::Get();
+    std::vector<uint16_t> bf16(N), fp16(N);
+    std::vector<float> back(N);
+    k.float_to_bf16(N, values.data(), bf16.data());
+    k.float_to_fp16(N, values.data(), fp16.data());
+    for (size_t i = 0; i < N; i++) {
+      assert(bf16[i] == gooch::float_to_bf16(values[i]));
+      assert(fp16[i] == gooch::float_to_fp16(values[i]));
+    }
+    k.bf16_to_float(N, bf16.data(), back.data());
+    for (size_t i = 0; i < N; i++) assert(back[i] == gooch::bf16_to_float(bf16[i]));
+    k.fp16_to_float(N, fp16.data(), back.data());
+    for (size_t i = 0; i < N; i++) assert(back[i] == gooch::fp16_to_float(fp16[i]));
+  }
+
+  // casts keep the relative error within half an ulp of the format
+  gooch::Tensor x = gooch::randn({37, 45});
+  gooch::Tensor y = gooch::randn({45});
+  gooch::Tensor x_bf16 = gooch::cast(x, gooch::DType::kBFloat16);
+  gooch::Tensor x_fp16 = gooch::cast(x, gooch::DType::kFloat16);
+  assert(x_bf16.dtype() == gooch::DType::kBFloat16);
+  gooch::Tensor x_back = gooch::cast(x_fp16, gooch::DType::kFloat32);
+  for (size_t i = 0; i < 37 * 45; i++) {
+    assert(fabs(at_bf16(x_bf16, i) - at(x, i)) <= fabs(at(x, i)) / 256);
+    assert(fabs(at(x_back, i) - at(x, i)) <= fabs(at(x, i)) / 2048 + 6e-8f);
+  }
+
+  // elementwise ops read reduced precision, compute in float32 and store it back
+  gooch::Tensor y_bf16 = gooch::cast(y, gooch::DType::kBFloat16);
+  gooch::Tensor sum = x_bf16 + y_bf16;
+  gooch::Tensor product = x_bf16 * gooch::cast(gooch::FromVector(2.0f), gooch::DType::kBFloat16);
+  gooch::Tensor mixed = x_bf16 - y;
+  gooch::Tensor e = gooch::exp(x_bf16);
+  assert(sum.dtype() == gooch::DType::kBFloat16 && e.dtype() == gooch::DType::kBFloat16);
+  assert(mixed.dtype() == gooch::DType::kFloat32);
+  for (size_t i = 0; i < 37; i++) {
+    for (size_t j = 0; j < 45; j++) {
+      float xv = at_bf16(x_bf16, i * 45 + j), yv = at_bf16(y_bf16, j);
+      assert(at_bf16(sum, i * 45 + j) == round_bf16(xv + yv));
+      assert(at_bf16(product, i * 45 + j) == round_bf16(2 * xv));
+      assert(at(mixed, i * 45 + j) == xv - at(y, j));
+      assert(fabs(at_bf16(e, i * 45 + j) - std::exp(xv)) <= std::exp(xv) / 128);
+    }
+  }
+
+  // strided reduced precision views, and ops that widen the whole tensor
+  gooch::Tensor column = x_bf16(gooch::Slice::all(), gooch::Slice(3));
+  gooch::Tensor doubled = column + column;
+  for (size_t i = 0; i < 37; i++) assert(at_bf16(doubled, i) == round_bf16(2 * at_bf16(x_bf16, i * 45 + 3)));
+  gooch::Tensor rows = gooch::reduceSum(x_bf16, {1});
+  for (size_t i = 0; i < 37; i++) {
+    float expected = 0;
+    for (size_t j = 0; j < 45; j++) expected += at_bf16(x_bf16, i * 45 + j);
+    assert(fabs(at(rows, i) - expected) < 1e-4);
+  }
+
+  // einsum accumulates in float32 and stores its result in the operands' type
+  gooch::Tensor w = gooch::randn({45, 19});
+  gooch::Tensor w_bf16 = gooch::cast(w, gooch::DType::kBFloat16);
+  gooch::Tensor c = gooch::Einsum(x_bf16, w_bf16, "n k, k m -> n m");
+  assert(c.dtype() == gooch::DType::kBFloat16);
+  for (size_t i = 0; i < 37; i++) {
+    for (size_t m = 0; m < 19; m++) {
+      double expected = 0;
+      for (size_t k = 0; k < 45; k++) expected += (double) at_bf16(x_bf16, i * 45 + k) * at_bf16(w_bf16, k * 19 + m);
+      assert(fabs(at_bf16(c, i * 19 + m) - expected) <= fabs(expected) / 128 + 1e-5);
+    }
+  }
+
+  // mixed precision: float32 master weights, a bfloat16 forward, float32 gradients
+  gooch::Tensor target = gooch::randn({37, 19});
+  gooch::Tensor master = gooch::randn({45, 19});
+  gooch::Adam adam({master}, 1e-2f);
+  float first = 0, last = 0;
+  for (int step = 0; step < 50; step++) {
+    gooch::Tensor prediction = gooch::Einsum(x_bf16, gooch::cast(master, gooch::DType::kBFloat16), "n k, k m -> n m");
+    gooch::Tensor error = gooch::cast(prediction, gooch::DType::kFloat32) - target;
+    gooch::Tensor loss = gooch::reduceMean(error * error, {0, 1});
+    master.ZeroGrad();
+    loss.Backward();
+    assert(master.dtype() == gooch::DType::kFloat32);
+    adam.step();
+    if (step == 0) first = at(loss, 0);
+    last = at(loss, 0);
+  }
+  assert(last < 0.9f * first);
+
+  // reduced precision tensors are read only, every in-place writer rejects them
+  gooch::Tensor x_fp16_rows = gooch::cast(gooch::zeros({3, 45}), gooch::DType::kFloat16);
+  gooch::Tensor rows_index = gooch::FromVector(std::vector<float>{0, 2});
+  std::vector<std::function<void()>> writes = {
+    [&] { gooch::View view = x_bf16(0); view = gooch::zeros({45}); },
+    [&] { gooch::glas::add_(gooch::ones({37, 45}), x_fp16); },
+    [&] { gooch::glas::index_add_(x_fp16_rows, 0, rows_index, gooch::ones({2, 45})); },
+    [&] { gooch::glas::scatter_add_(x_fp16_rows, 0, gooch::zeros({1, 45}), gooch::ones({1, 45})); },
+    [&] { gooch::Adam optimizer({w_bf16}, 1e-2f); },
+    [&] { gooch::SGD optimizer({w_bf16}, 1e-2f); },
+  };
+  for (const std::function<void()>& write : writes) {
+    bool thrown = false;
+    try {
+      write();
+    } catch (const std::invalid_argument&) {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+  return 0;
+}
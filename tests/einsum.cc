@@ -0,0 +1,123 @@
+#include "tensor.h"
+#include "glas.h"
+#include <cassert>
+#include <cmath>
+
+// element (i, j, k) of a tensor through its strides
+float at(const gooch::Tensor& t, std::vector<size_t> index) {
+  float* data = t.data().get() + t.offset();
+  for (size_t d = 0; d < index.size(); d++) {
+    data += index[d] * t.strides()[d];
+  }
+  return *data;
+}
+
+int main() {
+  const size_t B = 3, M = 37, N = 45, K = 300;
+  gooch::Tensor x = gooch::randn({M, K});
+  gooch::Tensor w = gooch::randn({N, K});
+  gooch::Tensor g = gooch::randn({M, N});
+  gooch::Tensor bx = gooch::randn({B, M, K});
+  gooch::Tensor bw = gooch::randn({B, K, N});
+
+  // the einsums that show up in a linear layer and its backward
+  gooch::Tensor y = gooch::glas::einsum(x, w, "m k, n k -> m n");
+  gooch::Tensor dx = gooch::glas::einsum(g, w, "m n, n k -> m k");
+  gooch::Tensor dw = gooch::glas::einsum(g, x, "m n, m k -> n k");
+  gooch::Tensor yt = gooch::glas::einsum(x, w, "m k, n k -> n m");
+  gooch::Tensor by = gooch::glas::einsum(bx, bw, "b m k, b k n -> b m n");
+
+  for (size_t i = 0; i < M; i++) {
+    for (size_t j = 0; j < N; j++) {
+      float expected = 0;
+      for (size_t k = 0; k < K; k++) {
+        expected += at(x, {i, k}) * at(w, {j, k});
+      }
+      assert(fabs(at(y, {i, j}) - expected) < 1e-3);
+      assert(fabs(at(yt, {j, i}) - expected) < 1e-3);
+    }
+  }
+  for (size_t i = 0; i < M; i++) {
+    for (size_t k = 0; k < K; k++) {
+      float expected = 0;
+      for (size_t j = 0; j < N; j++) {
+        expected += at(g, {i, j}) * at(w, {j, k});
+      }
+      assert(fabs(at(dx, {i, k}) - expected) < 1e-3);
+    }
+  }
+  for (size_t j = 0; j < N; j++) {
+    for (size_t k = 0; k < K; k++) {
+      float expected = 0;
+      for (size_t i = 0; i < M; i++) {
+        expected += at(g, {i, j}) * at(x, {i, k});
+      }
+      assert(fabs(at(dw, {j, k}) - expected) < 1e-3);
+    }
+  }
+  for (size_t b = 0; b < B; b++) {
+    for (size_t i = 0; i < M; i++) {
+      for (size_t j = 0; j < N; j++) {
+        float expected = 0;
+        for (size_t k = 0; k < K; k++) {
+          expected += at(bx, {b, i, k}) * at(bw, {b, k, j});
+        }
+        assert(fabs(at(by, {b, i, j}) - expected) < 1e-3);
+      }
+    }
+  }
+
+  // a matrix-vector product is a matrix multiply with a single column
+  gooch::Tensor v = w(gooch::Slice(0, 0));
+  assert(gooch::glas::parse_einsum("m k, k -> m").plan(x.shape(), x.strides(), v.shape(), v.strides())->gemm);
+  gooch::Tensor s = gooch::glas::einsum(x, v, "m k, k -> m");
+  for (size_t i = 0; i < M; i++) {
+    float expected = 0;
+    for (size_t k = 0; k < K; k++) {
+      expected += at(x, {i, k}) * at(w, {0, k});
+    }
+    assert(fabs(at(s, {i}) - expected) < 1e-3);
+  }
+  // a contraction that sums a label out of one operand goes through the generic path
+  assert(!gooch::glas::parse_einsum("m k, m n -> k").plan(x.shape(), x.strides(), g.shape(), g.strides())->gemm);
+  gooch::Tensor t = gooch::glas::einsum(x, g, "m k, m n -> k");
+  for (size_t k = 0; k < K; k++) {
+    float expected = 0;
+    for (size_t i = 0; i < M; i++) {
+      float row = 0;
+      for (size_t j = 0; j < N; j++) {
+        row += at(g, {i, j});
+      }
+      expected += at(x, {i, k}) * row;
+    }
+    assert(fabs(at(t, {k}) - expected) < 1e-3);
+  }
+
+  // equations and plans are compiled once and reused
+  const gooch::glas::EinsumEquation& parsed = gooch::glas::parse_einsum("m k, n k -> m n");
+  assert(&parsed == &gooch::glas::parse_einsum("m k, n k -> m n"));
+  assert(parsed.plan(x.shape(), x.strides(), w.shape(), w.strides()) == parsed.plan(x.shape(), x.strides(), w.shape(), w.strides()));
+  assert(parsed.plan(x.shape(), x.strides(), w.shape(), w.strides())->gemm);
+  // only the most recently used layouts are kept
+  std::shared_ptr<const gooch::glas::EinsumPlan> first = parsed.plan(x.shape(), x.strides(), w.shape(), w.strides());
+  std::shared_ptr<const gooch::glas::EinsumPlan> last;
+  for (size_t rows = 1; rows <= gooch::glas::kMaxEinsumPlans; rows++) {
+    gooch::Tensor batch = gooch::zeros({rows, K});
+    last = parsed.plan(batch.shape(), batch.strides(), w.shape(), w.strides());
+  }
+  gooch::Tensor batch = gooch::zeros({gooch::glas::kMaxEinsumPlans, K});
+  assert(parsed.plan(batch.shape(), batch.strides(), w.shape(), w.strides()) == last);
+  assert(parsed.plan(x.shape(), x.strides(), w.shape(), w.strides()) != first);
+
+  // a label summed out of one operand still has a gradient
+  gooch::Tensor p = gooch::ones({2, 3});
+  gooch::Tensor q = gooch::FromVector(std::vector<float>{1, 2});
+  gooch::Tensor r = gooch::reduceSum(gooch::Einsum(p, q, "i j, i -> i"), {0});
+  r.Backward();
+  for (size_t j = 0; j < 3; j++) {
+    assert(fabs(at(p.grad(), {0, j}) - 1.0f) < 1e-6);
+    assert(fabs(at(p.grad(), {1, j}) - 2.0f) < 1e-6);
+  }
+  assert(fabs(at(q.grad(), {1}) - 3.0f) < 1e-6);
+  return 0;
+}
@@ -0,0 +1,86 @@
+#include "tensor.h"
+#include "helpers.h"
+#include "fusion.h"
+#include "allocator.h"
+#include <cassert>
+#include <cmath>
+
+// every elementwise op, with broadcasting and a shared subexpression
+gooch::Tensor expression(const gooch::Tensor& x, const gooch::Tensor& y, const gooch::Tensor& m) {
+  gooch::Tensor d = y - x * m;
+  gooch::Tensor e = gooch::exp(-d * d) + gooch::log(y * y + m * m + gooch::ones({1}));
+  return gooch::root(e) / (gooch::inv(m * m + y * y) + x);
+}
+
+int main() {
+  const size_t N = 37, M = 300;
+  gooch::Tensor x = gooch::randn({N, M});
+  gooch::Tensor y = gooch::randn({M}) + gooch::ones({M});
+  gooch::Tensor m = gooch::randn({N, 1});
+
+  gooch::Tensor eager = expression(x, y, m);
+  gooch::Tensor eager_sum = gooch::reduceSum(eager, {0, 1});
+  gooch::allocator::Stats before = gooch::allocator::GetStats();
+  eager_sum.Backward();
+  gooch::allocator::Stats after = gooch::allocator::GetStats();
+  size_t eager_allocations = after.hits + after.misses - before.hits - before.misses;
+  gooch::Tensor x_grad = x.grad(), y_grad = y.grad(), m_grad = m.grad();
+  std::vector<float> expected_x(x_grad.data().get(), x_grad.data().get() + N * M);
+  std::vector<float> expected_y(y_grad.data().get(), y_grad.data().get() + M);
+  std::vector<float> expected_m(m_grad.data().get(), m_grad.data().get() + N);
+  x.ZeroGrad();
+  y.ZeroGrad();
+  m.ZeroGrad();
+
+  gooch::Tensor lazy = gooch::zeros({});
+  {
+    gooch::fusion::LazyMode mode;
+    lazy = expression(x, y, m);
+    // nothing has been computed yet
+    assert(lazy.expr() != nullptr);
+  }
+  for (size_t i = 0; i < N * M; i++) {
+    assert(fabs(at(lazy, i) - at(eager, i)) < 1e-4 * (1 + fabs(at(eager, i))));
+  }
+  // evaluated once, later reads see the same buffer
+  assert(lazy.data() == lazy.data());
+
+  // backward is fused as well, it keeps no full-size temporary per node of the region
+  gooch::Tensor lazy_sum = gooch::reduceSum(lazy, {0, 1});
+  before = gooch::allocator::GetStats();
+  lazy_sum.Backward();
+  after = gooch::allocator::GetStats();
+  assert(after.hits + after.misses - before.hits - before.misses < eager_allocations);
+  for (size_t i = 0; i < N * M; i++) {
+    assert(fabs(at(x.grad(), i) - expected_x[i]) < 1e-3 * (1 + fabs(expected_x[i])));
+  }
+  for (size_t i = 0; i < M; i++) {
+    assert(fabs(at(y.grad(), i) - expected_y[i]) < 1e-3 * (1 + fabs(expected_y[i])));
+  }
+  for (size_t i = 0; i < N; i++) {
+    assert(fabs(at(m.grad(), i) - expected_m[i]) < 1e-3 * (1 + fabs(expected_m[i])));
+  }
+
+  // long chains are split into bounded regions and still differentiate
+  gooch::Tensor w = gooch::FromVector(2.0f);
+  gooch::Tensor loss = gooch::zeros({});
+  {
+    gooch::fusion::LazyMode mode;
+    for (int i = 0; i < 1000; i++) {
+      loss = loss + w * w;
+    }
+  }
+  loss.Backward();
+  assert(fabs(at(loss, 0) - 4000.0f) < 1e-1);
+  assert(fabs(at(w.grad(), 0) - 4000.0f) < 1e-1);
+
+  // an empty last dimension evaluates to an empty buffer, as it does eagerly
+  gooch::Tensor empty = gooch::zeros({});
+  {
+    gooch::fusion::LazyMode mode;
+    empty = gooch::Tensor({3, 0}) + gooch::Tensor({3, 0});
+  }
+  empty.data();
+  assert(empty.shape() == std::vector<size_t>({3, 0}));
+  return 0;
+}
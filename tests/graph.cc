@@ -0,0 +1,141 @@
+#include "tensor.h"
+#include "helpers.h"
+#include "graph.h"
+#include "fusion.h"
+#include "allocator.h"
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+// a layer of most ops, the labels are the second input
+gooch::Tensor loss_of(const std::vector<gooch::Tensor>& inputs, const gooch::Tensor& w, const gooch::Tensor& v) {
+  gooch::Tensor h = gooch::Einsum(inputs[0], w, "n i, o i -> n o");
+  size_t n = h.shape()[0];
+  gooch::Tensor mean = gooch::reshape(gooch::reduceMean(h, {1}), {n, 1});
+  gooch::Tensor std = gooch::reshape(gooch::root(gooch::variance(h, {1}) + gooch::ones({1})), {n, 1});
+  gooch::Tensor normed = (h - mean) / std;
+  gooch::Tensor logits = gooch::exp(-normed * v) + normed;
+  gooch::Tensor loss = gooch::crossEntropyLoss(logits, inputs[1], gooch::Reduction::kMean);
+  return loss + gooch::reduceSum(gooch::logSumExp(logits, {1}), {0}) * gooch::FromVector(0.01f);
+}
+
+// a batch of random rows with labels in [0, C)
+std::vector<gooch::Tensor> batch(size_t N, size_t M, size_t C, size_t seed) {
+  gooch::Tensor x({N, M}), y({N});
+  for (size_t i = 0; i < N * M; i++) x.data().get()[i] = std::sin(0.37f * (i + 1) * (seed + 1));
+  for (size_t i = 0; i < N; i++) y.data().get()[i] = (float) ((i * 7 + seed) % C);
+  x.SetRequiresGrad(false);
+  y.SetRequiresGrad(false);
+  return {x, y};
+}
+
+int main() {
+  const size_t N = 12, M = 20, C = 6, STEPS = 5;
+  // randn starts from the same seed every call, so both copies of the weights start equal
+  gooch::Tensor w = gooch::randn({C, M});
+  gooch::Tensor v = gooch::randn({C}) * gooch::FromVector(0.1f);
+  gooch::Tensor w_eager = gooch::randn({C, M});
+  gooch::Tensor v_eager = gooch::randn({C}) * gooch::FromVector(0.1f);
+  v.SetRequiresGrad(true);
+  v_eager.SetRequiresGrad(true);
+  v.ZeroGrad();
+  v_eager.ZeroGrad();
+  // a plain step, applied to both copies of the weights
+  auto sgd = [] (gooch::Tensor& p) {
+    for (size_t i = 0; i < p.size(); i++) p.data().get()[i] -= 0.1f * at(p.grad(), i);
+    p.ZeroGrad();
+  };
+
+  gooch::graph::StepGraph step([&] (const std::vector<gooch::Tensor>& inputs) {
+    return loss_of(inputs, w, v);
+  }, [&] {
+    sgd(w);
+    sgd(v);
+  });
+  gooch::Tensor captured = gooch::zeros({});
+  for (size_t s = 0; s < STEPS; s++) {
+    std::vector<gooch::Tensor> inputs = batch(N, M, C, s);
+    gooch::Tensor loss = step.Step(inputs);
+    if (s == 0) captured = loss;
+    // a replay refreshes the captured loss in place
+    assert(s == 0 || loss.data() == captured.data());
+
+    gooch::Tensor expected = loss_of(inputs, w_eager, v_eager);
+    expected.Backward();
+    sgd(w_eager);
+    sgd(v_eager);
+    assert(fabs(at(loss, 0) - at(expected, 0)) < 1e-4 * (1 + fabs(at(expected, 0))));
+    for (size_t i = 0; i < C * M; i++) {
+      assert(fabs(at(w, i) - at(w_eager, i)) < 1e-4);
+    }
+    for (size_t i = 0; i < C; i++) {
+      assert(fabs(at(v, i) - at(v_eager, i)) < 1e-4);
+    }
+  }
+  assert(step.replays() == STEPS - 1);
+
+  // a different batch size is captured again and then replayed
+  for (size_t s = 0; s < 2; s++) {
+    std::vector<gooch::Tensor> inputs = batch(N / 2, M, C, s);
+    gooch::Tensor loss = step.Step(inputs);
+    gooch::Tensor expected = loss_of(inputs, w_eager, v_eager);
+    expected.Backward();
+    sgd(w_eager);
+    sgd(v_eager);
+    assert(fabs(at(loss, 0) - at(expected, 0)) < 1e-4 * (1 + fabs(at(expected, 0))));
+  }
+  assert(step.replays() == STEPS);
+
+  // a replay refreshes every result in its captured buffer, so it allocates
+  // only what its backward pass does, and all of that comes from the cache
+  std::vector<gooch::Tensor> next = batch(N / 2, M, C, 2);
+  gooch::allocator::Stats before = gooch::allocator::GetStats();
+  gooch::Tensor replayed = step.Step(next);
+  gooch::allocator::Stats after_step = gooch::allocator::GetStats();
+  replayed.Backward();
+  gooch::allocator::Stats after_backward = gooch::allocator::GetStats();
+  assert(step.replays() == STEPS + 1);
+  assert(after_step.misses == before.misses);
+  size_t step_allocations = after_step.hits + after_step.misses - before.hits - before.misses;
+  size_t backward_allocations = after_backward.hits + after_backward.misses - after_step.hits - after_step.misses;
+  assert(step_allocations == backward_allocations);
+
+  // labels out of range are caught on replay as well
+  std::vector<gooch::Tensor> bad = batch(N / 2, M, C, 0);
+  bad[1].data().get()[0] = (float) C;
+  bool thrown = false;
+  try {
+    step.Step(bad);
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  // a loss of more than one element is rejected before anything is captured
+  gooch::graph::StepGraph wide([&] (const std::vector<gooch::Tensor>& inputs) {
+    return gooch::Einsum(inputs[0], w, "n i, o i -> n o");
+  }, nullptr);
+  thrown = false;
+  try {
+    wide.Step(batch(N, M, C, 0));
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  // a step with an op that cannot be replayed always runs eagerly
+  gooch::graph::StepGraph lazy([&] (const std::vector<gooch::Tensor>& inputs) {
+    gooch::Tensor h = gooch::Einsum(inputs[0], w, "n i, o i -> n o");
+    gooch::fusion::LazyMode mode;
+    return gooch::crossEntropyLoss(h * h, inputs[1], gooch::Reduction::kSum);
+  }, [&] { w.ZeroGrad(); });
+  for (size_t s = 0; s < 3; s++) {
+    std::vector<gooch::Tensor> inputs = batch(N, M, C, s);
+    gooch::Tensor loss = lazy.Step(inputs);
+    gooch::Tensor h = gooch::Einsum(inputs[0], w, "n i, o i -> n o");
+    gooch::Tensor expected = gooch::crossEntropyLoss(h * h, inputs[1], gooch::Reduction::kSum);
+    assert(fabs(at(loss, 0) - at(expected, 0)) < 1e-4 * (1 + fabs(at(expected, 0))));
+  }
+  assert(lazy.replays() == 0);
+  return 0;
+}
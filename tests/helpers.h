@@ -0,0 +1,10 @@
+#pragma once
+
+#include "tensor.h"
+
+#include <cstddef>
+
+// reads element i of a contiguous float32 tensor
+inline float at(const gooch::Tensor& t, size_t i) {
+  return t.data().get()[t.offset() + i];
+}
@@ -0,0 +1,121 @@
+#include "tensor.h"
+#include <cassert>
+#include <cmath>
+#include <stdexcept>
+#include <vector>
+
+// a float tensor of indices, which needs no gradient
+gooch::Tensor indices(std::vector<size_t> shape, const std::vector<float>& values) {
+  gooch::Tensor t(shape);
+  std::copy(values.begin(), values.end(), t.data().get());
+  t.SetRequiresGrad(false);
+  return t;
+}
+
+// throws std::invalid_argument
+template <typename F>
+bool rejects(F f) {
+  try {
+    f();
+  } catch (const std::invalid_argument&) {
+    return true;
+  }
+  return false;
+}
+
+int main() {
+  const size_t N = 5, M = 4, D = 3;
+  gooch::Tensor a = gooch::randn({N, M, D});
+  gooch::Accessor<3> x = a.accessor<3>();
+
+  // rows 3, 0 and 3 again along the first axis
+  gooch::Tensor rows = indices({3}, {3, 0, 3});
+  gooch::Tensor selected = gooch::index_select(a, 0, rows);
+  assert(selected.shape() == std::vector<size_t>({3, M, D}));
+  gooch::Accessor<3> s = selected.accessor<3>();
+  for (size_t k = 0; k < 3; k++) {
+    for (size_t j = 0; j < M; j++) {
+      for (size_t d = 0; d < D; d++) {
+        assert(s(k, j, d) == x((size_t) rows.data().get()[k], j, d));
+      }
+    }
+  }
+  // the repeated row collects both gradients, unselected rows get none
+  gooch::reduceSum(selected, {0, 1, 2}).Backward();
+  gooch::Accessor<3> g = a.grad().accessor<3>();
+  for (size_t i = 0; i < N; i++) {
+    float expected = i == 3 ? 2.0f : i == 0 ? 1.0f : 0.0f;
+    for (size_t j = 0; j < M; j++) {
+      for (size_t d = 0; d < D; d++) assert(g(i, j, d) == expected);
+    }
+  }
+  a.ZeroGrad();
+
+  // one element per (row, depth) along the middle axis, on a strided view
+  gooch::Tensor b = a(gooch::Slice::all(), gooch::Slice::all(), gooch::Slice(0, -1, 2));
+  gooch::Accessor<3> y = b.accessor<3>();
+  std::vector<float> picks;
+  for (size_t i = 0; i < N; i++) {
+    for (size_t k = 0; k < 2; k++) {
+      for (size_t d = 0; d < 2; d++) picks.push_back((float) ((i + k + d) % M));
+    }
+  }
+  gooch::Tensor index = indices({N, 2, 2}, picks);
+  gooch::Tensor gathered = gooch::gather(b, 1, index);
+  gooch::Accessor<3> r = gathered.accessor<3>();
+  gooch::Accessor<3> idx = index.accessor<3>();
+  for (size_t i = 0; i < N; i++) {
+    for (size_t k = 0; k < 2; k++) {
+      for (size_t d = 0; d < 2; d++) assert(r(i, k, d) == y(i, (size_t) idx(i, k, d), d));
+    }
+  }
+  // the gradient scatters back through the view into a's even depths
+  gooch::Tensor weights = gooch::randn({N, 2, 2});
+  gooch::reduceSum(gathered * weights, {0, 1, 2}).Backward();
+  gooch::Accessor<3> ga = a.grad().accessor<3>();
+  gooch::Accessor<3> w = weights.accessor<3>();
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < M; j++) {
+      for (size_t d = 0; d < D; d++) {
+        float expected = 0.0f;
+        for (size_t k = 0; d % 2 == 0 && k < 2; k++) {
+          if ((size_t) idx(i, k, d / 2) == j) expected += w(i, k, d / 2);
+        }
+        assert(fabs(ga(i, j, d) - expected) < 1e-6);
+      }
+    }
+  }
+  a.ZeroGrad();
+
+  // scatter_add accumulates repeats, its source's gradient is gathered back
+  gooch::Tensor base = gooch::zeros({N, M});
+  gooch::Tensor src = gooch::ones({N, 3});
+  gooch::Tensor targets = indices({N, 3}, {0, 0, 1, 1, 2, 3, 3, 3, 3, 0, 1, 2, 2, 2, 0});
+  gooch::Tensor scattered = gooch::scatter_add(base, 1, targets, src);
+  gooch::Accessor<2> c = scattered.accessor<2>();
+  gooch::Accessor<2> t = targets.accessor<2>();
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < M; j++) {
+      float count = 0.0f;
+      for (size_t k = 0; k < 3; k++) count += (size_t) t(i, k) == j ? 1.0f : 0.0f;
+      assert(c(i, j) == count);
+    }
+  }
+  gooch::Tensor scale = gooch::randn({N, M});
+  gooch::reduceSum(scattered * scale, {0, 1}).Backward();
+  gooch::Accessor<2> sg = src.grad().accessor<2>();
+  gooch::Accessor<2> bg = base.grad().accessor<2>();
+  gooch::Accessor<2> sc = scale.accessor<2>();
+  for (size_t i = 0; i < N; i++) {
+    for (size_t k = 0; k < 3; k++) assert(sg(i, k) == sc(i, (size_t) t(i, k)));
+    for (size_t j = 0; j < M; j++) assert(bg(i, j) == sc(i, j));
+  }
+
+  // indices must be whole, in range, and shaped for the op
+  assert(rejects([&] { gooch::index_select(a, 0, indices({1}, {(float) N})); }));
+  assert(rejects([&] { gooch::index_select(a, 0, indices({1}, {0.5f})); }));
+  assert(rejects([&] { gooch::index_select(a, 3, rows); }));
+  assert(rejects([&] { gooch::gather(a, 1, indices({N, 2}, std::vector<float>(2 * N))); }));
+  assert(rejects([&] { gooch::scatter_add(base, 1, targets, gooch::ones({N, 2})); }));
+  return 0;
+}
@@ -0,0 +1,83 @@
+#include "tensor.h"
+#include "io.h"
+#include <cassert>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+int main() {
+  std::string path = (std::filesystem::temp_directory_path() / "gooch_io_test.tensor").string();
+
+  // a strided view is written in row-major order and comes back contiguous
+  gooch::Tensor a = gooch::randn({6, 5});
+  gooch::Tensor columns = a(gooch::Slice::all(), gooch::Slice(0, -1, 2));
+  gooch::io::Save(columns, path);
+  gooch::Tensor loaded = gooch::io::Load(path);
+  assert(loaded.shape() == std::vector<size_t>({6, 3}) && loaded.is_contiguous());
+  assert(loaded.dtype() == gooch::DType::kFloat32);
+  // the payload is the aligned mapping itself
+  assert((uintptr_t) loaded.data().get() % gooch::allocator::kAlignment == 0);
+  gooch::Accessor<2> x = columns.accessor<2>(), y = loaded.accessor<2>();
+  for (size_t i = 0; i < 6; i++) {
+    for (size_t j = 0; j < 3; j++) assert(x(i, j) == y(i, j));
+  }
+  // writes stay in memory, the file keeps what was saved
+  y(0, 0) = 42.0f;
+  gooch::Tensor reloaded = gooch::io::Load(path);
+  assert(reloaded.accessor<2>()(0, 0) == x(0, 0));
+
+  // the mapping outlives the handle that loaded it through the tensors sharing it
+  gooch::Tensor row = reloaded(gooch::Slice(5));
+  reloaded = gooch::zeros({1});
+  assert(row.accessor<1>()(2) == x(5, 2));
+
+  // reduced precision keeps its bits, scalars and empty tensors round trip
+  gooch::Tensor half = gooch::cast(a, gooch::DType::kBFloat16);
+  gooch::io::Save(half, path);
+  gooch::Tensor half_loaded = gooch::io::Load(path);
+  assert(half_loaded.dtype() == gooch::DType::kBFloat16 && half_loaded.shape() == half.shape());
+  for (size_t i = 0; i < 30; i++) assert(half_loaded.half_data().get()[i] == half.half_data().get()[i]);
+  gooch::io::Save(gooch::FromVector(7.0f), path);
+  gooch::Tensor scalar = gooch::io::Load(path);
+  assert(scalar.shape().empty() && *scalar.data() == 7.0f);
+  gooch::io::Save(gooch::zeros({3, 0}), path);
+  assert(gooch::io::Load(path).shape() == std::vector<size_t>({3, 0}));
+
+  // anything else is rejected
+  {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out << "label,p0,p1\n7,0,255\n" << std::string(64, ' ');
+  }
+  bool thrown = false;
+  try {
+    gooch::io::Load(path);
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  assert(thrown);
+  // a shape whose element count overflows is rejected rather than read past the payload
+  gooch::io::Save(gooch::zeros({2, 4}), path);
+  {
+    std::fstream out(path, std::ios::binary | std::ios::in | std::ios::out);
+    uint64_t huge = uint64_t(1) << 62;
+    out.seekp(32);
+    out.write(reinterpret_cast<const char*>(&huge), sizeof(huge));
+  }
+  thrown = false;
+  try {
+    gooch::io::Load(path);
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  assert(thrown);
+  std::filesystem::remove(path);
+  thrown = false;
+  try {
+    gooch::io::Load(path);
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  assert(thrown);
+  return 0;
+}
@@ -0,0 +1,97 @@
+#include "kernels.h"
+#include <cassert>
+#include <cmath>
+#include <random>
+#include <vector>
+
+bool close(float a, float b) {
+  return fabs(a - b) <= 1e-4 * (1 + fabs(b));
+}
+
+// every table the CPU supports agrees with the scalar definitions, including tails
+void check(gooch::kernels::Isa isa) {
+  gooch::kernels::Select(isa);
+  const gooch::kernels::Table& k = gooch::kernels::Get();
+  assert(k.isa == isa);
+
+  std::default_random_engine generator;
+  std::uniform_real_distribution<float> d(0.5f, 2.0f);
+  const size_t N = 77;
+  std::vector<float> x(N), y(N), out(N);
+  for (size_t i = 0; i < N; i++) {
+    x[i] = d(generator);
+    y[i] = d(generator);
+  }
+
+  k.add(N, x.data(), 1, y.data(), 1, out.data());
+  for (size_t i = 0; i < N; i++) assert(close(out[i], x[i] + y[i]));
+  k.sub(N, x.data(), 1, y.data(), 0, out.data());
+  for (size_t i = 0; i < N; i++) assert(close(out[i], x[i] - y[0]));
+  k.mul(N, x.data(), 0, y.data(), 1, out.data());
+  for (size_t i = 0; i < N; i++) assert(close(out[i], x[0] * y[i]));
+  k.div(N / 2, x.data(), 2, y.data(), 1, out.data());
+  for (size_t i = 0; i < N / 2; i++) assert(close(out[i], x[2 * i] / y[i]));
+
+  k.neg(N, x.data(), out.data());
+  for (size_t i = 0; i < N; i++) assert(out[i] == -x[i]);
+  k.inv(N, x.data(), out.data());
+  for (size_t i = 0; i < N; i++) assert(close(out[i], 1 / x[i]));
+  k.root(N, x.data(), out.data());
+  for (size_t i = 0; i < N; i++) assert(close(out[i], std::sqrt(x[i])));
+
+  // exp and log are within an ulp or two of libm, the fast variants within their documented bounds
+  std::vector<float> wide(N);
+  for (size_t i = 0; i < N; i++) wide[i] = -80.0f + 160.0f * i / N;
+  k.exp(N, wide.data(), out.data());
+  for (size_t i = 0; i < N; i++) assert(fabs(out[i] - std::exp(wide[i])) <= 2.5e-7 * std::exp(wide[i]));
+  k.exp_fast(N, wide.data(), out.data());
+  for (size_t i = 0; i < N; i++) assert(fabs(out[i] - std::exp(wide[i])) <= 6e-5 * std::exp(wide[i]));
+  for (size_t i = 0; i < N; i++) wide[i] = std::exp(wide[i]);
+  k.log(N, wide.data(), out.data());
+  for (size_t i = 0; i < N; i++) assert(fabs(out[i] - std::log(wide[i])) <= 2.5e-7 * (1 + fabs(std::log(wide[i]))));
+  k.log_fast(N, wide.data(), out.data());
+  for (size_t i = 0; i < N; i++) assert(fabs(out[i] - std::log(wide[i])) <= 7e-5);
+  k.inv_fast(N, x.data(), out.data());
+  for (size_t i = 0; i < N; i++) assert(close(out[i], 1 / x[i]));
+
+  // special values
+  std::vector<float> special = {0.0f, -1.0f, INFINITY, -INFINITY, NAN, 100.0f, -100.0f, 1e-40f};
+  std::vector<float> special_out(special.size());
+  k.exp(special.size(), special.data(), special_out.data());
+  assert(special_out[0] == 1 && special_out[2] == INFINITY && special_out[3] == 0);
+  assert(std::isnan(special_out[4]) && special_out[5] == INFINITY && special_out[6] == 0);
+  k.log(special.size(), special.data(), special_out.data());
+  assert(special_out[0] == -INFINITY && std::isnan(special_out[1]) && special_out[2] == INFINITY);
+  assert(std::isnan(special_out[3]) && std::isnan(special_out[4]) && close(special_out[7], std::log(1e-40f)));
+
+  out = y;
+  k.axpy(N, 3.0f, x.data(), out.data());
+  for (size_t i = 0; i < N; i++) assert(close(out[i], y[i] + 3 * x[i]));
+  out = y;
+  k.add_square_scaled(N, 0.5f, x.data(), out.data());
+  for (size_t i = 0; i < N; i++) assert(close(out[i], y[i] + 0.5f * x[i] * x[i]));
+  out = y;
+  k.adam_update(N, out.data(), x.data(), y.data(), 0.1f, 1e-8f);
+  for (size_t i = 0; i < N; i++) assert(close(out[i], y[i] - 0.1f * x[i] / std::sqrt(y[i])));
+
+  // a transposed A and sizes that leave partial panels in every dimension
+  const size_t M = 67, P = 41, K = 300;
+  std::vector<float> a(K * M), b(K * P), c(M * P, 1.0f);
+  for (float& v : a) v = d(generator);
+  for (float& v : b) v = d(generator);
+  k.sgemm(M, P, K, a.data(), 1, M, b.data(), P, 1, c.data(), P, 1);
+  for (size_t i = 0; i < M; i++) {
+    for (size_t j = 0; j < P; j++) {
+      float expected = 1.0f;
+      for (size_t p = 0; p < K; p++) expected += a[p * M + i] * b[p * P + j];
+      assert(close(c[i * P + j], expected));
+    }
+  }
+}
+
+int main() {
+  for (auto isa : {gooch::kernels::Isa::kSse, gooch::kernels::Isa::kAvx2, gooch::kernels::Isa::kAvx512}) {
+    if (gooch::kernels::Supported(isa)) check(isa);
+  }
+  return 0;
+}
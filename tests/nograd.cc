@@ -0,0 +1,65 @@
+#include "tensor.h"
+#include "helpers.h"
+#include "autograd.h"
+#include <cassert>
+#include <cmath>
+#include <memory>
+#include <stdexcept>
+
+int main() {
+  const size_t N = 8, M = 5;
+  gooch::Tensor x = gooch::randn({N, M});
+  gooch::Tensor w = gooch::randn({M, 3});
+  assert(gooch::autograd::GradEnabled());
+  assert(x.requires_grad());
+
+  // nothing is recorded and intermediates die with their last handle
+  std::weak_ptr<float> hidden;
+  gooch::Tensor y = gooch::zeros({});
+  {
+    gooch::autograd::NoGradMode mode;
+    assert(!gooch::autograd::GradEnabled());
+    gooch::Tensor h = gooch::Einsum(x, w, "n m, m k -> n k");
+    hidden = h.data();
+    y = gooch::exp(h(gooch::Slice::all(), gooch::Slice(0, 1)));
+    assert(h.grad_fn_ == nullptr && y.grad_fn_ == nullptr);
+    assert(!y.requires_grad());
+    {
+      gooch::autograd::NoGradMode nested;
+    }
+    assert(!gooch::autograd::GradEnabled());
+  }
+  assert(gooch::autograd::GradEnabled());
+  assert(hidden.expired());
+  bool thrown = false;
+  try {
+    gooch::reduceSum(y, {0, 1}).Backward();
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  // the same values as with recording on
+  gooch::Tensor recorded = gooch::exp(gooch::Einsum(x, w, "n m, m k -> n k")(gooch::Slice::all(), gooch::Slice(0, 1)));
+  assert(recorded.grad_fn_ != nullptr);
+  for (size_t i = 0; i < N * 2; i++) {
+    assert(at(y, i) == at(recorded, i));
+  }
+
+  // inputs that do not require a gradient get none, the others are unchanged
+  gooch::Tensor loss = gooch::reduceSum(gooch::Einsum(x, w, "n m, m k -> n k") * gooch::FromVector(2.0f), {0, 1});
+  loss.Backward();
+  std::vector<float> expected(w.grad().data().get(), w.grad().data().get() + M * 3);
+  w.ZeroGrad();
+  x.ZeroGrad();
+  x.SetRequiresGrad(false);
+  gooch::Tensor data_only = x * x;
+  assert(data_only.grad_fn_ == nullptr && !data_only.requires_grad());
+  loss = gooch::reduceSum(gooch::Einsum(x, w, "n m, m k -> n k") * gooch::FromVector(2.0f), {0, 1});
+  loss.Backward();
+  for (size_t i = 0; i < x.size(); i++) assert(at(x.grad(), i) == 0);
+  for (size_t i = 0; i < M * 3; i++) {
+    assert(fabs(at(w.grad(), i) - expected[i]) < 1e-5);
+  }
+  return 0;
+}
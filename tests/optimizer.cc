@@ -0,0 +1,87 @@
+#include "tensor.h"
+#include "helpers.h"
+#include "glas.h"
+#include "sgd.cc"
+#include <cassert>
+#include <cmath>
+#include <vector>
+
+// sets the gradient of p to g
+void set_grad(gooch::Tensor& p, const std::vector<float>& g) {
+  p.TouchGrad();
+  std::copy(g.begin(), g.end(), p.grad_data().get());
+}
+
+int main() {
+  // sizes that leave vector tails and one that spans several chunks
+  std::vector<std::vector<size_t>> shapes = {{3}, {17, 5}, {1}, {70000}};
+
+  // SGD matches its definition as separate passes, bit for bit
+  {
+    std::vector<gooch::Tensor> params, copies, m, v;
+    for (auto& shape : shapes) {
+      params.push_back(gooch::randn(shape));
+      copies.push_back(gooch::zeros(shape) + params.back());
+      m.push_back(gooch::zeros(shape));
+      v.push_back(gooch::zeros(shape));
+    }
+    gooch::SGD sgd(params, 1e-2f);
+    for (int step = 0; step < 3; step++) {
+      for (size_t i = 0; i < params.size(); i++) {
+        size_t N = params[i].size();
+        std::vector<float> g(N);
+        for (size_t j = 0; j < N; j++) g[j] = std::sin(j * 0.37f + step + i);
+        set_grad(params[i], g);
+        float* x = copies[i].data().get();
+        gooch::glas::mul_cons_simd(N, m[i].data().get(), 0.9f);
+        gooch::glas::axpy(N, 1.0f - 0.9f, g.data(), m[i].data().get());
+        gooch::glas::mul_cons_simd(N, v[i].data().get(), 0.99f);
+        gooch::glas::inplace_add_square_const(N, 1.0f - 0.99f, g.data(), v[i].data().get());
+        gooch::glas::adam_update(N, x, m[i].data().get(), v[i].data().get(), 1e-2f, 1e-8f);
+      }
+      sgd.step();
+      for (size_t i = 0; i < params.size(); i++) {
+        for (size_t j = 0; j < params[i].size(); j++) {
+          assert(at(params[i], j) == at(copies[i], j));
+        }
+      }
+    }
+  }
+
+  // Adam and AdamW against a scalar reference in double precision
+  for (float weight_decay : {0.0f, 0.1f}) {
+    const float lr = 1e-2f, beta1 = 0.9f, beta2 = 0.999f, eps = 1e-8f;
+    std::vector<gooch::Tensor> params;
+    std::vector<std::vector<double>> expected, m, v;
+    for (auto& shape : shapes) {
+      params.push_back(gooch::randn(shape));
+      expected.emplace_back(params.back().data().get(), params.back().data().get() + params.back().size());
+      m.emplace_back(params.back().size(), 0.0);
+      v.emplace_back(params.back().size(), 0.0);
+    }
+    gooch::Adam adam(params, lr, beta1, beta2, eps, weight_decay);
+    for (int t = 1; t <= 5; t++) {
+      for (size_t i = 0; i < params.size(); i++) {
+        size_t N = params[i].size();
+        std::vector<float> g(N);
+        for (size_t j = 0; j < N; j++) g[j] = std::cos(j * 0.11f + t * 3 + i);
+        set_grad(params[i], g);
+        for (size_t j = 0; j < N; j++) {
+          m[i][j] = beta1 * m[i][j] + (1 - beta1) * g[j];
+          v[i][j] = beta2 * v[i][j] + (1 - beta2) * g[j] * g[j];
+          double m_hat = m[i][j] / (1 - std::pow((double) beta1, t));
+          double v_hat = v[i][j] / (1 - std::pow((double) beta2, t));
+          expected[i][j] -= lr * weight_decay * expected[i][j];
+          expected[i][j] -= lr * m_hat / (std::sqrt(v_hat) + eps);
+        }
+      }
+      adam.step();
+      for (size_t i = 0; i < params.size(); i++) {
+        for (size_t j = 0; j < params[i].size(); j++) {
+          assert(fabs(at(params[i], j) - expected[i][j]) < 1e-5 * (1 + fabs(expected[i][j])));
+        }
+      }
+    }
+  }
+  return 0;
+}
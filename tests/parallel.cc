@@ -0,0 +1,99 @@
+#include "tensor.h"
+#include "helpers.h"
+#include "glas.h"
+#include "parallel.h"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cmath>
+#include <thread>
+#include <vector>
+
+int main() {
+  gooch::parallel::SetNumThreads(4);
+  assert(gooch::parallel::GetNumThreads() == 4);
+
+  // every index is visited exactly once, nested calls run serially
+  std::vector<std::atomic<int>> visits(100000);
+  gooch::parallel::parallel_for(0, visits.size(), 1000, [&] (size_t begin, size_t end) {
+    gooch::parallel::parallel_for(begin, end, 1, [&] (size_t inner_begin, size_t inner_end) {
+      for (size_t i = inner_begin; i < inner_end; i++) {
+        visits[i]++;
+      }
+    });
+  });
+  for (auto& count : visits) {
+    assert(count == 1);
+  }
+
+  // large kernels give the same answer as their serial definition
+  const size_t N = 300, M = 400;
+  gooch::Tensor a = gooch::randn({N, M});
+  gooch::Tensor b = gooch::randn({M});
+  gooch::Tensor sum = a + b;
+  gooch::Tensor product = a * b;
+  gooch::Tensor neg = -a;
+  gooch::Tensor rows = gooch::glas::reduceSum(a, {1});
+  for (size_t i = 0; i < N; i++) {
+    float row = 0;
+    for (size_t j = 0; j < M; j++) {
+      assert(fabs(at(sum, i * M + j) - (at(a, i * M + j) + at(b, j))) < 1e-6);
+      assert(fabs(at(product, i * M + j) - at(a, i * M + j) * at(b, j)) < 1e-6);
+      assert(at(neg, i * M + j) == -at(a, i * M + j));
+      row += at(a, i * M + j);
+    }
+    assert(fabs(at(rows, i) - row) < 1e-3);
+  }
+
+  gooch::Tensor w = gooch::randn({M, N});
+  gooch::Tensor c = gooch::glas::einsum(a, w, "n m, m k -> n k");
+  for (size_t i = 0; i < N; i += 7) {
+    for (size_t k = 0; k < N; k += 5) {
+      float expected = 0;
+      for (size_t j = 0; j < M; j++) {
+        expected += at(a, i * M + j) * at(w, j * N + k);
+      }
+      assert(fabs(at(c, i * N + k) - expected) < 1e-3);
+    }
+  }
+
+  // exceptions thrown by a chunk reach the caller
+  bool thrown = false;
+  try {
+    gooch::parallel::parallel_for(0, 1000, 10, [] (size_t begin, size_t) {
+      if (begin == 0) throw std::runtime_error("chunk failed");
+    });
+  } catch (const std::runtime_error&) {
+    thrown = true;
+  }
+  assert(thrown);
+
+  // resizing while other threads are in parallel_for, down to a single thread or
+  // from inside a chunk, leaves their jobs running on the pool they started with
+  std::atomic<bool> stop{false};
+  std::vector<std::thread> callers;
+  std::vector<std::atomic<size_t>> totals(3);
+  for (size_t t = 0; t < totals.size(); t++) {
+    callers.emplace_back([&, t] {
+      while (!stop) {
+        std::atomic<size_t> total{0};
+        gooch::parallel::parallel_for(0, 10000, 100, [&] (size_t begin, size_t end) {
+          total += end - begin;
+        });
+        assert(total == 10000);
+        totals[t]++;
+      }
+    });
+  }
+  for (size_t i = 0; std::any_of(totals.begin(), totals.end(), [] (const std::atomic<size_t>& total) { return total < 200; }); i++) {
+    gooch::parallel::SetNumThreads(i % 2 == 0 ? 1 : 4);
+  }
+  gooch::parallel::SetNumThreads(4);
+  gooch::parallel::parallel_for(0, 10000, 100, [] (size_t begin, size_t) {
+    if (begin == 0) gooch::parallel::SetNumThreads(3);
+  });
+  stop = true;
+  for (std::thread& caller : callers) caller.join();
+  assert(gooch::parallel::GetNumThreads() == 3);
+  return 0;
+}
@@ -0,0 +1,94 @@
+#include "tensor.h"
+#include "helpers.h"
+#include "parameters.h"
+#include "sgd.cc"
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <vector>
+
+// a small model: the parameters and a loss over them
+struct Model {
+  gooch::Tensor w = gooch::randn({7, 3});
+  gooch::Tensor b = gooch::randn({3});
+  gooch::Tensor s = gooch::randn({});
+
+  gooch::Tensor loss(const gooch::Tensor& x) {
+    gooch::Tensor y = gooch::Einsum(x, w, "n k, k m -> n m") + b;
+    return gooch::reduceSum(y * y * s, {0, 1});
+  }
+};
+
+int main() {
+  gooch::Tensor x = gooch::randn({5, 7});
+  Model grouped, separate;
+  separate.w = gooch::zeros({7, 3}) + grouped.w;
+  separate.b = gooch::zeros({3}) + grouped.b;
+  separate.s = gooch::zeros({}) + grouped.s;
+  std::vector<float> w_values(grouped.w.data().get(), grouped.w.data().get() + 21);
+
+  gooch::ParameterGroup group({&grouped.w, &grouped.b, &grouped.s});
+  // every slot is padded to the alignment
+  assert(group.size() == 32 + 16 + 16);
+  for (gooch::Tensor* p : group.params()) {
+    assert(reinterpret_cast<uintptr_t>(p->data().get()) % gooch::allocator::kAlignment == 0);
+    assert(p->data().get() >= group.flat().data().get() && p->data().get() < group.flat().data().get() + group.size());
+  }
+  for (size_t i = 0; i < 21; i++) assert(at(grouped.w, i) == w_values[i]);
+
+  // gradients land in the arena, the optimizer steps it in one pass
+  gooch::SGD flat_sgd(group, 1e-2f);
+  gooch::SGD sgd({separate.w, separate.b, separate.s}, 1e-2f);
+  for (int step = 0; step < 3; step++) {
+    group.ZeroGrad();
+    for (gooch::Tensor p : {separate.w, separate.b, separate.s}) p.ZeroGrad();
+    grouped.loss(x).Backward();
+    separate.loss(x).Backward();
+    assert(grouped.w.grad_data().get() == group.flat().grad_data().get());
+    for (size_t i = 0; i < 21; i++) assert(fabs(at(grouped.w.grad(), i) - at(separate.w.grad(), i)) < 1e-4);
+    flat_sgd.step();
+    sgd.step();
+    // the same update, up to the rounding of vector tails the padded arena does not have
+    for (size_t i = 0; i < 21; i++) assert(fabs(at(grouped.w, i) - at(separate.w, i)) < 1e-6);
+    for (size_t i = 0; i < 3; i++) assert(fabs(at(grouped.b, i) - at(separate.b, i)) < 1e-6);
+    assert(fabs(at(grouped.s, 0) - at(separate.s, 0)) < 1e-6);
+  }
+
+  // one memset clears every gradient
+  group.ZeroGrad();
+  for (size_t i = 0; i < group.size(); i++) assert(at(group.flat().grad(), i) == 0);
+
+  // zeroing a parameter on its own clears its slice and keeps it bound to the arena
+  grouped.loss(x).Backward();
+  for (gooch::Tensor* p : group.params()) p->ZeroGrad();
+  assert(grouped.b.grad_data().get() == group.flat().grad_data().get() + 32);
+  for (size_t i = 0; i < group.size(); i++) assert(at(group.flat().grad(), i) == 0);
+  grouped.loss(x).Backward();
+  assert(at(group.flat().grad(), 32) == at(grouped.b.grad(), 0) && at(grouped.b.grad(), 0) != 0);
+
+  // a checkpoint restores the values and the optimizer state
+  std::stringstream checkpoint;
+  group.Save(checkpoint);
+  std::vector<float> saved(group.flat().data().get(), group.flat().data().get() + group.size());
+  std::vector<float> moments(flat_sgd.vel[0].data().get(), flat_sgd.vel[0].data().get() + group.size());
+  grouped.loss(x).Backward();
+  flat_sgd.step();
+  group.Load(checkpoint);
+  for (size_t i = 0; i < group.size(); i++) {
+    assert(at(group.flat(), i) == saved[i]);
+    assert(at(flat_sgd.vel[0], i) == moments[i]);
+  }
+
+  Model other;
+  gooch::ParameterGroup mismatched({&other.w, &other.b});
+  bool thrown = false;
+  try {
+    std::stringstream copy(checkpoint.str());
+    mismatched.Load(copy);
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  assert(thrown);
+  return 0;
+}
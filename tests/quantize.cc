@@ -0,0 +1,102 @@
+#include "tensor.h"
+#include "helpers.h"
+#include "glas.h"
+#include "kernels.h"
+#include "quantize.h"
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+// the product of the quantized operands, summed exactly like the kernel does
+float reference(const std::vector<int8_t>& a_q, float a_scale, const gooch::quantize::QuantizedTensor& w, size_t channel) {
+  int32_t sum = 0;
+  for (size_t p = 0; p < w.cols; p++) {
+    sum += a_q[p] * w.data.get()[channel * w.row_stride + p];
+  }
+  return (float) sum * a_scale * w.scales[channel];
+}
+
+// the euclidean norm of row r of a contiguous matrix with n columns
+float norm(const gooch::Tensor& t, size_t r, size_t n) {
+  float sum = 0;
+  for (size_t i = 0; i < n; i++) sum += at(t, r * n + i) * at(t, r * n + i);
+  return std::sqrt(sum);
+}
+
+int main() {
+  const size_t B = 37, I = 100, H = 50;
+  gooch::Tensor a = gooch::randn({B, I});
+  gooch::Tensor w = gooch::randn({H, I});
+
+  // symmetric per channel, each channel reaches +-127 and rounds to within half a step
+  gooch::quantize::QuantizedTensor q = gooch::quantize::QuantizeWeights(w, 0);
+  assert(q.channels == H && q.cols == I && q.row_stride % gooch::quantize::kRowAlignment == 0);
+  gooch::Tensor restored = gooch::quantize::Dequantize(q);
+  for (size_t c = 0; c < H; c++) {
+    int max_abs = 0;
+    for (size_t i = 0; i < I; i++) {
+      int8_t v = q.data.get()[c * q.row_stride + i];
+      max_abs = std::max(max_abs, std::abs((int) v));
+      assert(fabs(at(restored, c * I + i) - at(w, c * I + i)) <= 0.5f * q.scales[c] * 1.0001f);
+    }
+    assert(max_abs == 127);
+  }
+
+  std::vector<std::vector<int8_t>> a_q(B, std::vector<int8_t>(I));
+  std::vector<float> a_scale(B);
+  for (size_t b = 0; b < B; b++) {
+    a_scale[b] = gooch::quantize::QuantizeRow(I, a.data().get() + a.offset() + b * I, a_q[b].data());
+  }
+
+  // every kernel sums the int8 products exactly, the result is close to the float32 product
+  gooch::Tensor exact = gooch::glas::einsum(a, w, "batch input, hidden input -> batch hidden");
+  for (auto isa : {gooch::kernels::Isa::kSse, gooch::kernels::Isa::kAvx2, gooch::kernels::Isa::kAvx512}) {
+    if (!gooch::kernels::Supported(isa)) continue;
+    gooch::kernels::Select(isa);
+    gooch::Tensor c = gooch::quantize::Einsum(a, q, "batch input, hidden input -> batch hidden");
+    assert(c.shape() == std::vector<size_t>({B, H}));
+    for (size_t b = 0; b < B; b++) {
+      for (size_t h = 0; h < H; h++) {
+        float expected = reference(a_q[b], a_scale[b], q, h);
+        assert(fabs(at(c, b * H + h) - expected) <= 1e-5f * (1 + fabs(expected)));
+        assert(fabs(at(c, b * H + h) - at(exact, b * H + h)) < 0.01f * norm(a, b, I) * norm(w, h, I));
+      }
+    }
+  }
+
+  // weights stored input-major quantize along their second axis, and batch labels of a loop
+  gooch::Tensor wt = gooch::randn({I, H});
+  gooch::quantize::QuantizedTensor qt = gooch::quantize::QuantizeWeights(wt, 1);
+  gooch::Tensor x = gooch::randn({3, 5, I});
+  gooch::Tensor expected = gooch::glas::einsum(x, wt, "s t i, i h -> t s h");
+  gooch::Tensor c = gooch::quantize::Einsum(x, qt, "s t i, i h -> t s h");
+  assert(c.shape() == expected.shape());
+  assert(c.is_contiguous() && expected.is_contiguous());
+  float scale = 0;
+  for (size_t i = 0; i < 15 * H; i++) scale = std::max(scale, std::fabs(at(expected, i)));
+  for (size_t i = 0; i < 15 * H; i++) {
+    assert(fabs(at(c, i) - at(expected, i)) < 0.05f * scale);
+  }
+
+  // the weights are only usable along the channel axis they were quantized for
+  gooch::quantize::QuantizedTensor square = gooch::quantize::QuantizeWeights(gooch::randn({I, I}), 0);
+  for (const char* equation : {"batch input, input hidden -> batch hidden", "batch input, hidden input -> batch input"}) {
+    bool thrown = false;
+    try {
+      gooch::quantize::Einsum(a, square, equation);
+    } catch (const std::invalid_argument&) {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+  bool thrown = false;
+  try {
+    gooch::quantize::QuantizeWeights(x, 0);
+  } catch (const std::invalid_argument&) {
+    thrown = true;
+  }
+  assert(thrown);
+  return 0;
+}
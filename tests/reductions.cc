@@ -0,0 +1,135 @@
+#include "tensor.h"
+#include "helpers.h"
+#include "glas.h"
+#include <cassert>
+#include <cmath>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+// element (i, j, k) of a 3d tensor through its strides
+float at3(const gooch::Tensor& t, size_t i, size_t j, size_t k) {
+  std::vector<int> s = t.strides();
+  return t.data().get()[t.offset() + i * s[0] + j * s[1] + k * s[2]];
+}
+
+int main() {
+  // odd sizes so every kernel has a tail, and a permuted view of the same data
+  const size_t A = 5, B = 7, C = 45;
+  gooch::Tensor x = gooch::randn({A, B, C});
+  gooch::Tensor base = gooch::randn({C, A, B});
+  gooch::Tensor permuted({A, B, C}, {(int) B, 1, (int) (A * B)}, 0, base);
+
+  for (const gooch::Tensor& t : {x, permuted}) {
+    for (std::unordered_set<size_t> axes : {std::unordered_set<size_t>{2}, {1}, {0}, {0, 2}, {0, 1, 2}}) {
+      gooch::Tensor sum = gooch::glas::reduceSum(t, axes);
+      gooch::Tensor max = gooch::glas::reduceMax(t, axes);
+      gooch::Tensor min = gooch::glas::reduceMin(t, axes);
+      gooch::Tensor mean = gooch::reduceMean(t, axes);
+      gooch::Tensor var = gooch::variance(t, axes, true);
+      std::vector<size_t> dims = {A, B, C};
+      std::vector<size_t> kept;
+      for (size_t d = 0; d < 3; d++) if (!axes.count(d)) kept.push_back(d);
+      size_t count = 1;
+      for (size_t d : axes) count *= dims[d];
+      size_t out_size = 1;
+      for (size_t d : kept) out_size *= dims[d];
+      std::vector<double> e_sum(out_size, 0), e_sq(out_size, 0), e_max(out_size, -INFINITY), e_min(out_size, INFINITY);
+      auto out_index = [&] (size_t i, size_t j, size_t k) {
+        size_t idx[3] = {i, j, k}, o = 0;
+        for (size_t d : kept) o = o * dims[d] + idx[d];
+        return o;
+      };
+      for (size_t i = 0; i < A; i++) for (size_t j = 0; j < B; j++) for (size_t k = 0; k < C; k++) {
+        size_t o = out_index(i, j, k);
+        double v = at3(t, i, j, k);
+        e_sum[o] += v;
+        e_max[o] = std::max(e_max[o], v);
+        e_min[o] = std::min(e_min[o], v);
+      }
+      for (size_t i = 0; i < A; i++) for (size_t j = 0; j < B; j++) for (size_t k = 0; k < C; k++) {
+        size_t o = out_index(i, j, k);
+        double d = at3(t, i, j, k) - e_sum[o] / count;
+        e_sq[o] += d * d;
+      }
+      for (size_t o = 0; o < out_size; o++) {
+        assert(fabs(at(sum, o) - e_sum[o]) < 1e-4 * (1 + fabs(e_sum[o])));
+        assert(at(max, o) == (float) e_max[o]);
+        assert(at(min, o) == (float) e_min[o]);
+        assert(fabs(at(mean, o) - e_sum[o] / count) < 1e-5);
+        assert(fabs(at(var, o) - e_sq[o] / (count - 1)) < 1e-4 * (1 + e_sq[o] / (count - 1)));
+      }
+    }
+
+    // the first extremum along each axis
+    for (size_t axis = 0; axis < 3; axis++) {
+      gooch::Tensor amax = gooch::argmax(t, axis);
+      gooch::Tensor amin = gooch::argmin(t, axis);
+      std::vector<size_t> dims = {A, B, C};
+      dims.erase(dims.begin() + axis);
+      assert(amax.shape() == dims);
+      for (size_t p = 0; p < dims[0]; p++) for (size_t q = 0; q < dims[1]; q++) {
+        auto value = [&] (size_t n) {
+          size_t idx[3];
+          idx[axis] = n;
+          idx[axis == 0 ? 1 : 0] = p;
+          idx[axis == 2 ? 1 : 2] = q;
+          return at3(t, idx[0], idx[1], idx[2]);
+        };
+        size_t len = axis == 0 ? A : axis == 1 ? B : C;
+        size_t best_max = 0, best_min = 0;
+        for (size_t n = 1; n < len; n++) {
+          if (value(n) > value(best_max)) best_max = n;
+          if (value(n) < value(best_min)) best_min = n;
+        }
+        assert(at(amax, p * dims[1] + q) == (float) best_max);
+        assert(at(amin, p * dims[1] + q) == (float) best_min);
+      }
+    }
+  }
+
+  // pairwise sums keep a long sum close, a single running float drifts by ~1e-2
+  const size_t N = 1 << 22;
+  gooch::Tensor tenths = gooch::zeros({N}) + gooch::FromVector(0.1f);
+  double exact = (double) 0.1f * N;
+  assert(fabs(at(gooch::glas::reduceSum(tenths, {0}), 0) - exact) < 1e-6 * exact);
+
+  // gradients: max splits between ties, mean spreads evenly, variance is 2 (x - mean) / n
+  gooch::Tensor v = gooch::FromVector(std::vector<std::vector<float>>{{1, 3, 3, 2}, {4, 0, -1, 4}});
+  gooch::reduceSum(gooch::reduceMax(v, {1}), {0}).Backward();
+  std::vector<float> max_grad = {0, 0.5f, 0.5f, 0, 0.5f, 0, 0, 0.5f};
+  for (size_t i = 0; i < 8; i++) assert(at(v.grad(), i) == max_grad[i]);
+  v.ZeroGrad();
+  gooch::reduceSum(gooch::reduceMin(v, {0}), {0}).Backward();
+  std::vector<float> min_grad = {1, 0, 0, 1, 0, 1, 1, 0};
+  for (size_t i = 0; i < 8; i++) assert(at(v.grad(), i) == min_grad[i]);
+  v.ZeroGrad();
+  gooch::reduceMean(v, {0, 1}).Backward();
+  for (size_t i = 0; i < 8; i++) assert(at(v.grad(), i) == 0.125f);
+  v.ZeroGrad();
+  gooch::reduceSum(gooch::variance(v, {1}), {0}).Backward();
+  std::vector<float> values = {1, 3, 3, 2, 4, 0, -1, 4};
+  for (size_t i = 0; i < 8; i++) {
+    float mean = i < 4 ? 2.25f : 1.75f;
+    assert(fabs(at(v.grad(), i) - 2 * (values[i] - mean) / 4) < 1e-6);
+  }
+
+  // axes past the rank are rejected by every reduction
+  std::vector<std::function<void()>> out_of_range = {
+    [&] { gooch::argmax(v, 2); },
+    [&] { gooch::reduceSum(v, {2}); },
+    [&] { gooch::reduceMax(v, {0, 5}); },
+    [&] { gooch::reduceMean(v, {2}); },
+    [&] { gooch::variance(v, {2}); },
+  };
+  for (const std::function<void()>& reduce : out_of_range) {
+    bool thrown = false;
+    try {
+      reduce();
+    } catch (const std::invalid_argument&) {
+      thrown = true;
+    }
+    assert(thrown);
+  }
+  return 0;
+}
@@ -0,0 +1,125 @@
+#include "tensor.h"
+#include "glas.h"
+#include "utils.h"
+#include <cassert>
+#include <cmath>
+
+int main() {
+  // contiguous dimensions collapse into one row, broadcast ones into a zero stride
+  gooch::utils::StridedIterator flat({4, 1, 5, 6}, {{30, 30, 6, 1}, {0, 0, 0, 0}});
+  assert(flat.ndim() == 1 && flat.row_size() == 120);
+  assert(flat.row_stride(0) == 1 && flat.row_stride(1) == 0);
+
+  // a transposed walk keeps both dimensions and visits rows in order
+  gooch::utils::StridedIterator transposed({3, 4}, {{1, 3}});
+  assert(transposed.ndim() == 2 && transposed.steps() == 3);
+  for (size_t i = 0; i < 3; i++, transposed.next()) {
+    assert(transposed.offset(0) == (long) i);
+  }
+
+  // copies of transposed views, large enough to cross tiles, match element by element
+  const size_t B = 3, N = 70, M = 45;
+  std::vector<float> src(B * N * M), dst(B * N * M);
+  for (size_t i = 0; i < src.size(); i++) src[i] = (float) i;
+  gooch::utils::StridedCopy({B, M, N}, src.data(), {(int) (N * M), 1, (int) M}, dst.data(), {(int) (N * M), (int) N, 1});
+  for (size_t b = 0; b < B; b++) {
+    for (size_t i = 0; i < M; i++) {
+      for (size_t j = 0; j < N; j++) {
+        assert(dst[b * N * M + i * N + j] == src[b * N * M + j * M + i]);
+      }
+    }
+  }
+
+  // assigning through a strided view broadcasts the source
+  gooch::Tensor target = gooch::zeros({N, M});
+  gooch::Tensor row = gooch::randn({M});
+  gooch::View columns = target(gooch::Slice::all(), gooch::Slice(0, -1, 2));
+  gooch::Tensor every_other = row(gooch::Slice(0, -1, 2));
+  columns = every_other;
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < M; j++) {
+      float expected = j % 2 == 0 ? row.data().get()[j] : 0.0f;
+      assert(target.data().get()[i * M + j] == expected);
+    }
+  }
+
+  // reductions of a non-contiguous view over every subset of axes
+  gooch::Tensor base = gooch::randn({B, 2 * N, M});
+  gooch::Tensor view = base(gooch::Slice::all(), gooch::Slice(1, -1, 2));
+  for (int mask = 1; mask < 8; mask++) {
+    std::unordered_set<size_t> axes;
+    for (size_t d = 0; d < 3; d++) if (mask & (1 << d)) axes.insert(d);
+    gooch::Tensor sum = gooch::glas::reduceSum(view, axes);
+    std::vector<float> expected(sum.size(), 0.0f);
+    for (size_t b = 0; b < B; b++) {
+      for (size_t i = 0; i < N; i++) {
+        for (size_t j = 0; j < M; j++) {
+          size_t out = 0;
+          if (!axes.count(0)) out = out * B + b;
+          if (!axes.count(1)) out = out * N + i;
+          if (!axes.count(2)) out = out * M + j;
+          expected[out] += base.data().get()[b * 2 * N * M + (2 * i + 1) * M + j];
+        }
+      }
+    }
+    for (size_t k = 0; k < expected.size(); k++) {
+      assert(fabs(sum.data().get()[k] - expected[k]) < 1e-3 * (1 + fabs(expected[k])));
+    }
+  }
+
+  // contiguity survives size-1 dimensions but not strided slices
+  assert(target.is_contiguous() && !columns.is_contiguous());
+  assert(target(3).is_contiguous() && target(gooch::Slice(2, 4)).is_contiguous());
+  assert(gooch::Tensor({N, 1, M}, {(int) M, 7, 1}, 0, target.data()).is_contiguous());
+
+  // in-place accumulation into a strided target, with and without broadcasting
+  gooch::Tensor acc = gooch::zeros({N, M});
+  gooch::View acc_columns = acc(gooch::Slice::all(), gooch::Slice(0, -1, 2));
+  gooch::glas::add_(every_other, acc_columns);
+  gooch::glas::add_(columns, acc_columns);
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < M; j++) {
+      float expected = j % 2 == 0 ? 2 * row.data().get()[j] : 0.0f;
+      assert(acc.data().get()[i * M + j] == expected);
+    }
+  }
+
+  // unary ops and reshapes of strided views read the view, not the base buffer
+  gooch::Tensor negated = -columns;
+  gooch::Tensor flat_columns = gooch::reshape(columns, {N * ((M + 1) / 2)});
+  for (size_t i = 0; i < N; i++) {
+    for (size_t j = 0; j < (M + 1) / 2; j++) {
+      float expected = target.data().get()[i * M + 2 * j];
+      assert(negated.data().get()[i * ((M + 1) / 2) + j] == -expected);
+      assert(flat_columns.data().get()[i * ((M + 1) / 2) + j] == expected);
+    }
+  }
+
+  // printing walks the view in row-major order
+  gooch::Tensor small = gooch::FromVector(std::vector<std::vector<float>>{{1, 2, 3}, {4, 5, 6}});
+  assert(small(gooch::Slice::all(), gooch::Slice(0, -1, 2)).str() == "Tensor of shape (2, 2)\n[[1.000, 3.000],\n[4.000, 6.000]]");
+
+  // shapes and strides are views of the tensor's own metadata, inline up to kInlineDims
+  gooch::utils::Span<size_t> shape = small.shape();
+  assert(shape.data() == small.shape().data() && shape == std::vector<size_t>({2, 3}));
+  gooch::utils::Shape inline_shape = shape;
+  inline_shape[0] = 5;
+  assert(small.shape()[0] == 2 && inline_shape != shape);
+  // past it they spill to the heap and keep working
+  std::vector<size_t> deep(gooch::utils::kInlineDims + 2, 1);
+  deep[0] = 2;
+  deep.back() = 3;
+  gooch::Tensor high = gooch::ones(deep);
+  gooch::Tensor summed = gooch::reduceSum(high + high, {0});
+  assert(summed.shape().size() == deep.size() - 1 && summed.strides().back() == 1);
+  for (size_t i = 0; i < 3; i++) assert(summed.data().get()[i] == 4.0f);
+  gooch::utils::Strides spilled = high.strides();
+  spilled.resize(2);
+  assert(spilled[0] == 3 && spilled[1] == 3);
+  // views of any rank build their shape with push_back, which spills the same way
+  gooch::utils::Shape grown;
+  for (size_t i = 0; i <= gooch::utils::kInlineDims; i++) grown.push_back(i + 1);
+  assert(grown.size() == gooch::utils::kInlineDims + 1 && grown[0] == 1 && grown[gooch::utils::kInlineDims] == gooch::utils::kInlineDims + 1);
+  assert(high(1).shape() == std::vector<size_t>(deep.begin() + 1, deep.end()));
+  return 0;
+}